@@ -0,0 +1,546 @@
+#include "AsyncFileReader.h"
+#include <deque>
+
+#if ! JUCE_WINDOWS
+ #include <fcntl.h>
+ #include <sys/stat.h>
+ #include <unistd.h>
+ #include <cerrno>
+#endif
+
+#if JUCE_LINUX && __has_include(<linux/io_uring.h>)
+ #define LOOPY_IO_URING 1
+ #include <linux/io_uring.h>
+ #include <sys/mman.h>
+ #include <sys/syscall.h>
+#else
+ #define LOOPY_IO_URING 0
+#endif
+
+//==============================================================================
+AsyncFileReader::Handle::~Handle()
+{
+   #if ! JUCE_WINDOWS
+    if (fd >= 0)
+        ::close(fd);
+   #endif
+}
+
+int AsyncFileReader::Handle::readAt(juce::int64 offset, void* dest, int numBytes)
+{
+   #if JUCE_WINDOWS
+    const juce::ScopedLock sl(streamLock);
+    if (!stream->setPosition(offset))
+        return -1;
+    return stream->read(dest, numBytes);
+   #else
+    int total = 0;
+    while (total < numBytes) {
+        ssize_t n = ::pread(fd, static_cast<char*>(dest) + total, (size_t)(numBytes - total), (off_t)(offset + total));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return total > 0 ? total : -1;
+        if (n == 0)
+            break;
+        total += (int)n;
+    }
+    return total;
+   #endif
+}
+
+void AsyncFileReader::Handle::willNeed(juce::int64 offset, juce::int64 numBytes)
+{
+   #if JUCE_LINUX
+    posix_fadvise(fd, (off_t)offset, (off_t)numBytes, POSIX_FADV_WILLNEED);
+   #else
+    juce::ignoreUnused(offset, numBytes);
+   #endif
+}
+
+std::shared_ptr<AsyncFileReader::Handle> AsyncFileReader::open(const juce::File& file)
+{
+    std::shared_ptr<Handle> handle(new Handle());
+
+   #if JUCE_WINDOWS
+    handle->stream = file.createInputStream();
+    if (handle->stream == nullptr)
+        return nullptr;
+    handle->size = handle->stream->getTotalLength();
+   #else
+    handle->fd = ::open(file.getFullPathName().toRawUTF8(), O_RDONLY | O_CLOEXEC);
+    if (handle->fd < 0)
+        return nullptr;
+
+    struct stat info;
+    if (fstat(handle->fd, &info) != 0 || !S_ISREG(info.st_mode))
+        return nullptr;
+    handle->size = (juce::int64)info.st_size;
+
+   #if JUCE_LINUX
+    //doubles the kernels read ahead window for this file
+    posix_fadvise(handle->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+   #endif
+   #endif
+
+    return handle;
+}
+
+//==============================================================================
+#if LOOPY_IO_URING
+
+/// <summary>
+/// a minimal io_uring through the raw syscalls, no liburing needed.
+/// Requests are submitted from any thread, the completions are collected by this thread.
+/// </summary>
+class AsyncFileReader::Ring : private juce::Thread
+{
+public:
+    static std::unique_ptr<Ring> create()
+    {
+        std::unique_ptr<Ring> ring(new Ring());
+        if (!ring->setUp(queueDepth) || !ring->supportsRead())
+            return nullptr;
+
+        ring->startThread(juce::Thread::Priority::high);
+        return ring;
+    }
+
+    ~Ring() override
+    {
+        if (isThreadRunning()) {
+            signalThreadShouldExit();
+
+            //a nop completion wakes the waiting thread
+            const juce::ScopedLock sl(lock);
+            if (io_uring_sqe* sqe = nextSqe()) {
+                sqe->opcode = IORING_OP_NOP;
+                sqe->user_data = wakeUp;
+                enter(1, 0, 0);
+            }
+        }
+        stopThread(2000);
+
+        if (sqes != nullptr)
+            munmap(sqes, sqesSize);
+        if (cqRing != nullptr && cqRing != sqRing)
+            munmap(cqRing, cqRingSize);
+        if (sqRing != nullptr)
+            munmap(sqRing, sqRingSize);
+        if (ringFd >= 0)
+            ::close(ringFd);
+    }
+
+    void submit(std::vector<Request>&& batch)
+    {
+        const juce::ScopedLock sl(lock);
+        for (Request& request : batch)
+            pending.push_back(std::move(request));
+
+        submitPending();
+    }
+
+private:
+    static constexpr unsigned queueDepth = 64;
+    static constexpr __u64 wakeUp = ~(__u64)0;
+
+    Ring() : juce::Thread("io_uring completions") {}
+
+    bool setUp(unsigned entries)
+    {
+        io_uring_params params{};
+        ringFd = (int)syscall(__NR_io_uring_setup, entries, &params);
+        if (ringFd < 0)
+            return false;
+
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(__u32);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMmap)
+            sqRingSize = cqRingSize = juce::jmax(sqRingSize, cqRingSize);
+
+        sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) {
+            sqRing = nullptr;
+            return false;
+        }
+
+        if (singleMmap) {
+            cqRing = sqRing;
+        }
+        else {
+            cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+            if (cqRing == MAP_FAILED) {
+                cqRing = nullptr;
+                return false;
+            }
+        }
+
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqesMap = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+        if (sqesMap == MAP_FAILED)
+            return false;
+        sqes = static_cast<io_uring_sqe*>(sqesMap);
+
+        auto* sq = static_cast<char*>(sqRing);
+        sqHead = reinterpret_cast<__u32*>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<__u32*>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<__u32*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<__u32*>(sq + params.sq_off.array);
+
+        auto* cq = static_cast<char*>(cqRing);
+        cqHead = reinterpret_cast<__u32*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<__u32*>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<__u32*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        //never more in flight than the completion queue can hold
+        slots.resize(params.sq_entries);
+        for (int i = (int)params.sq_entries - 1; i >= 0; --i)
+            freeSlots.push_back(i);
+
+        return true;
+    }
+
+    //kernels before 5.6 have io_uring but can't read into a plain buffer, every request would fail and be read again blocking
+    bool supportsRead()
+    {
+       #ifdef IO_URING_OP_SUPPORTED
+        constexpr unsigned numOps = 256;
+        juce::HeapBlock<char> buffer(sizeof(io_uring_probe) + numOps * sizeof(io_uring_probe_op), true);
+        auto* probe = reinterpret_cast<io_uring_probe*>(buffer.get());
+
+        if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PROBE, probe, numOps) < 0)
+            return false;
+
+        return probe->last_op >= IORING_OP_READ && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) != 0;
+       #else
+        return false;
+       #endif
+    }
+
+    int enter(unsigned toSubmit, unsigned minComplete, unsigned flags)
+    {
+        int result;
+        do {
+            result = (int)syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, nullptr, 0);
+        } while (result < 0 && errno == EINTR);
+        return result;
+    }
+
+    //lock has to be held
+    io_uring_sqe* nextSqe()
+    {
+        const __u32 head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        if (sqTail[0] - head > sqMask)
+            return nullptr;
+
+        const __u32 index = sqTail[0] & sqMask;
+        io_uring_sqe* sqe = &sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, sqTail[0] + 1, __ATOMIC_RELEASE);
+        return sqe;
+    }
+
+    //lock has to be held
+    void submitPending()
+    {
+        unsigned toSubmit = 0;
+        while (!pending.empty() && !freeSlots.empty()) {
+            io_uring_sqe* sqe = nextSqe();
+            if (sqe == nullptr)
+                break;
+
+            const int slot = freeSlots.back();
+            freeSlots.pop_back();
+            slots[(size_t)slot] = std::move(pending.front());
+            pending.pop_front();
+
+            const Request& request = slots[(size_t)slot];
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = request.file->fd;
+            sqe->off = (__u64)request.offset;
+            sqe->addr = (__u64)(uintptr_t)request.dest;
+            sqe->len = (__u32)request.numBytes;
+            sqe->user_data = (__u64)slot;
+            ++toSubmit;
+        }
+
+        if (toSubmit > 0)
+            enter(toSubmit, 0, 0);
+    }
+
+    void run() override
+    {
+        std::vector<std::pair<Request, int>> finished;
+
+        //reads still in flight write into their buffers, so they are waited for before the ring goes away
+        while (!threadShouldExit() || isInFlight()) {
+            enter(0, 1, IORING_ENTER_GETEVENTS);
+
+            {
+                const juce::ScopedLock sl(lock);
+                __u32 head = *cqHead;
+                const __u32 tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+
+                for (; head != tail; ++head) {
+                    const io_uring_cqe& cqe = cqes[head & cqMask];
+                    if (cqe.user_data == wakeUp)
+                        continue;
+
+                    const int slot = (int)cqe.user_data;
+                    finished.emplace_back(std::move(slots[(size_t)slot]), cqe.res);
+                    slots[(size_t)slot] = {};
+                    freeSlots.push_back(slot);
+                }
+                __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+
+                submitPending();
+            }
+
+            for (auto& [request, result] : finished)
+                complete(request, result);
+            finished.clear();
+        }
+
+        //whatever is still queued is read right here, so every done gets called
+        const juce::ScopedLock sl(lock);
+        for (Request& request : pending) {
+            if (request.done)
+                request.done(request.file->readAt(request.offset, request.dest, request.numBytes));
+        }
+        pending.clear();
+    }
+
+    bool isInFlight()
+    {
+        const juce::ScopedLock sl(lock);
+        return freeSlots.size() < slots.size();
+    }
+
+    static void complete(Request& request, int result)
+    {
+        //short reads before the end of the file are finished blocking, errors are left to the caller
+        if (result < 0)
+            result = -1;
+        else if (result < request.numBytes && request.offset + result < request.file->getSize()) {
+            int rest = request.file->readAt(request.offset + result, static_cast<char*>(request.dest) + result, request.numBytes - result);
+            result += juce::jmax(0, rest);
+        }
+
+        if (request.done)
+            request.done(result);
+    }
+
+    int ringFd = -1;
+    void* sqRing = nullptr;
+    void* cqRing = nullptr;
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqesSize = 0;
+
+    __u32* sqHead = nullptr;
+    __u32* sqTail = nullptr;
+    __u32 sqMask = 0;
+    __u32* sqArray = nullptr;
+    __u32* cqHead = nullptr;
+    __u32* cqTail = nullptr;
+    __u32 cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    juce::CriticalSection lock;
+    std::vector<Request> slots;
+    std::vector<int> freeSlots;
+    std::deque<Request> pending;
+};
+
+#else
+
+class AsyncFileReader::Ring
+{
+public:
+    static std::unique_ptr<Ring> create() { return nullptr; }
+    void submit(std::vector<Request>&&) {}
+};
+
+#endif
+
+//==============================================================================
+namespace
+{
+    /// <summary>
+    /// reads blocks of blockSize ahead of the position. The read ahead grows while the stream is read sequentially,
+    /// so parsing a header only reads its first block and decoding keeps several blocks in flight
+    /// </summary>
+    class AsyncFileInputStream : public juce::InputStream
+    {
+    public:
+        AsyncFileInputStream(AsyncFileReader& reader_, std::shared_ptr<AsyncFileReader::Handle> handle_)
+            : reader(reader_), handle(std::move(handle_))
+        {
+        }
+
+        juce::int64 getTotalLength() override { return handle->getSize(); }
+        bool isExhausted() override { return position >= handle->getSize(); }
+        juce::int64 getPosition() override { return position; }
+
+        bool setPosition(juce::int64 newPosition) override
+        {
+            position = juce::jlimit((juce::int64)0, handle->getSize(), newPosition);
+            return true;
+        }
+
+        int read(void* destBuffer, int maxBytesToRead) override
+        {
+            auto* dest = static_cast<char*>(destBuffer);
+            int total = 0;
+
+            while (total < maxBytesToRead && position < handle->getSize()) {
+                std::shared_ptr<Block> block = getBlock(position / blockSize);
+                block->ready.wait();
+
+                const int inBlock = (int)(position - block->index * blockSize);
+                if (block->numBytes <= inBlock) {
+                    //failed reads are retried blocking, the os might have had a hiccup
+                    int n = handle->readAt(position, dest + total, maxBytesToRead - total);
+                    if (n > 0) {
+                        total += n;
+                        position += n;
+                    }
+                    break;
+                }
+
+                const int n = juce::jmin(block->numBytes - inBlock, maxBytesToRead - total);
+                std::memcpy(dest + total, block->data.get() + inBlock, (size_t)n);
+                total += n;
+                position += n;
+            }
+
+            return total;
+        }
+
+    private:
+        static constexpr int blockSize = 64 * 1024;
+        static constexpr int maxReadAhead = 4;
+
+        struct Block
+        {
+            juce::int64 index = 0;
+            juce::HeapBlock<char> data;
+            int numBytes = -1;
+            juce::WaitableEvent ready{ true };
+        };
+
+        std::shared_ptr<Block> getBlock(juce::int64 index)
+        {
+            while (!blocks.empty() && blocks.front()->index < index)
+                blocks.pop_front();
+
+            if (!blocks.empty() && blocks.front()->index != index) {
+                blocks.clear();
+                sequentialBlocks = 0;
+            }
+
+            if (blocks.empty()) {
+                //a jump, the os reads ahead from here while the first block is read
+                handle->willNeed(index * blockSize, (juce::int64)blockSize * maxReadAhead);
+            }
+            else {
+                sequentialBlocks = juce::jmin(sequentialBlocks + 1, maxReadAhead);
+            }
+
+            const juce::int64 numBlocks = (handle->getSize() + blockSize - 1) / blockSize;
+            const juce::int64 last = juce::jmin(numBlocks - 1, index + sequentialBlocks);
+
+            std::vector<AsyncFileReader::Request> batch;
+            for (juce::int64 i = blocks.empty() ? index : blocks.back()->index + 1; i <= last; ++i) {
+                auto block = std::make_shared<Block>();
+                block->index = i;
+                block->data.malloc(blockSize);
+                blocks.push_back(block);
+
+                //the request keeps the block alive, even if this stream is gone when it completes
+                batch.push_back({ handle, i * blockSize, block->data.get(), blockSize, [block](int numRead) {
+                    block->numBytes = numRead;
+                    block->ready.signal();
+                } });
+            }
+            if (!batch.empty())
+                reader.submit(std::move(batch));
+
+            return blocks.front();
+        }
+
+        AsyncFileReader& reader;
+        std::shared_ptr<AsyncFileReader::Handle> handle;
+        juce::int64 position = 0;
+        std::deque<std::shared_ptr<Block>> blocks;
+        int sequentialBlocks = 0;
+    };
+}
+
+//==============================================================================
+AsyncFileReader::AsyncFileReader()
+    : ring(Ring::create()),
+      fallbackPool(4, 0, juce::Thread::Priority::high)
+{
+}
+
+AsyncFileReader::~AsyncFileReader()
+{
+    ring.reset();
+    fallbackPool.removeAllJobs(false, 2000);
+}
+
+AsyncFileReader& AsyncFileReader::getShared()
+{
+    static AsyncFileReader reader;
+    return reader;
+}
+
+void AsyncFileReader::submit(std::vector<Request>&& batch)
+{
+    if (ring != nullptr) {
+        ring->submit(std::move(batch));
+        return;
+    }
+
+    for (Request& request : batch) {
+        fallbackPool.addJob([request = std::move(request)] {
+            int result = request.file->readAt(request.offset, request.dest, request.numBytes);
+            if (request.done)
+                request.done(result);
+        });
+    }
+}
+
+void AsyncFileReader::warmUp(const juce::Array<juce::File>& files, int numBytes)
+{
+    std::vector<Request> batch;
+    for (const juce::File& file : files) {
+        std::shared_ptr<Handle> handle = open(file);
+        if (handle == nullptr)
+            continue;
+
+        int length = (int)juce::jmin((juce::int64)numBytes, handle->getSize());
+        if (length <= 0)
+            continue;
+
+        auto buffer = std::make_shared<juce::HeapBlock<char>>(length);
+        batch.push_back({ handle, 0, buffer->get(), length, [buffer](int) {} });
+    }
+
+    if (!batch.empty())
+        submit(std::move(batch));
+}
+
+std::unique_ptr<juce::InputStream> AsyncFileReader::createInputStream(const juce::File& file)
+{
+    std::shared_ptr<Handle> handle = open(file);
+    if (handle == nullptr)
+        return nullptr;
+
+    return std::make_unique<AsyncFileInputStream>(*this, std::move(handle));
+}
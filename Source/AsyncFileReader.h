@@ -0,0 +1,99 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+
+/// <summary>
+/// Reads blocks of files without blocking the thread asking for them. On Linux batches of reads are submitted together
+/// through io_uring, so many of them are in flight at once; where io_uring isn't available or can't read (kernels before 5.6,
+/// containers forbidding it, other systems) the reads run as pread on a small thread pool instead.
+/// Completions are called on the reader's own threads and have to be quick.
+/// All functions are thread safe.
+/// </summary>
+class AsyncFileReader
+{
+public:
+    AsyncFileReader();
+    ~AsyncFileReader();
+
+    /// <summary>
+    /// the reader used by the streams from createInputStream and by warmUp
+    /// </summary>
+    static AsyncFileReader& getShared();
+
+    /// <summary>
+    /// an open file. Kept alive by every request reading from it
+    /// </summary>
+    class Handle
+    {
+    public:
+        ~Handle();
+
+        juce::int64 getSize() const { return size; }
+
+        /// <summary>
+        /// blocking read, for what can't wait for a completion
+        /// </summary>
+        /// <returns>the number of bytes read, -1 on errors</returns>
+        int readAt(juce::int64 offset, void* dest, int numBytes);
+
+        /// <summary>
+        /// tells the os that this part of the file will be read soon (posix_fadvise), so it can start reading ahead
+        /// </summary>
+        void willNeed(juce::int64 offset, juce::int64 numBytes);
+
+    private:
+        friend class AsyncFileReader;
+        Handle() = default;
+
+        juce::int64 size = 0;
+       #if JUCE_WINDOWS
+        std::unique_ptr<juce::FileInputStream> stream;
+        juce::CriticalSection streamLock;
+       #else
+        int fd = -1;
+       #endif
+    };
+
+    /// <returns>nullptr if the file can't be opened</returns>
+    static std::shared_ptr<Handle> open(const juce::File& file);
+
+    struct Request
+    {
+        std::shared_ptr<Handle> file;
+        juce::int64 offset = 0;
+        void* dest = nullptr;
+        int numBytes = 0;
+
+        //called with the number of bytes read, which can be less at the end of the file, or -1 on errors
+        std::function<void(int)> done;
+    };
+
+    /// <summary>
+    /// starts all requests of the batch at once. dest has to stay valid until done was called
+    /// </summary>
+    void submit(std::vector<Request>&& batch);
+
+    /// <summary>
+    /// reads the first numBytes of every file in the background, so reading them afterwards is served from the os cache.
+    /// For walking many small headers in a row.
+    /// </summary>
+    void warmUp(const juce::Array<juce::File>& files, int numBytes);
+
+    /// <summary>
+    /// a stream reading aligned blocks ahead of its position through this reader, for the audio format readers.
+    /// A read only waits if the block it needs isn't there yet, so it must not be read on the audio thread
+    /// (see PrimedAudioFormatReaderSource).
+    /// </summary>
+    /// <returns>nullptr if the file can't be opened</returns>
+    std::unique_ptr<juce::InputStream> createInputStream(const juce::File& file);
+
+    bool isUsingIoUring() const { return ring != nullptr; }
+
+private:
+    class Ring;
+    std::unique_ptr<Ring> ring;
+    juce::ThreadPool fallbackPool;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AsyncFileReader)
+};
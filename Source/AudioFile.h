@@ -1,30 +1,54 @@
 #pragma once
 #include <JuceHeader.h>
+#include "AudioFingerprint.h"
+#include "PathTable.h"
 
 
+/// <summary>
+/// hash for juce::String keys in std::unordered_map
+/// </summary>
+struct StringHash
+{
+	size_t operator()(const juce::String& s) const noexcept { return (size_t)s.hashCode64(); }
+};
 
 
 /// <summary>
-/// Representation of opened audio file with all informations and settings
+/// Representation of opened audio file with all informations and settings.
+/// Kept small, there can be hundreds of thousands of them: paths are ids into PathTable::getShared()
 /// </summary>
 class AudioFile
 {
 public:
 
 	AudioFile() {}
-	AudioFile(juce::String path, double loopStart, double loopEnd) : absPath(path), loopStart(loopStart), loopEnd(loopEnd) {}
+	AudioFile(juce::String path, double loopStart, double loopEnd) : absPathId(PathTable::getShared().intern(path)), loopStart(loopStart), loopEnd(loopEnd) {}
 
-	juce::String absPath = "";
-	juce::String relPathToLib = "";
+	PathTable::Id absPathId = PathTable::empty;
+	PathTable::Id relPathToLibId = PathTable::empty;
 
 	double loopStart=0;
 	double loopEnd=0;
-	double length=0;
+	float length=0;
 
-	bool crossFadeActive = false;
 	float crossFadeLength = 0;
 
-	enum class CustomSetting {
+	//content fingerprint, see AudioFingerprint
+	AudioFingerprint::Value fingerprint;
+
+	bool crossFadeActive = false;
+
+	juce::String getAbsPath() const { return PathTable::getShared().toString(absPathId); }
+	juce::String getRelPathToLib() const { return PathTable::getShared().toString(relPathToLibId); }
+	bool hasRelPathToLib() const { return relPathToLibId != PathTable::empty; }
+
+	/// <summary>
+	/// only for records which are not in an AudioFileIndex, those are changed with AudioFileIndex::setPaths
+	/// </summary>
+	void setAbsPath(const juce::String& path) { absPathId = PathTable::getShared().intern(path); }
+	void setRelPathToLib(const juce::String& path) { relPathToLibId = PathTable::getShared().intern(path); }
+
+	enum class CustomSetting : juce::uint8 {
 		None			= 0,
 		LoopStart		= 1 << 0,
 		LoopEnd			= 1 << 1,
@@ -66,7 +90,7 @@ public:
 	/// CustomSetting::None can be used to check if there is not a single custom setting.
 	/// </summary>
 	/// <returns>true if there is a custom setting or with CustomSetting::None as argument if there is none</returns>
-	bool hasCustomSetting(CustomSetting settingToCheck) {
+	bool hasCustomSetting(CustomSetting settingToCheck) const {
 
 		if (settingToCheck == CustomSetting::None) {
 			return customSetting == CustomSetting::None;
@@ -76,12 +100,23 @@ public:
 		}
 	}
 
+	/// <summary>
+	/// takes over loop markers, cross fade and which of them are custom, paths and fingerprint stay
+	/// </summary>
+	void copySettingsFrom(const AudioFile& other) {
+		loopStart = other.loopStart;
+		loopEnd = other.loopEnd;
+		crossFadeActive = other.crossFadeActive;
+		crossFadeLength = other.crossFadeLength;
+		customSetting = other.customSetting;
+	}
+
 
 	/// <summary>
 	/// Converts the AudioFile to a juce::var which can be converted to JSON. Can be converted back by the fromVar() function.
 	/// </summary>
 	/// <returns>a juce::var containing propeties of the AudioFile as DynamicObject</returns>
-	juce::var toVar() {
+	juce::var toVar() const {
 		juce::DynamicObject* obj = new juce::DynamicObject();
 		copyPropetiesToDynObj(obj);
 		return juce::var(obj);
@@ -97,17 +132,24 @@ public:
 	}
 
 private:
+	friend class AudioFileIndex;
 
 	//used to define whether to use a individual "per-file-setting" or the global default-setting
 	CustomSetting customSetting = CustomSetting::None;
 
-	void copyPropetiesToDynObj(juce::DynamicObject* obj) {
-		obj->setProperty("absPath", absPath);
-		if (relPathToLib != "") {
-			obj->setProperty("relPathToLib", relPathToLib);
+	//position in the AudioFileIndex holding the record, set when it's added. Stored records are never assigned to as a whole
+	juce::uint32 recordIndex = 0;
+
+	void copyPropetiesToDynObj(juce::DynamicObject* obj) const {
+		obj->setProperty("absPath", getAbsPath());
+		if (hasRelPathToLib()) {
+			obj->setProperty("relPathToLib", getRelPathToLib());
 		}
 		obj->setProperty("length", length);
 
+		if (fingerprint.computed)
+			obj->setProperty("fingerprint", AudioFingerprint::toString(fingerprint));
+
 		obj->setProperty("customSetting", static_cast<int>(customSetting));
 
 		if(hasCustomSetting(CustomSetting::LoopStart))
@@ -130,15 +172,19 @@ private:
 
 		prop = obj.getProperty("absPath");
 		if (prop != juce::var())
-			audioFile.absPath = prop;
+			audioFile.setAbsPath(prop);
 
 		prop = obj.getProperty("relPathToLib");
 		if (prop != juce::var())
-			audioFile.relPathToLib = prop;
+			audioFile.setRelPathToLib(prop);
 
 		prop = obj.getProperty("length");
 		if (prop != juce::var())
-			audioFile.length = prop;
+			audioFile.length = (float)prop;
+
+		prop = obj.getProperty("fingerprint");
+		if (prop != juce::var())
+			audioFile.fingerprint = AudioFingerprint::fromString(prop.toString());
 
 		bool legacyBeforeCustomSettings = true;
 		prop = obj.getProperty("customSetting");
@@ -0,0 +1,206 @@
+#include "AudioFileIndex.h"
+#include <bit>
+
+AudioFile& AudioFileIndex::add(AudioFile&& file)
+{
+    file.recordIndex = (juce::uint32)files.size();
+    files.push_back(std::move(file));
+    addToIndices(files.back());
+    recordChanged(files.back());
+    return files.back();
+}
+
+void AudioFileIndex::clear()
+{
+    settingsBlocks.clear();
+    byAbsPath.clear();
+    byRelPath.clear();
+    byFingerprintLength.clear();
+    files.clear();
+}
+
+void AudioFileIndex::swapWith(AudioFileIndex& other)
+{
+    files.swap(other.files);
+    byAbsPath.swap(other.byAbsPath);
+    byRelPath.swap(other.byRelPath);
+    byFingerprintLength.swap(other.byFingerprintLength);
+    settingsBlocks.swap(other.settingsBlocks);
+
+    //how all records are loaded at once
+    memoryUsageGrew();
+}
+
+AudioFile* AudioFileIndex::findByAbsPath(const juce::String& absPath) const
+{
+    return findByAbsPath(PathTable::getShared().find(absPath));
+}
+
+AudioFile* AudioFileIndex::findByRelPath(const juce::String& relPathToLib) const
+{
+    return findByRelPath(PathTable::getShared().find(relPathToLib));
+}
+
+AudioFile* AudioFileIndex::findByAbsPath(PathTable::Id absPath) const
+{
+    return lookUp(byAbsPath, absPath);
+}
+
+AudioFile* AudioFileIndex::findByRelPath(PathTable::Id relPathToLib) const
+{
+    return lookUp(byRelPath, relPathToLib);
+}
+
+AudioFileIndex::FingerprintMatch AudioFileIndex::findByFingerprint(const AudioFingerprint::Value& fingerprint,
+                                                                  const std::function<bool(const AudioFile&)>& accept) const
+{
+    FingerprintMatch best;
+    if (!fingerprint.computed)
+        return best;
+
+    //lengths within the tolerance are at most one key apart
+    const juce::int64 key = getLengthKey(fingerprint);
+    for (juce::int64 k = key - 1; k <= key + 1; ++k) {
+        auto range = byFingerprintLength.equal_range(k);
+        for (auto it = range.first; it != range.second; ++it) {
+            const AudioFingerprint::Match match = AudioFingerprint::compare(fingerprint, it->second->fingerprint);
+            if (match > best.match && accept(*it->second)) {
+                best = { it->second, match };
+                if (match == AudioFingerprint::Match::same)
+                    return best;
+            }
+        }
+    }
+    return best;
+}
+
+void AudioFileIndex::setPaths(AudioFile& file, const juce::String& absPath, const juce::String& relPathToLib)
+{
+    PathTable& paths = PathTable::getShared();
+    setPaths(file, paths.intern(absPath), paths.intern(relPathToLib));
+}
+
+void AudioFileIndex::setPaths(AudioFile& file, PathTable::Id absPath, PathTable::Id relPathToLib)
+{
+    removeFromIndices(file);
+    file.absPathId = absPath;
+    file.relPathToLibId = relPathToLib;
+
+    //the record moved here, a record still registered for these paths is outdated
+    set(byAbsPath, file.absPathId, &file, true);
+    set(byRelPath, file.relPathToLibId, &file, true);
+    addFingerprint(file);
+    recordChanged(file);
+}
+
+void AudioFileIndex::setFingerprint(AudioFile& file, const AudioFingerprint::Value& fingerprint)
+{
+    removeFingerprint(file);
+    file.fingerprint = fingerprint;
+    addFingerprint(file);
+    recordChanged(file);
+}
+
+void AudioFileIndex::recordChanged(const AudioFile& file)
+{
+    const size_t block = file.recordIndex / blockSize;
+    if (block < settingsBlocks.size())
+        settingsBlocks[block] = nullptr;
+}
+
+std::vector<AudioFileIndex::SettingsBlock> AudioFileIndex::getSettingsBlocks()
+{
+    //blocks of records added since the last call start out empty, so they get copied too
+    settingsBlocks.resize((files.size() + blockSize - 1) / blockSize);
+
+    for (size_t block = 0; block < settingsBlocks.size(); ++block) {
+        if (settingsBlocks[block] != nullptr)
+            continue;
+
+        auto copied = std::make_shared<std::vector<AudioFile>>();
+        const size_t end = juce::jmin(files.size(), (block + 1) * blockSize);
+        for (size_t i = block * blockSize; i < end; ++i) {
+            if (!files[i].hasCustomSetting(AudioFile::CustomSetting::None))
+                copied->push_back(files[i]);
+        }
+        settingsBlocks[block] = std::move(copied);
+    }
+
+    return settingsBlocks;
+}
+
+size_t AudioFileIndex::getMemoryUsage() const
+{
+    size_t copiedBytes = settingsBlocks.capacity() * sizeof(SettingsBlock);
+    for (const SettingsBlock& block : settingsBlocks) {
+        if (block != nullptr)
+            copiedBytes += block->capacity() * sizeof(AudioFile);
+    }
+
+    //deque blocks and hash nodes estimated, the rest is exact
+    return files.size() * sizeof(AudioFile) + copiedBytes
+        + (byAbsPath.size() + byRelPath.size()) * (sizeof(PathIndex::value_type) + sizeof(void*))
+        + (byAbsPath.bucket_count() + byRelPath.bucket_count()) * sizeof(void*)
+        + byFingerprintLength.size() * (sizeof(juce::int64) + 3 * sizeof(void*)) + byFingerprintLength.bucket_count() * sizeof(void*);
+}
+
+void AudioFileIndex::addToIndices(AudioFile& file)
+{
+    //an older record keeps the key
+    set(byAbsPath, file.absPathId, &file, false);
+    set(byRelPath, file.relPathToLibId, &file, false);
+    addFingerprint(file);
+}
+
+void AudioFileIndex::removeFromIndices(AudioFile& file)
+{
+    eraseIfOwnedBy(byAbsPath, file.absPathId, &file);
+    eraseIfOwnedBy(byRelPath, file.relPathToLibId, &file);
+
+    removeFingerprint(file);
+}
+
+void AudioFileIndex::addFingerprint(AudioFile& file)
+{
+    //silence or a steady level, such a fingerprint never matches
+    if (file.fingerprint.computed && std::popcount(file.fingerprint.reliable) >= AudioFingerprint::minComparedBits)
+        byFingerprintLength.emplace(getLengthKey(file.fingerprint), &file);
+}
+
+void AudioFileIndex::removeFingerprint(AudioFile& file)
+{
+    auto range = byFingerprintLength.equal_range(getLengthKey(file.fingerprint));
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == &file) {
+            byFingerprintLength.erase(it);
+            return;
+        }
+    }
+}
+
+AudioFile* AudioFileIndex::lookUp(const PathIndex& index, PathTable::Id id)
+{
+    if (id == PathTable::empty)
+        return nullptr;
+
+    auto it = index.find(id);
+    return it != index.end() ? it->second : nullptr;
+}
+
+void AudioFileIndex::set(PathIndex& index, PathTable::Id id, AudioFile* file, bool overwrite)
+{
+    if (id == PathTable::empty)
+        return;
+
+    if (overwrite)
+        index[id] = file;
+    else
+        index.emplace(id, file);
+}
+
+void AudioFileIndex::eraseIfOwnedBy(PathIndex& index, PathTable::Id id, AudioFile* owner)
+{
+    auto it = index.find(id);
+    if (it != index.end() && it->second == owner)
+        index.erase(it);
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "AudioFile.h"
+#include "MemoryBudget.h"
+#include <deque>
+#include <unordered_map>
+
+
+/// <summary>
+/// Owns all AudioFile records and keeps indices over absolute path, path relative to a music library
+/// and content fingerprint. Records never move in memory, so pointers to them stay valid.
+/// Paths and fingerprints of a stored record must only be changed through this class.
+/// The path indices are hash maps keyed by PathTable id, so they only grow with the records and not with every path ever interned.
+/// Counts towards the MemoryBudget, but records are never evicted.
+/// Records with own settings are also kept as immutable blocks of copies, which settings snapshots share.
+/// </summary>
+class AudioFileIndex : public MemoryBudget::Cache
+{
+public:
+    AudioFileIndex() {}
+
+    AudioFile& add(AudioFile&& file);
+    void clear();
+
+    /// <summary>
+    /// exchanges all records and indices, pointers to records stay valid but then belong to the other index
+    /// </summary>
+    void swapWith(AudioFileIndex& other);
+
+    AudioFile* findByAbsPath(const juce::String& absPath) const;
+    AudioFile* findByRelPath(const juce::String& relPathToLib) const;
+    AudioFile* findByAbsPath(PathTable::Id absPath) const;
+    AudioFile* findByRelPath(PathTable::Id relPathToLib) const;
+
+    struct FingerprintMatch
+    {
+        AudioFile* file = nullptr;
+        AudioFingerprint::Match match = AudioFingerprint::Match::none;
+    };
+
+    /// <summary>
+    /// the record whose fingerprint matches among those accepted, one with the same content before a similar one.
+    /// Only records of about the same length are compared.
+    /// </summary>
+    FingerprintMatch findByFingerprint(const AudioFingerprint::Value& fingerprint, const std::function<bool(const AudioFile&)>& accept) const;
+
+    void setPaths(AudioFile& file, const juce::String& absPath, const juce::String& relPathToLib);
+    void setPaths(AudioFile& file, PathTable::Id absPath, PathTable::Id relPathToLib);
+    void setFingerprint(AudioFile& file, const AudioFingerprint::Value& fingerprint);
+
+    /// <summary>
+    /// marks a stored record whose settings or length were changed in place, so the next getSettingsBlocks() copies it again.
+    /// setPaths and setFingerprint mark the record themselves
+    /// </summary>
+    void recordChanged(const AudioFile& file);
+
+    //copies of the records with own settings among blockSize consecutive records. Never changed once made,
+    //so settings snapshots share them with the index and with each other instead of copying every record
+    using SettingsBlock = std::shared_ptr<const std::vector<AudioFile>>;
+    static constexpr size_t blockSize = 1024;
+
+    /// <summary>
+    /// the records with own settings, in the order they were added. Only blocks with a record changed since the last call are copied again
+    /// </summary>
+    std::vector<SettingsBlock> getSettingsBlocks();
+
+    size_t size() const { return files.size(); }
+    size_t getMemoryUsage() const override;
+
+    std::deque<AudioFile>::iterator begin() { return files.begin(); }
+    std::deque<AudioFile>::iterator end() { return files.end(); }
+    std::deque<AudioFile>::const_iterator begin() const { return files.begin(); }
+    std::deque<AudioFile>::const_iterator end() const { return files.end(); }
+
+private:
+    void addToIndices(AudioFile& file);
+    void removeFromIndices(AudioFile& file);
+
+    std::deque<AudioFile> files;
+    std::vector<SettingsBlock> settingsBlocks;  //nullptr where a record changed since the block was copied
+
+    using PathIndex = std::unordered_map<PathTable::Id, AudioFile*>;
+    static AudioFile* lookUp(const PathIndex& index, PathTable::Id id);
+    static void set(PathIndex& index, PathTable::Id id, AudioFile* file, bool overwrite);
+    static void eraseIfOwnedBy(PathIndex& index, PathTable::Id id, AudioFile* owner);
+
+    //first record wins if several share a key, like the linear search did before
+    PathIndex byAbsPath;
+    PathIndex byRelPath;
+    //fingerprints which can match anything, by whole seconds of length
+    static juce::int64 getLengthKey(const AudioFingerprint::Value& fingerprint) { return (juce::int64)fingerprint.getLengthSecs(); }
+    void addFingerprint(AudioFile& file);
+    void removeFingerprint(AudioFile& file);
+    std::unordered_multimap<juce::int64, AudioFile*> byFingerprintLength;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AudioFileIndex)
+};
@@ -0,0 +1,172 @@
+#include "AudioFingerprint.h"
+#include "FormatSniffer.h"
+#include <array>
+#include <bit>
+
+namespace
+{
+    constexpr int numWindows = 65;      //64 neighbour pairs -> 64 bits
+    constexpr double windowLength = 0.5; //secs, long enough to not care about encoder delay
+    constexpr float reliableDifference = 1.0f; //dB between neighbouring windows, lossy codecs change window energies far less
+
+    //independent lanes so the compiler keeps them in one SIMD register
+    float sumOfSquares(const float* data, int numSamples)
+    {
+        constexpr int numLanes = 8;
+        float lanes[numLanes] = {};
+
+        int i = 0;
+        for (; i + numLanes <= numSamples; i += numLanes) {
+            for (int l = 0; l < numLanes; ++l)
+                lanes[l] += data[i + l] * data[i + l];
+        }
+
+        float sum = 0;
+        for (int l = 0; l < numLanes; ++l)
+            sum += lanes[l];
+
+        for (; i < numSamples; ++i)
+            sum += data[i] * data[i];
+
+        return sum;
+    }
+}
+
+AudioFingerprint::Value AudioFingerprint::compute(juce::AudioFormatReader& reader, const std::function<bool()>& shouldCancel)
+{
+    if (reader.sampleRate <= 0 || reader.numChannels == 0)
+        return {};
+
+    const int windowSamples = (int)(windowLength * reader.sampleRate);
+    const juce::int64 length = reader.lengthInSamples;
+
+    Value fingerprint;
+    fingerprint.lengthInSamples = length;
+    fingerprint.sampleRate = (juce::uint32)juce::roundToInt(reader.sampleRate);
+    fingerprint.computed = true;
+
+    //no reliable bits, similar to nothing
+    if (length < (juce::int64)windowSamples * 4)
+        return fingerprint;
+
+    juce::AudioBuffer<float> buffer(juce::jmin(2, (int)reader.numChannels), windowSamples);
+    std::array<float, numWindows> energies;
+
+    for (int w = 0; w < numWindows; ++w) {
+        if (shouldCancel && shouldCancel())
+            return {};
+
+        //windows are placed relative to the length, re-encodes with some padding still line up
+        juce::int64 start = (length - windowSamples) * w / (numWindows - 1);
+        reader.read(&buffer, 0, windowSamples, start, true, true);
+
+        //downmix into the first channel
+        for (int ch = 1; ch < buffer.getNumChannels(); ++ch)
+            juce::FloatVectorOperations::add(buffer.getWritePointer(0), buffer.getReadPointer(ch), windowSamples);
+
+        energies[w] = juce::Decibels::gainToDecibels(sumOfSquares(buffer.getReadPointer(0), windowSamples) / windowSamples, -200.0f);
+    }
+
+    for (int w = 0; w < numWindows - 1; ++w) {
+        const juce::uint64 bit = (juce::uint64)1 << w;
+        if (energies[w + 1] > energies[w])
+            fingerprint.bits |= bit;
+        if (std::abs(energies[w + 1] - energies[w]) >= reliableDifference)
+            fingerprint.reliable |= bit;
+    }
+
+    return fingerprint;
+}
+
+AudioFingerprint::Match AudioFingerprint::compare(const Value& a, const Value& b)
+{
+    if (!a.computed || !b.computed || std::abs(a.getLengthSecs() - b.getLengthSecs()) > lengthTolerance)
+        return Match::none;
+
+    //silence or a steady level gives no reliable bits, such files can't be told apart
+    const juce::uint64 compared = a.reliable & b.reliable;
+    if (std::popcount(compared) < minComparedBits || std::popcount((a.bits ^ b.bits) & compared) > maxDifferentBits)
+        return Match::none;
+
+    if (a.bits == b.bits && a.reliable == b.reliable && a.lengthInSamples == b.lengthInSamples && a.sampleRate == b.sampleRate)
+        return Match::same;
+    return Match::similar;
+}
+
+juce::String AudioFingerprint::toString(const Value& fingerprint)
+{
+    return juce::String::toHexString((juce::int64)fingerprint.bits).paddedLeft('0', 16)
+        + "/" + juce::String::toHexString((juce::int64)fingerprint.reliable).paddedLeft('0', 16)
+        + "/" + juce::String(fingerprint.lengthInSamples)
+        + "/" + juce::String(fingerprint.sampleRate);
+}
+
+AudioFingerprint::Value AudioFingerprint::fromString(const juce::String& s)
+{
+    juce::StringArray parts = juce::StringArray::fromTokens(s, "/", "");
+    if (parts.size() != 4)
+        return {};
+
+    Value fingerprint;
+    fingerprint.bits = (juce::uint64)parts[0].getHexValue64();
+    fingerprint.reliable = (juce::uint64)parts[1].getHexValue64();
+    fingerprint.lengthInSamples = parts[2].getLargeIntValue();
+    fingerprint.sampleRate = (juce::uint32)parts[3].getLargeIntValue();
+    fingerprint.computed = true;
+    return fingerprint;
+}
+
+
+Fingerprinter::Fingerprinter(FormatSniffer& formatSniffer_)
+    : formatSniffer(formatSniffer_)
+{
+}
+
+Fingerprinter::~Fingerprinter()
+{
+    cancelPendingUpdate();
+    JobSystem::getShared().cancelAndWait(jobs);
+}
+
+void Fingerprinter::addFile(const juce::File& file)
+{
+    {
+        const juce::ScopedLock sl(queueLock);
+        if (std::find(pending.begin(), pending.end(), file) != pending.end())
+            return;
+        pending.push_back(file);
+    }
+
+    JobSystem::getShared().run(JobSystem::Priority::analysis, [this, file] { process(file); }, jobs);
+}
+
+void Fingerprinter::process(const juce::File& file)
+{
+    AudioFingerprint::Value fingerprint;
+    std::unique_ptr<juce::AudioFormatReader> reader(formatSniffer.createReaderFor(file));
+    if (reader != nullptr)
+        fingerprint = AudioFingerprint::compute(*reader, [this] { return jobs.isCancelled(); });
+
+    {
+        const juce::ScopedLock sl(queueLock);
+        pending.erase(std::find(pending.begin(), pending.end(), file));
+        if (!fingerprint.computed)
+            return;
+        results.emplace_back(file, fingerprint);
+    }
+    triggerAsyncUpdate();
+}
+
+void Fingerprinter::handleAsyncUpdate()
+{
+    std::vector<std::pair<juce::File, AudioFingerprint::Value>> ready;
+    {
+        const juce::ScopedLock sl(queueLock);
+        ready.swap(results);
+    }
+
+    for (auto& result : ready) {
+        if (onFingerprintReady)
+            onFingerprintReady(result.first, result.second);
+    }
+}
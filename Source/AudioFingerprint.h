@@ -0,0 +1,85 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "JobSystem.h"
+
+
+/// <summary>
+/// Compact content fingerprint of an audio file. It is built from the energy contour of windows
+/// spread evenly over the whole file, so it does not change with renames, moves or tags.
+/// Re-encoding may flip bits whose windows are almost equally loud, so only the bits with a clear difference
+/// are compared, and two fingerprints are similar if few of those differ and the lengths are about the same.
+/// </summary>
+namespace AudioFingerprint
+{
+    struct Value
+    {
+        juce::uint64 bits = 0;      //one per pair of neighbouring windows, set if the later one is louder
+        juce::uint64 reliable = 0;  //bits whose windows differ clearly in loudness
+        juce::int64 lengthInSamples = 0;
+        juce::uint32 sampleRate = 0;
+        bool computed = false;      //also for silent or too short files, which are similar to nothing
+
+        bool operator==(const Value&) const = default;
+
+        double getLengthSecs() const { return sampleRate > 0 ? (double)lengthInSamples / sampleRate : 0.0; }
+    };
+
+    enum class Match
+    {
+        none,
+        similar,    //probably the same recording, e.g. encoded differently. Needs the user's confirmation
+        same        //same length, sample rate and all bits, a copy or the moved file itself
+    };
+
+    constexpr double lengthTolerance = 1.0;  //secs
+    constexpr int minComparedBits = 24;
+    constexpr int maxDifferentBits = 3;
+
+    /// <summary>
+    /// decodes only a few short windows of the file and derives one bit from each pair of neighbouring windows
+    /// </summary>
+    /// <param name="shouldCancel">polled between windows, may be empty</param>
+    /// <returns>a fingerprint that isn't computed if the file could not be read or it was cancelled</returns>
+    Value compute(juce::AudioFormatReader& reader, const std::function<bool()>& shouldCancel = {});
+
+    Match compare(const Value& a, const Value& b);
+
+    juce::String toString(const Value& fingerprint);
+
+    /// <summary>
+    /// fingerprints stored by older versions (bits only) come back not computed, so they are computed again
+    /// </summary>
+    Value fromString(const juce::String& s);
+}
+
+
+class FormatSniffer;
+
+/// <summary>
+/// Computes fingerprints as analysis jobs, one job per file.
+/// Results are delivered on the message thread.
+/// </summary>
+class Fingerprinter : private juce::AsyncUpdater
+{
+public:
+    Fingerprinter(FormatSniffer& formatSniffer);
+    ~Fingerprinter() override;
+
+    void addFile(const juce::File& file);
+
+    std::function<void(const juce::File&, const AudioFingerprint::Value&)> onFingerprintReady;
+
+private:
+    void process(const juce::File& file);
+    void handleAsyncUpdate() override;
+
+    FormatSniffer& formatSniffer;
+    JobSystem::CancellationToken jobs;
+
+    juce::CriticalSection queueLock;
+    std::vector<juce::File> pending;   //queued or being computed
+    std::vector<std::pair<juce::File, AudioFingerprint::Value>> results;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Fingerprinter)
+};
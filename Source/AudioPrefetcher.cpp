@@ -0,0 +1,473 @@
+#include "AudioPrefetcher.h"
+#include "RealtimeSupport.h"
+
+PrimedAudioFormatReaderSource::PrimedAudioFormatReaderSource(juce::AudioFormatReader* reader, bool deleteReaderWhenThisIsDeleted)
+    : juce::AudioFormatReaderSource(reader, deleteReaderWhenThisIsDeleted)
+{
+}
+
+PrimedAudioFormatReaderSource::~PrimedAudioFormatReaderSource()
+{
+    if (readingAhead)
+        readAheadThread->removeTimeSliceClient(this);
+
+    if (locked) {
+        for (Region& region : regions)
+            RealtimeSupport::unlockBuffer(region.samples);
+        unlockWindows();
+    }
+}
+
+void PrimedAudioFormatReaderSource::lockInMemory()
+{
+    if (locked)
+        return;
+
+    locked = true;
+    for (Region& region : regions)
+        RealtimeSupport::lockBuffer(region.samples, "primed region");
+    lockWindows();
+}
+
+void PrimedAudioFormatReaderSource::lockWindows()
+{
+    for (Window& window : windows) {
+        if (window.samples.getNumSamples() > 0)
+            RealtimeSupport::lockBuffer(window.samples, "read ahead");
+    }
+}
+
+void PrimedAudioFormatReaderSource::unlockWindows()
+{
+    for (Window& window : windows) {
+        if (window.samples.getNumSamples() > 0)
+            RealtimeSupport::unlockBuffer(window.samples);
+    }
+}
+
+size_t PrimedAudioFormatReaderSource::getMemoryUsage() const
+{
+    size_t bytes = 0;
+    for (const Region& region : regions)
+        bytes += (size_t)region.samples.getNumChannels() * (size_t)region.samples.getNumSamples() * sizeof(float);
+    for (const Window& window : windows)
+        bytes += (size_t)window.samples.getNumChannels() * (size_t)window.samples.getNumSamples() * sizeof(float);
+    return bytes;
+}
+
+bool PrimedAudioFormatReaderSource::primeRegion(juce::int64 startSample, int numSamples, const std::function<bool()>& shouldCancel)
+{
+    juce::AudioFormatReader* reader = getAudioFormatReader();
+
+    startSample = juce::jlimit((juce::int64)0, reader->lengthInSamples, startSample);
+    numSamples = (int)juce::jmin((juce::int64)numSamples, reader->lengthInSamples - startSample);
+    if (numSamples <= 0)
+        return true;
+
+    for (const Region& region : regions) {
+        if (startSample >= region.start && startSample + numSamples <= region.start + region.samples.getNumSamples())
+            return true;
+    }
+
+    //same channel layout as AudioFormatReaderSource reads into a stereo buffer
+    Region region{ startSample, juce::AudioBuffer<float>(2, numSamples) };
+
+    constexpr int chunkSize = 4096;
+    for (int offset = 0; offset < numSamples; offset += chunkSize) {
+        if (shouldCancel && shouldCancel())
+            return false;
+
+        reader->read(&region.samples, offset, juce::jmin(chunkSize, numSamples - offset), startSample + offset, true, true);
+    }
+
+    if (locked)
+        RealtimeSupport::lockBuffer(region.samples, "primed region");
+    regions.push_back(std::move(region));
+    return true;
+}
+
+void PrimedAudioFormatReaderSource::prepareToPlay(int samplesPerBlockExpected, double sampleRate)
+{
+    juce::AudioFormatReaderSource::prepareToPlay(samplesPerBlockExpected, sampleRate);
+
+    if (readAheadThread == nullptr)
+        return;
+
+    //the windows are only changed while the read ahead thread doesn't use them
+    if (readingAhead)
+        readAheadThread->removeTimeSliceClient(this);
+
+    const int capacity = juce::jmax(readAheadChunk * 2, (int)(readAheadLength * getAudioFormatReader()->sampleRate));
+    for (Window& window : windows) {
+        if (window.samples.getNumSamples() != capacity) {
+            if (locked && window.samples.getNumSamples() > 0)
+                RealtimeSupport::unlockBuffer(window.samples);
+            window.samples.setSize(2, capacity);
+            if (locked)
+                RealtimeSupport::lockBuffer(window.samples, "read ahead");
+        }
+
+        setRange(window, 0, 0);
+        window.seekTo = -1;
+        window.consumed = 0;
+        window.expected = -1;
+        window.lastUsed = 0;
+    }
+
+    //the first window starts right where playing will start
+    windows[0].seekTo = getNextReadPosition();
+    windows[0].expected = getNextReadPosition();
+    holding = false;
+
+    readingAhead = true;
+    readAheadThread->addTimeSliceClient(this);
+}
+
+void PrimedAudioFormatReaderSource::releaseResources()
+{
+    if (readingAhead) {
+        readAheadThread->removeTimeSliceClient(this);
+        readingAhead = false;
+
+        if (locked)
+            unlockWindows();
+        for (Window& window : windows)
+            window.samples.setSize(0, 0);
+    }
+
+    juce::AudioFormatReaderSource::releaseResources();
+}
+
+void PrimedAudioFormatReaderSource::getNextAudioBlock(const juce::AudioSourceChannelInfo& info)
+{
+    if (!readingAhead) {
+        //no read ahead thread, what isn't primed comes from the reader right here
+        if (info.numSamples > 0 && info.buffer->getNumChannels() <= 2) {
+            const juce::int64 pos = getNextReadPosition();
+            if (copyFromRegions(pos, info, 0, info.numSamples) == info.numSamples) {
+                setNextReadPosition(pos + info.numSamples);
+                return;
+            }
+        }
+
+        juce::AudioFormatReaderSource::getNextAudioBlock(info);
+        return;
+    }
+
+    info.clearActiveBufferRegion();
+
+    const juce::int64 length = getTotalLength();
+    const juce::int64 pos = getNextReadPosition();
+    const int numChannels = juce::jmin(2, info.buffer->getNumChannels());
+    int done = 0;
+    bool held = false;
+
+    while (done < info.numSamples && length > 0) {
+        juce::int64 position = pos + done;
+        if (isLooping())
+            position %= length;
+        else if (position >= length)
+            break;
+
+        const int wanted = (int)juce::jmin((juce::int64)(info.numSamples - done), length - position);
+
+        //a window follows every read, also from the primed regions, so it's filled by the time a region ends
+        Window& window = chooseWindow(position);
+        int got = copyFromRegions(position, info, done, wanted);
+        if (got == 0)
+            got = copyFromWindow(window, position, info, done, wanted);
+
+        window.lastUsed = ++useCounter;
+
+        //not decoded yet: holds right here instead of waiting or skipping it, the rest of the block stays silent
+        if (got == 0) {
+            if (!holding) {
+                holding = true;
+                numUnderruns.fetch_add(1, std::memory_order_relaxed);
+                const int fade = juce::jmin(holdFadeLength, done);
+                for (int ch = 0; ch < numChannels; ++ch)
+                    info.buffer->applyGainRamp(ch, info.startSample + done - fade, fade, 1.0f, 0.0f);
+            }
+            window.expected = position;
+            window.consumed = position;
+            held = true;
+            break;
+        }
+
+        if (holding) {
+            holding = false;
+            const int fade = juce::jmin(holdFadeLength, got);
+            for (int ch = 0; ch < numChannels; ++ch)
+                info.buffer->applyGainRamp(ch, info.startSample + done, fade, 0.0f, 1.0f);
+        }
+
+        window.expected = position + got;
+        window.consumed = position + got;
+        done += got;
+    }
+
+    //the end of a file that doesn't loop is passed as usual, so the transport notices it
+    setNextReadPosition(pos + (held ? done : info.numSamples));
+}
+
+PrimedAudioFormatReaderSource::Window& PrimedAudioFormatReaderSource::chooseWindow(juce::int64 position)
+{
+    for (Window& window : windows) {
+        if (window.expected == position)
+            return window;
+    }
+
+    for (Window& window : windows) {
+        if (position >= window.start.load(std::memory_order_acquire) && position < window.end.load(std::memory_order_acquire))
+            return window;
+    }
+
+    //a jump, the window used least recently starts over from there
+    Window* oldest = &windows[0];
+    for (Window& window : windows) {
+        if (window.lastUsed < oldest->lastUsed)
+            oldest = &window;
+    }
+
+    oldest->seekTo = position;
+    oldest->expected = position;
+    return *oldest;
+}
+
+int PrimedAudioFormatReaderSource::copyFromRegions(juce::int64 position, const juce::AudioSourceChannelInfo& info, int offset, int numSamples) const
+{
+    for (const Region& region : regions) {
+        const juce::int64 regionEnd = region.start + region.samples.getNumSamples();
+        if (position < region.start || position >= regionEnd)
+            continue;
+
+        const int n = (int)juce::jmin((juce::int64)numSamples, regionEnd - position);
+        for (int ch = 0; ch < juce::jmin(2, info.buffer->getNumChannels()); ++ch)
+            info.buffer->copyFrom(ch, info.startSample + offset, region.samples, ch, (int)(position - region.start), n);
+        return n;
+    }
+
+    return 0;
+}
+
+int PrimedAudioFormatReaderSource::copyFromWindow(Window& window, juce::int64 position, const juce::AudioSourceChannelInfo& info, int offset, int numSamples) const
+{
+    const int capacity = window.samples.getNumSamples();
+    const int numChannels = juce::jmin(2, info.buffer->getNumChannels());
+
+    //the read ahead thread only holds the version odd for a moment, one retry is almost always enough
+    for (int attempt = 0; attempt < 3; ++attempt) {
+        const juce::uint32 version = window.version.load(std::memory_order_acquire);
+        if ((version & 1) != 0)
+            continue;
+
+        const juce::int64 start = window.start.load(std::memory_order_acquire);
+        const juce::int64 end = window.end.load(std::memory_order_acquire);
+        if (position < start || position >= end)
+            return 0;
+
+        const int n = (int)juce::jmin((juce::int64)numSamples, end - position);
+        const int ringPos = (int)(position % capacity);
+        const int first = juce::jmin(n, capacity - ringPos);
+        for (int ch = 0; ch < numChannels; ++ch) {
+            info.buffer->copyFrom(ch, info.startSample + offset, window.samples, ch, ringPos, first);
+            if (first < n)
+                info.buffer->copyFrom(ch, info.startSample + offset + first, window.samples, ch, 0, n - first);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (window.version.load(std::memory_order_relaxed) == version)
+            return n;
+    }
+
+    return 0;
+}
+
+void PrimedAudioFormatReaderSource::setRange(Window& window, juce::int64 start, juce::int64 end)
+{
+    window.version.fetch_add(1, std::memory_order_acq_rel);
+    window.start.store(start, std::memory_order_release);
+    window.end.store(end, std::memory_order_release);
+    window.version.fetch_add(1, std::memory_order_acq_rel);
+}
+
+int PrimedAudioFormatReaderSource::useTimeSlice()
+{
+    bool more = false;
+    for (Window& window : windows)
+        more = fill(window) || more;
+
+    //while there is space left in a window it's filled right away, otherwise checked again after a few ms
+    return more ? 0 : 5;
+}
+
+bool PrimedAudioFormatReaderSource::fill(Window& window)
+{
+    juce::int64 start = window.start.load(std::memory_order_relaxed);
+    juce::int64 end = window.end.load(std::memory_order_relaxed);
+
+    const juce::int64 seekTo = window.seekTo.exchange(-1);
+    if (seekTo >= 0 && (seekTo < start || seekTo > end))
+        start = end = seekTo;
+
+    //what was played can be overwritten. A window that fell behind skips ahead instead of decoding what's gone by already
+    const juce::int64 consumed = window.consumed.load(std::memory_order_acquire);
+    if (consumed > end)
+        start = end = consumed;
+    else if (consumed > start)
+        start = consumed;
+
+    if (start != window.start.load(std::memory_order_relaxed) || end != window.end.load(std::memory_order_relaxed))
+        setRange(window, start, end);
+
+    const int capacity = window.samples.getNumSamples();
+    const juce::int64 length = getTotalLength();
+    const int num = (int)juce::jmin((juce::int64)readAheadChunk, (juce::int64)capacity - (end - start), length - end);
+    if (num <= 0)
+        return false;
+
+    //straight into the ring, in two parts where it wraps around
+    juce::AudioFormatReader* reader = getAudioFormatReader();
+    const int ringPos = (int)(end % capacity);
+    const int first = juce::jmin(num, capacity - ringPos);
+    reader->read(&window.samples, ringPos, first, end, true, true);
+    if (first < num)
+        reader->read(&window.samples, 0, num - first, end + first, true, true);
+
+    window.end.store(end + num, std::memory_order_release);
+    return true;
+}
+
+AudioPrefetcher::AudioPrefetcher(FormatSniffer& formatSniffer_)
+    : formatSniffer(formatSniffer_)
+{
+}
+
+AudioPrefetcher::~AudioPrefetcher()
+{
+    cancelPendingUpdate();
+    ++generation;
+    JobSystem::getShared().cancelAndWait(jobs);
+}
+
+void AudioPrefetcher::prefetch(const juce::File& file, double loopStartSecs, JobSystem::Priority priority)
+{
+    juce::uint32 gen;
+    {
+        const juce::ScopedLock sl(lock);
+
+        //already done or on its way
+        if ((ready != nullptr && readyFile == file)
+            || (workingOn == file && workingGeneration == generation))
+            return;
+
+        //still queued, a more urgent request queues it again and whichever job starts first takes it
+        if (pendingFile == file && priority >= pendingPriority)
+            return;
+
+        if (pendingFile != file) {
+            pendingFile = file;
+            pendingLoopStart = loopStartSecs;
+            ++generation;
+        }
+        pendingPriority = priority;
+        gen = generation;
+    }
+
+    JobSystem::getShared().run(priority, [this, gen] { process(gen); }, jobs);
+}
+
+std::unique_ptr<PrimedAudioFormatReaderSource> AudioPrefetcher::take(const juce::File& file, int maxWaitMs)
+{
+    const juce::uint32 deadline = juce::Time::getMillisecondCounter() + (juce::uint32)maxWaitMs;
+
+    for (;;) {
+        {
+            const juce::ScopedLock sl(lock);
+
+            if (ready != nullptr && readyFile == file) {
+                readyFile = juce::File();
+                return std::move(ready);
+            }
+
+            if (pendingFile != file && workingOn != file)
+                return nullptr;
+        }
+
+        if (juce::Time::getMillisecondCounter() >= deadline)
+            return nullptr;
+
+        jobDone.wait(50);
+    }
+}
+
+void AudioPrefetcher::process(juce::uint32 gen)
+{
+    juce::File file;
+    double loopStart;
+    {
+        const juce::ScopedLock sl(lock);
+
+        //superseded by a newer request, or taken by the other job of the same request
+        if (generation != gen || pendingFile == juce::File())
+            return;
+
+        file = pendingFile;
+        loopStart = pendingLoopStart;
+        pendingFile = juce::File();
+        workingOn = file;
+        workingGeneration = gen;
+    }
+
+    //a newer request makes this one obsolete
+    auto isCancelled = [this, gen] { return jobs.isCancelled() || generation != gen; };
+
+    std::unique_ptr<PrimedAudioFormatReaderSource> source;
+    if (juce::AudioFormatReader* reader = formatSniffer.createReaderFor(file)) {
+        source = std::make_unique<PrimedAudioFormatReaderSource>(reader, true);
+        const int numSamples = (int)(primedLength * reader->sampleRate);
+
+        //the start is primed last, so the decoder continues from there without seeking
+        bool completed = true;
+        if (loopStart > 0)
+            completed = source->primeRegion((juce::int64)(loopStart * reader->sampleRate), numSamples, isCancelled);
+        if (completed)
+            completed = source->primeRegion(0, numSamples, isCancelled);
+
+        if (!completed)
+            source.reset();
+    }
+
+    {
+        const juce::ScopedLock sl(lock);
+
+        //a cancelled job may still be running while the next one started
+        if (workingGeneration == gen)
+            workingOn = juce::File();
+
+        //cancelled requests are dropped silently
+        if (!isCancelled()) {
+            finished.emplace_back(file, source != nullptr);
+            if (source != nullptr) {
+                readyFile = file;
+                ready = std::move(source);
+            }
+        }
+    }
+    jobDone.signal();
+    triggerAsyncUpdate();
+}
+
+void AudioPrefetcher::handleAsyncUpdate()
+{
+    std::vector<std::pair<juce::File, bool>> results;
+    {
+        const juce::ScopedLock sl(lock);
+        results.swap(finished);
+    }
+
+    for (auto& result : results) {
+        if (onPrefetchFinished)
+            onPrefetchFinished(result.first, result.second);
+    }
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "FormatSniffer.h"
+#include "JobSystem.h"
+
+
+/// <summary>
+/// AudioFormatReaderSource which serves some regions of the file (usually the start and the loop start)
+/// from memory, so the first blocks after starting playback don't wait for the disk or the decoder.
+/// Once a read ahead thread is set, the audio thread only ever copies from memory: two windows of the file
+/// (one for the playing position and one for the other side of a crossfade) are decoded ahead of the position by that thread.
+/// If the position isn't decoded yet, playing holds there (faded out and in again) and the underrun is counted, nothing of the file
+/// is skipped. A jump to a primed region continues seamlessly, the window fills up behind it.
+/// Without a read ahead thread everything outside of the regions is read as usual.
+/// </summary>
+class PrimedAudioFormatReaderSource : public juce::AudioFormatReaderSource,
+                                      private juce::TimeSliceClient
+{
+public:
+    PrimedAudioFormatReaderSource(juce::AudioFormatReader* reader, bool deleteReaderWhenThisIsDeleted);
+    ~PrimedAudioFormatReaderSource() override;
+
+    /// <summary>
+    /// decodes a region into memory. Must not be called while the source is played.
+    /// </summary>
+    /// <returns>false if shouldCancel returned true in between</returns>
+    bool primeRegion(juce::int64 startSample, int numSamples, const std::function<bool()>& shouldCancel);
+
+    /// <summary>
+    /// the thread decoding ahead of the playing position. Has to be set before the source is prepared and outlive it.
+    /// </summary>
+    void setReadAheadThread(juce::TimeSliceThread* thread) { readAheadThread = thread; }
+
+    void prepareToPlay(int samplesPerBlockExpected, double sampleRate) override;
+    void releaseResources() override;
+    void getNextAudioBlock(const juce::AudioSourceChannelInfo& info) override;
+
+    /// <summary>
+    /// keeps the primed regions and the read ahead windows, and the ones allocated later, in RAM (see RealtimeSupport).
+    /// Must be called before the source is played.
+    /// </summary>
+    void lockInMemory();
+
+    /// <summary>
+    /// bytes of the primed regions and the read ahead windows
+    /// </summary>
+    size_t getMemoryUsage() const;
+
+    /// <summary>
+    /// how often playing had to hold because the read ahead thread fell behind, since the source was created
+    /// </summary>
+    int getNumUnderruns() const { return numUnderruns.load(std::memory_order_relaxed); }
+
+    static constexpr double readAheadLength = 2.0;  //secs per window
+
+private:
+    struct Region
+    {
+        juce::int64 start;
+        juce::AudioBuffer<float> samples;
+    };
+
+    //ring buffer of the file from start to end, sample n is at n % capacity. The range is a seqlock: it's only changed by
+    //the read ahead thread, the audio thread copies without ever waiting and throws the copy away if the version changed meanwhile
+    struct Window
+    {
+        juce::AudioBuffer<float> samples;
+        std::atomic<juce::uint32> version{ 0 };     //odd while start or end change
+        std::atomic<juce::int64> start{ 0 };
+        std::atomic<juce::int64> end{ 0 };
+        std::atomic<juce::int64> seekTo{ -1 };      //set by the audio thread when it needs a position this window doesn't have
+        std::atomic<juce::int64> consumed{ 0 };     //end of the audio thread's last read
+
+        //only used by the audio thread
+        juce::int64 expected = -1;
+        juce::uint32 lastUsed = 0;
+    };
+
+    static constexpr int numWindows = 2;
+    static constexpr int readAheadChunk = 8192;
+    static constexpr int holdFadeLength = 64;   //samples faded out before and in after holding, so it doesn't click
+
+    int useTimeSlice() override;
+    bool fill(Window& window);
+    void setRange(Window& window, juce::int64 start, juce::int64 end);
+
+    Window& chooseWindow(juce::int64 position);
+    int copyFromRegions(juce::int64 position, const juce::AudioSourceChannelInfo& info, int offset, int numSamples) const;
+    int copyFromWindow(Window& window, juce::int64 position, const juce::AudioSourceChannelInfo& info, int offset, int numSamples) const;
+    void lockWindows();
+    void unlockWindows();
+
+    std::vector<Region> regions;
+    bool locked = false;
+
+    juce::TimeSliceThread* readAheadThread = nullptr;
+    bool readingAhead = false;
+    Window windows[numWindows];
+    juce::uint32 useCounter = 0;
+    bool holding = false;   //only used by the audio thread
+    std::atomic<int> numUnderruns{ 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PrimedAudioFormatReaderSource)
+};
+
+
+/// <summary>
+/// Opens the selected file in the background and primes its start and loop start, so a following
+/// double click can start playback right away. A new request cancels the previous one between two
+/// decoded chunks. This is also how files are opened without blocking the message thread, as interactive jobs.
+/// </summary>
+class AudioPrefetcher : private juce::AsyncUpdater
+{
+public:
+    AudioPrefetcher(FormatSniffer& formatSniffer);
+    ~AudioPrefetcher() override;
+
+    void prefetch(const juce::File& file, double loopStartSecs, JobSystem::Priority priority = JobSystem::Priority::prefetch);
+
+    /// <summary>
+    /// returns the prefetched source for this file, waits up to maxWaitMs if it's still being prepared.
+    /// </summary>
+    /// <returns>nullptr if the file wasn't prefetched (yet)</returns>
+    std::unique_ptr<PrimedAudioFormatReaderSource> take(const juce::File& file, int maxWaitMs = 0);
+
+    //called on the message thread for every request which wasn't cancelled, success is false if the file couldn't be read
+    std::function<void(const juce::File& file, bool success)> onPrefetchFinished;
+
+    static constexpr double primedLength = 0.5;    //secs per region
+
+private:
+    void process(juce::uint32 gen);
+    void handleAsyncUpdate() override;
+
+    FormatSniffer& formatSniffer;
+    JobSystem::CancellationToken jobs;
+
+    juce::CriticalSection lock;
+    juce::File pendingFile;
+    double pendingLoopStart = 0;
+    JobSystem::Priority pendingPriority = JobSystem::Priority::prefetch;
+    juce::File workingOn;
+    juce::uint32 workingGeneration = 0;
+    std::atomic<juce::uint32> generation{ 0 };
+    juce::File readyFile;
+    std::unique_ptr<PrimedAudioFormatReaderSource> ready;
+    juce::WaitableEvent jobDone;
+    std::vector<std::pair<juce::File, bool>> finished;
+
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AudioPrefetcher)
+};
@@ -0,0 +1,587 @@
+#include "Benchmarks.h"
+#include "FormatSniffer.h"
+#include "ParallelFlacDecoder.h"
+#include "SearchIndex.h"
+#include "MainComponent.h"
+#include <iostream>
+
+#if JUCE_WINDOWS
+ #include <windows.h>
+#else
+ #include <sys/resource.h>
+#endif
+
+namespace
+{
+    double millisecondsSince(juce::int64 startTicks)
+    {
+        return juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks) * 1000.0;
+    }
+
+    juce::var makeError(const juce::String& message)
+    {
+        juce::DynamicObject* obj = new juce::DynamicObject();
+        obj->setProperty("error", message);
+        return juce::var(obj);
+    }
+
+    //keeps the message loop running until done() or the timeout, the benchmarks are started from JUCEApplication::initialise
+    bool dispatchUntil(const std::function<bool()>& done, int timeoutMs)
+    {
+        const juce::uint32 start = juce::Time::getMillisecondCounter();
+        while (!done()) {
+            if (juce::Time::getMillisecondCounter() - start > (juce::uint32)timeoutMs)
+                return false;
+            juce::MessageManager::getInstance()->runDispatchLoopUntil(1);
+        }
+        return true;
+    }
+
+    //user and system time of the whole process
+    double processCpuMs()
+    {
+       #if JUCE_WINDOWS
+        FILETIME creation, exit, kernel, user;
+        if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+            return 0;
+        auto toMs = [](const FILETIME& t) { return (double)((juce::uint64)t.dwHighDateTime << 32 | t.dwLowDateTime) / 10000.0; };
+        return toMs(kernel) + toMs(user);
+       #else
+        rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0)
+            return 0;
+        auto toMs = [](const timeval& t) { return t.tv_sec * 1000.0 + t.tv_usec / 1000.0; };
+        return toMs(usage.ru_utime) + toMs(usage.ru_stime);
+       #endif
+    }
+
+    //cpu ms per wall second while only the message loop runs
+    double measureCpuMsPerSec(double seconds)
+    {
+        const double cpuStart = processCpuMs();
+        const juce::int64 start = juce::Time::getHighResolutionTicks();
+        dispatchUntil([]() { return false; }, (int)(seconds * 1000));
+        return (processCpuMs() - cpuStart) / (millisecondsSince(start) / 1000.0);
+    }
+
+    juce::var summarise(const juce::Array<double>& values)
+    {
+        juce::DynamicObject* obj = new juce::DynamicObject();
+        double sum = 0;
+        double max = 0;
+        juce::Array<juce::var> all;
+        for (double value : values) {
+            sum += value;
+            max = juce::jmax(max, value);
+            all.add(value);
+        }
+        obj->setProperty("avg", values.isEmpty() ? 0.0 : sum / values.size());
+        obj->setProperty("max", max);
+        obj->setProperty("values", all);
+        return juce::var(obj);
+    }
+}
+
+bool Benchmarks::runFromCommandLine(const juce::String& commandLine)
+{
+    juce::StringArray tokens = juce::StringArray::fromTokens(commandLine, true);
+    tokens.trim();
+    for (juce::String& token : tokens)
+        token = token.unquoted();
+
+    int index = tokens.indexOf("--benchmark");
+    if (index < 0)
+        return false;
+
+    juce::String name = tokens[index + 1];
+    juce::StringArray args(tokens.begin() + juce::jmin(index + 2, tokens.size()), juce::jmax(0, tokens.size() - index - 2));
+
+    juce::File outFile;
+    int outIndex = args.indexOf("--out");
+    if (outIndex >= 0) {
+        outFile = juce::File::getCurrentWorkingDirectory().getChildFile(args[outIndex + 1]);
+        args.removeRange(outIndex, 2);
+    }
+
+    juce::var result;
+    if (name == "formatSniffing")
+        result = formatSniffing(args);
+    else if (name == "startup")
+        result = startup(args);
+    else if (name == "idlePower")
+        result = idlePower(args);
+    else if (name == "idle")
+        result = idle(args);
+    else if (name == "flacDecode")
+        result = flacDecode(args);
+    else if (name == "search")
+        result = search(args);
+    else
+        result = makeError("unknown benchmark: " + name);
+
+    if (auto* obj = result.getDynamicObject())
+        obj->setProperty("benchmark", name);
+
+    juce::String json = juce::JSON::toString(result);
+    std::cout << json << std::endl;
+
+    if (outFile != juce::File())
+        outFile.replaceWithText(json);
+
+    return true;
+}
+
+juce::var Benchmarks::formatSniffing(const juce::StringArray& args)
+{
+    juce::File directory = juce::File::getCurrentWorkingDirectory().getChildFile(args[0]);
+    if (!directory.isDirectory())
+        return makeError("usage: --benchmark formatSniffing directory");
+
+    juce::AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+
+    juce::Array<juce::File> files;
+    for (const juce::DirectoryEntry& entry : juce::RangedDirectoryIterator(directory, true, "*", juce::File::findFiles))
+        files.add(entry.getFile());
+
+    auto run = [&files](const std::function<juce::AudioFormatReader* (const juce::File&)>& createReader, int& numReadable) {
+        numReadable = 0;
+        const juce::int64 start = juce::Time::getHighResolutionTicks();
+        for (const juce::File& file : files) {
+            std::unique_ptr<juce::AudioFormatReader> reader(createReader(file));
+            if (reader != nullptr)
+                ++numReadable;
+        }
+        return millisecondsSince(start);
+    };
+
+    int numReadable = 0;
+
+    //first pass only brings the files into the os cache, so all measured passes start the same
+    run([&](const juce::File& file) { return formatManager.createReaderFor(file); }, numReadable);
+
+    juce::DynamicObject* obj = new juce::DynamicObject();
+    juce::var result(obj);
+    obj->setProperty("numFiles", files.size());
+
+    auto addRun = [&](const juce::String& runName, double ms) {
+        juce::DynamicObject* runObj = new juce::DynamicObject();
+        runObj->setProperty("totalMs", ms);
+        runObj->setProperty("usPerFile", files.isEmpty() ? 0.0 : ms * 1000.0 / files.size());
+        runObj->setProperty("numReadable", numReadable);
+        obj->setProperty(runName, juce::var(runObj));
+    };
+
+    double ms = run([&](const juce::File& file) { return formatManager.createReaderFor(file); }, numReadable);
+    addRun("formatManager", ms);
+
+    FormatSniffer sniffer(formatManager);
+    ms = run([&](const juce::File& file) { return sniffer.createReaderFor(file); }, numReadable);
+    addRun("sniffed", ms);
+
+    ms = run([&](const juce::File& file) { return sniffer.createReaderFor(file); }, numReadable);
+    addRun("sniffedCached", ms);
+
+    return result;
+}
+
+juce::var Benchmarks::startup(const juce::StringArray& args)
+{
+    const int numSettingsEntries = args.size() > 0 ? args[0].getIntValue() : 100000;
+    const int numLibraryFiles = args.size() > 1 ? args[1].getIntValue() : 200;
+    if (numSettingsEntries < 0 || numLibraryFiles < 2)
+        return makeError("usage: --benchmark startup [numSettingsEntries] [numLibraryFiles >= 2]");
+
+    struct TemporaryDirectory
+    {
+        juce::File dir = juce::File::getSpecialLocation(juce::File::tempDirectory).getNonexistentChildFile("LoopyAudioPlayerBenchmark", "");
+        ~TemporaryDirectory() { dir.deleteRecursively(); }
+    } tempDir;
+
+    const juce::File root = tempDir.dir;
+    const juce::File libRoot = root.getChildFile("library");
+    const juce::File settingsFile = root.getChildFile("settings.json");
+
+    //library: short sine tones, 20 per album directory
+    const double sampleRate = 44100;
+    juce::AudioBuffer<float> tone(2, (int)(2 * sampleRate));
+    for (int i = 0; i < tone.getNumSamples(); ++i) {
+        float value = 0.25f * std::sin(juce::MathConstants<float>::twoPi * 440.0f * (float)(i / sampleRate));
+        tone.setSample(0, i, value);
+        tone.setSample(1, i, value);
+    }
+
+    juce::WavAudioFormat wav;
+    juce::Array<juce::File> libraryFiles;
+    for (int i = 0; i < numLibraryFiles; ++i) {
+        juce::File file = libRoot.getChildFile(juce::String::formatted("album_%03d", i / 20)).getChildFile(juce::String::formatted("track_%05d.wav", i));
+        file.getParentDirectory().createDirectory();
+
+        std::unique_ptr<juce::OutputStream> out = file.createOutputStream();
+        if (out == nullptr)
+            return makeError("can't write " + file.getFullPathName());
+
+        std::unique_ptr<juce::AudioFormatWriter> writer(wav.createWriterFor(out.get(), sampleRate, 2, 16, {}, 0));
+        if (writer == nullptr)
+            return makeError("can't write " + file.getFullPathName());
+        out.release();
+
+        writer->writeFromAudioSampleBuffer(tone, 0, tone.getNumSamples());
+        libraryFiles.add(file);
+    }
+
+    //settings: the first half of the library has saved loop markers, everything else are files from elsewhere
+    SettingsSnapshot snapshot;
+    snapshot.currentFileBrowserPath = libRoot.getFullPathName();
+    snapshot.musicLibs.push_back(libRoot);
+    auto records = std::make_shared<std::vector<AudioFile>>();
+    for (int i = 0; i < numSettingsEntries; ++i) {
+        AudioFile audioFile;
+        if (i < numLibraryFiles / 2) {
+            audioFile.setAbsPath(libraryFiles[i].getFullPathName());
+            audioFile.setRelPathToLib(libraryFiles[i].getRelativePathFrom(libRoot));
+        }
+        else {
+            audioFile.setAbsPath(root.getChildFile("elsewhere").getChildFile(juce::String::formatted("archive_%07d.wav", i)).getFullPathName());
+        }
+        audioFile.loopStart = 0.5;
+        audioFile.loopEnd = 1.5;
+        audioFile.length = 2;
+        audioFile.fingerprint.bits = (juce::uint64)i + 1;
+        audioFile.fingerprint.reliable = ~(juce::uint64)0;
+        audioFile.fingerprint.lengthInSamples = tone.getNumSamples();
+        audioFile.fingerprint.sampleRate = (juce::uint32)sampleRate;
+        audioFile.fingerprint.computed = true;
+        audioFile.setCustomSetting(AudioFile::CustomSetting::LoopStart, true);
+        audioFile.setCustomSetting(AudioFile::CustomSetting::LoopEnd, true);
+        records->push_back(audioFile);
+    }
+    snapshot.records.push_back(std::move(records));
+
+    if (!SettingsAutoSaver(settingsFile).saveNow(std::move(snapshot)))
+        return makeError("can't write " + settingsFile.getFullPathName());
+
+    juce::DynamicObject* obj = new juce::DynamicObject();
+    juce::var result(obj);
+    obj->setProperty("numSettingsEntries", numSettingsEntries);
+    obj->setProperty("numLibraryFiles", numLibraryFiles);
+
+    //no audio device, and caches and traces go into the temporary directory instead of the app's
+    MainComponent::Options options;
+    options.settingsFile = settingsFile;
+    options.appDataDirectory = root.getChildFile("appData");
+    options.openAudioDevice = false;
+
+    //startup like the app does it, settings are read in the background
+    {
+        juce::int64 start = juce::Time::getHighResolutionTicks();
+        MainComponent comp(options);
+        obj->setProperty("constructorMs", millisecondsSince(start));
+
+        if (!dispatchUntil([&comp]() { return comp.isSettingsLoaded(); }, 120000))
+            return makeError("settings were not loaded within 2 minutes");
+        obj->setProperty("settingsAppliedMs", millisecondsSince(start));
+    }
+
+    juce::int64 start = juce::Time::getHighResolutionTicks();
+    MainComponent::readSettingsFile(settingsFile);
+    obj->setProperty("readSettingsFileMs", millisecondsSince(start));
+
+    options.loadSettingsOnStart = false;
+    MainComponent comp(options);
+    start = juce::Time::getHighResolutionTicks();
+    comp.loadAllSettingsFromFile();
+    obj->setProperty("loadAllSettingsFromFileMs", millisecondsSince(start));
+    obj->setProperty("allFilesBytes", (juce::int64)comp.getRecordsMemoryUsage());
+    obj->setProperty("pathTableBytes", (juce::int64)PathTable::getShared().getMemoryUsage());
+
+    juce::Array<double> knownUs, newUs;
+    for (int i = 0; i < numLibraryFiles; ++i) {
+        start = juce::Time::getHighResolutionTicks();
+        comp.findFileInAllFiles(libraryFiles[i]);
+        (i < numLibraryFiles / 2 ? knownUs : newUs).add(millisecondsSince(start) * 1000.0);
+    }
+    obj->setProperty("findFileInAllFilesKnownUs", summarise(knownUs));
+    obj->setProperty("findFileInAllFilesNewUs", summarise(newUs));
+
+    //without device the audio callback is pulled from here, the block size of a typical device
+    const int blockSize = 512;
+    comp.prepareToPlay(blockSize, sampleRate);
+    juce::AudioBuffer<float> block(2, blockSize);
+
+    auto timeToFirstSample = [&](const juce::File& file) {
+        comp.stop();
+        dispatchUntil([&comp]() { return comp.isStopped(); }, 5000);
+
+        juce::int64 openStart = juce::Time::getHighResolutionTicks();
+        comp.openFile(file, true);
+        bool audible = dispatchUntil([&]() {
+            juce::AudioSourceChannelInfo info(block);
+            comp.getNextAudioBlock(info);
+            return block.getMagnitude(0, blockSize) > 0.0f;
+        }, 10000);
+        return audible ? millisecondsSince(openStart) : -1.0;
+    };
+
+    //all but the last one are in the ReaderPool afterwards
+    const int numOpens = juce::jmin(comp.getMaxPooledReaders(), numLibraryFiles);
+    juce::Array<double> coldMs, pooledMs;
+    for (int i = 0; i < numOpens; ++i)
+        coldMs.add(timeToFirstSample(libraryFiles[i]));
+    for (int i = 0; i < numOpens - 1; ++i)
+        pooledMs.add(timeToFirstSample(libraryFiles[i]));
+
+    comp.stop();
+    comp.releaseResources();
+
+    obj->setProperty("openColdMs", summarise(coldMs));
+    obj->setProperty("openPooledMs", summarise(pooledMs));
+    obj->setProperty("startupTrace", StartupTrace::toVar());
+
+    return result;
+}
+
+juce::var Benchmarks::idlePower(const juce::StringArray& args)
+{
+    const double seconds = args.size() > 0 ? args[0].getDoubleValue() : 10.0;
+    if (seconds <= 0)
+        return makeError("usage: idlePower [seconds]");
+
+    //what MainComponent::getNextAudioBlock does while stopped
+    struct SilentCallback : public juce::AudioIODeviceCallback
+    {
+        std::atomic<int> numCallbacks{ 0 };
+
+        void audioDeviceIOCallbackWithContext(const float* const*, int, float* const* outputChannelData, int numOutputChannels,
+                                              int numSamples, const juce::AudioIODeviceCallbackContext&) override
+        {
+            for (int channel = 0; channel < numOutputChannels; ++channel)
+                if (outputChannelData[channel] != nullptr)
+                    juce::FloatVectorOperations::clear(outputChannelData[channel], numSamples);
+            ++numCallbacks;
+        }
+
+        void audioDeviceAboutToStart(juce::AudioIODevice*) override {}
+        void audioDeviceStopped() override {}
+    };
+
+    juce::AudioDeviceManager deviceManager;
+    const juce::String error = deviceManager.initialise(0, 2, nullptr, true);
+    if (error.isNotEmpty() || deviceManager.getCurrentAudioDevice() == nullptr)
+        return makeError("no audio device: " + error);
+
+    SilentCallback callback;
+    deviceManager.addAudioCallback(&callback);
+
+    juce::DynamicObject* obj = new juce::DynamicObject();
+    juce::var result(obj);
+    obj->setProperty("device", deviceManager.getCurrentAudioDevice()->getName());
+    obj->setProperty("bufferSize", deviceManager.getCurrentAudioDevice()->getCurrentBufferSizeSamples());
+    obj->setProperty("seconds", seconds);
+
+    dispatchUntil([&callback]() { return callback.numCallbacks > 0; }, 5000);
+    const int callbacksBefore = callback.numCallbacks;
+    obj->setProperty("deviceOpenCpuMsPerSec", measureCpuMsPerSec(seconds));
+    obj->setProperty("deviceOpenCallbacksPerSec", (callback.numCallbacks - callbacksBefore) / seconds);
+
+    deviceManager.closeAudioDevice();
+    obj->setProperty("deviceClosedCpuMsPerSec", measureCpuMsPerSec(seconds));
+
+    const int callbacksClosed = callback.numCallbacks;
+    const juce::int64 reopenStart = juce::Time::getHighResolutionTicks();
+    deviceManager.restartLastAudioDevice();
+    const bool reopened = dispatchUntil([&]() { return callback.numCallbacks > callbacksClosed; }, 5000);
+    obj->setProperty("reopenToFirstCallbackMs", reopened ? millisecondsSince(reopenStart) : -1.0);
+
+    deviceManager.removeAudioCallback(&callback);
+    deviceManager.closeAudioDevice();
+
+    return result;
+}
+
+juce::var Benchmarks::idle(const juce::StringArray& args)
+{
+    const double seconds = args.size() > 0 ? args[0].getDoubleValue() : 10.0;
+    if (seconds <= 0)
+        return makeError("usage: idle [seconds]");
+
+    struct TemporaryDirectory
+    {
+        juce::File dir = juce::File::getSpecialLocation(juce::File::tempDirectory).getNonexistentChildFile("LoopyAudioPlayerBenchmark", "");
+        ~TemporaryDirectory() { dir.deleteRecursively(); }
+    } tempDir;
+
+    //no settings and no audio device, caches go into the temporary directory instead of the app's
+    MainComponent::Options options;
+    options.settingsFile = tempDir.dir.getChildFile("settings.json");
+    options.appDataDirectory = tempDir.dir.getChildFile("appData");
+    options.openAudioDevice = false;
+
+    MainComponent comp(options);
+    if (!dispatchUntil([&comp]() { return comp.isSettingsLoaded(); }, 10000))
+        return makeError("settings were not loaded within 10 seconds");
+
+    //the playhead only refreshes with a peer, without display the timers are measured alone
+    const bool onDesktop = juce::Desktop::getInstance().getDisplays().getPrimaryDisplay() != nullptr;
+    if (onDesktop) {
+        comp.addToDesktop(juce::ComponentPeer::windowHasTitleBar);
+        comp.setVisible(true);
+    }
+
+    juce::DynamicObject* obj = new juce::DynamicObject();
+    juce::var result(obj);
+    obj->setProperty("seconds", seconds);
+    obj->setProperty("onDesktop", onDesktop);
+
+    //startup counts as activity, so the GUI refreshes until the idle delay is over
+    if (comp.isGuiActive())
+        obj->setProperty("activeCpuMsPerSec", measureCpuMsPerSec(GuiScheduler::idleDelay / 1000.0 * 0.5));
+
+    const juce::int64 start = juce::Time::getHighResolutionTicks();
+    const bool wentIdle = dispatchUntil([&comp]() { return !comp.isGuiActive(); }, 2 * GuiScheduler::idleDelay);
+    obj->setProperty("untilIdleMs", wentIdle ? millisecondsSince(start) : -1.0);
+    if (!wentIdle)
+        return makeError("the GUI did not go idle within " + juce::String(2 * GuiScheduler::idleDelay) + " ms");
+
+    obj->setProperty("idleCpuMsPerSec", measureCpuMsPerSec(seconds));
+
+    if (onDesktop)
+        comp.removeFromDesktop();
+
+    return result;
+}
+
+juce::var Benchmarks::flacDecode(const juce::StringArray& args)
+{
+    juce::File file = juce::File::getCurrentWorkingDirectory().getChildFile(args[0]);
+
+    juce::AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+    FormatSniffer sniffer(formatManager);
+
+    std::unique_ptr<juce::AudioFormatReader> reader(sniffer.createReaderFor(file));
+    if (!file.existsAsFile() || reader == nullptr || reader->lengthInSamples > std::numeric_limits<int>::max())
+        return makeError("usage: --benchmark flacDecode file");
+
+    const int numSamples = (int)reader->lengthInSamples;
+    juce::AudioBuffer<float> serial(juce::jmax(1, (int)reader->numChannels), numSamples);
+
+    //first pass only brings the file into the os cache
+    reader->read(&serial, 0, numSamples, 0, true, true);
+
+    juce::DynamicObject* obj = new juce::DynamicObject();
+    juce::var result(obj);
+    obj->setProperty("numSamples", numSamples);
+    obj->setProperty("lengthSecs", numSamples / reader->sampleRate);
+
+    reader.reset(sniffer.createReaderFor(file));
+    juce::int64 start = juce::Time::getHighResolutionTicks();
+    reader->read(&serial, 0, numSamples, 0, true, true);
+    const double serialMs = millisecondsSince(start);
+    obj->setProperty("serialMs", serialMs);
+
+    start = juce::Time::getHighResolutionTicks();
+    std::unique_ptr<ParallelFlacDecoder> decoder = ParallelFlacDecoder::open(file, sniffer);
+    if (decoder == nullptr)
+        return makeError("not a FLAC file with known length: " + file.getFullPathName());
+    obj->setProperty("indexMs", millisecondsSince(start));
+    obj->setProperty("numFrames", decoder->getNumFrames());
+
+    juce::Array<juce::var> runs;
+    juce::AudioBuffer<float> parallel(serial.getNumChannels(), numSamples);
+    for (int numThreads = 1; ; numThreads = juce::jmin(numThreads * 2, juce::SystemStats::getNumCpus())) {
+        //the calling thread decodes parts too
+        JobSystem jobs(numThreads - 1);
+
+        parallel.clear();
+        start = juce::Time::getHighResolutionTicks();
+        const bool success = decoder->decode(parallel, 0, 0, numSamples, jobs, JobSystem::Priority::interactive);
+        const double ms = millisecondsSince(start);
+
+        float maxDifference = 0;
+        for (int channel = 0; channel < serial.getNumChannels(); ++channel)
+            for (int i = 0; i < numSamples; ++i)
+                maxDifference = juce::jmax(maxDifference, std::abs(serial.getSample(channel, i) - parallel.getSample(channel, i)));
+
+        juce::DynamicObject* run = new juce::DynamicObject();
+        run->setProperty("numThreads", numThreads);
+        run->setProperty("ms", ms);
+        run->setProperty("speedup", serialMs / ms);
+        run->setProperty("success", success);
+        run->setProperty("maxDifference", maxDifference);
+        runs.add(juce::var(run));
+
+        if (numThreads >= juce::SystemStats::getNumCpus())
+            break;
+    }
+    obj->setProperty("parallel", runs);
+
+    return result;
+}
+
+juce::var Benchmarks::search(const juce::StringArray& args)
+{
+    const int numFiles = args.isEmpty() ? 200000 : args[0].getIntValue();
+    if (numFiles <= 0)
+        return makeError("usage: --benchmark search [numFiles]");
+
+    //the paths of a synthetic library, nothing is written to disk
+    const juce::File libRoot = juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("searchBenchmark");
+    juce::StringArray relPaths;
+    for (int i = 0; i < numFiles; ++i)
+        relPaths.add(juce::String::formatted("Artist %04d/Album %03d/%02d Track %07d.flac", i / 2000, (i / 20) % 100, i % 20, i));
+
+    juce::DynamicObject* obj = new juce::DynamicObject();
+    juce::var result(obj);
+    obj->setProperty("numFiles", numFiles);
+
+    SearchIndex index;
+    juce::int64 start = juce::Time::getHighResolutionTicks();
+    for (const juce::String& relPath : relPaths)
+        index.add(libRoot, relPath);
+    obj->setProperty("addMs", millisecondsSince(start));
+    obj->setProperty("indexBytes", (juce::int64)index.getMemoryUsage());
+
+    //long words, two and one characters, several words and nothing found
+    const juce::StringArray queries{ "track 0012345", "album 042 track", "07", "k 1", "zq", "a", "no such file" };
+    juce::DynamicObject* queriesObj = new juce::DynamicObject();
+    for (const juce::String& query : queries) {
+        juce::Array<double> us;
+        for (int i = 0; i < 20; ++i) {
+            start = juce::Time::getHighResolutionTicks();
+            index.search(query, 100);
+            us.add(millisecondsSince(start) * 1000.0);
+        }
+        queriesObj->setProperty(query, summarise(us));
+    }
+    obj->setProperty("searchUs", juce::var(queriesObj));
+
+    //half of the files are gone, removing them rebuilds the index while searching goes on
+    std::unordered_set<juce::String, StringHash> stillExisting;
+    for (int i = 0; i < numFiles; i += 2)
+        stillExisting.insert(relPaths[i]);
+
+    JobSystem jobs(1);
+    std::atomic<bool> removing{ true };
+    double removeMs = 0;
+    const JobSystem::Handle removed = jobs.run(JobSystem::Priority::interactive, [&] {
+        const juce::int64 removeStart = juce::Time::getHighResolutionTicks();
+        index.removeAllExcept(libRoot, stillExisting);
+        removeMs = millisecondsSince(removeStart);
+        removing = false;
+    });
+
+    juce::Array<double> whileRemovingUs;
+    while (removing) {
+        start = juce::Time::getHighResolutionTicks();
+        index.search("track 001", 100);
+        whileRemovingUs.add(millisecondsSince(start) * 1000.0);
+    }
+    jobs.wait(removed);
+
+    obj->setProperty("removeAllExceptMs", removeMs);
+    obj->setProperty("searchWhileRemovingUs", summarise(whileRemovingUs));
+    obj->setProperty("numFilesAfter", index.size());
+
+    return result;
+}
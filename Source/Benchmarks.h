@@ -0,0 +1,58 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+
+/// <summary>
+/// Headless measurements, started from the command line with
+///     LoopyAudioPlayer --benchmark name [arguments] [--out resultFile]
+/// Results are printed as json (and written to resultFile if given), so they can be compared between builds.
+/// </summary>
+namespace Benchmarks
+{
+    /// <summary>
+    /// runs the benchmark named on the command line, if there is one.
+    /// </summary>
+    /// <returns>true if a benchmark was requested, the app should quit then instead of opening its window</returns>
+    bool runFromCommandLine(const juce::String& commandLine);
+
+    /// <summary>
+    /// formatSniffing directory: creates a reader for every file in directory (recursive) with the AudioFormatManager,
+    /// with a fresh FormatSniffer and with the same FormatSniffer again (cached formats)
+    /// </summary>
+    juce::var formatSniffing(const juce::StringArray& args);
+
+    /// <summary>
+    /// startup [numSettingsEntries = 100000] [numLibraryFiles = 200]: writes a synthetic settings file and music library
+    /// into a temporary directory and measures, on MainComponents without audio device and with their app data in that directory:
+    /// the constructor, the time until settings loaded in the background are applied, readSettingsFile and loadAllSettingsFromFile
+    /// (and the memory of the loaded records),
+    /// findFileInAllFiles for known and new files and openFile until the first non silent sample (cold and from the ReaderPool)
+    /// </summary>
+    juce::var startup(const juce::StringArray& args);
+
+    /// <summary>
+    /// idlePower [seconds = 10]: opens the default output device with a callback rendering silence, like the player while stopped,
+    /// and measures the cpu time of the process per second of wall time with the device open and after closing it
+    /// (the idle power mode), then the time from reopening the device until its first callback
+    /// </summary>
+    juce::var idlePower(const juce::StringArray& args);
+
+    /// <summary>
+    /// idle [seconds = 10]: shows a MainComponent without audio device (on the desktop if there is one) and measures the cpu time
+    /// of the process per second of wall time while its GUI still refreshes after startup, and over seconds once nothing changes anymore
+    /// </summary>
+    juce::var idle(const juce::StringArray& args);
+
+    /// <summary>
+    /// flacDecode file: decodes the whole FLAC file with its reader, then indexes its frames and decodes it with
+    /// ParallelFlacDecoder on 1, 2, 4, ... up to all cores, each compared to the serial result
+    /// </summary>
+    juce::var flacDecode(const juce::StringArray& args);
+
+    /// <summary>
+    /// search [numFiles = 200000]: fills a SearchIndex with synthetic paths and measures adding them, searches with long,
+    /// two character and single character words, and searches running while removing half of the files rebuilds the index
+    /// </summary>
+    juce::var search(const juce::StringArray& args);
+}
@@ -0,0 +1,237 @@
+#include "BufferSizeCalibrator.h"
+
+namespace
+{
+    //the callbacks right after a restart of the device are often irregular
+    constexpr int warmUpCallbacks = 20;
+
+    //share of the buffer time the load may use, the rest is for the system and the real player
+    constexpr double maxLoad = 0.5;
+
+    //file at 44.1 kHz played on a 48 kHz device, the most common resampling case
+    constexpr double resampleRatio = 44100.0 / 48000.0;
+
+    constexpr int minBufferSize = 16;
+    constexpr int maxBufferSize = 4096;
+}
+
+BufferSizeCalibrator::BufferSizeCalibrator(juce::AudioDeviceManager& deviceManager)
+    : deviceManager(deviceManager)
+{
+}
+
+BufferSizeCalibrator::~BufferSizeCalibrator()
+{
+    cancel();
+}
+
+void BufferSizeCalibrator::start()
+{
+    cancel();
+
+    juce::AudioIODevice* device = deviceManager.getCurrentAudioDevice();
+    if (device == nullptr)
+        return;
+
+    originalSetup = deviceManager.getAudioDeviceSetup();
+    sizesToTry.clear();
+    for (int size : device->getAvailableBufferSizes()) {
+        if (size >= minBufferSize && size <= maxBufferSize)
+            sizesToTry.add(size);
+    }
+    sizesToTry.sort();
+    smallestStable = 0;
+
+    if (sizesToTry.isEmpty())
+        return;
+
+    deviceManager.addAudioCallback(this);
+    startStep();
+    startTimer(stepMs);
+}
+
+void BufferSizeCalibrator::cancel()
+{
+    if (!isTimerRunning())
+        return;
+
+    stopTimer();
+    deviceManager.removeAudioCallback(this);
+    deviceManager.setAudioDeviceSetup(originalSetup, true);
+}
+
+void BufferSizeCalibrator::abandon()
+{
+    if (!isTimerRunning())
+        return;
+
+    stopTimer();
+    deviceManager.removeAudioCallback(this);
+}
+
+void BufferSizeCalibrator::startStep()
+{
+    //largest first, so a device that can't keep up at all doesn't get tortured with tiny buffers
+    currentSize = sizesToTry.getLast();
+    sizesToTry.removeLast();
+
+    juce::AudioDeviceManager::AudioDeviceSetup setup = deviceManager.getAudioDeviceSetup();
+    setup.bufferSize = currentSize;
+    deviceManager.setAudioDeviceSetup(setup, true);
+
+    juce::AudioIODevice* device = deviceManager.getCurrentAudioDevice();
+    xrunsAtStepStart = device != nullptr ? device->getXRunCount() : -1;
+    numCallbacks = 0;
+    misses = 0;
+}
+
+void BufferSizeCalibrator::timerCallback()
+{
+    juce::AudioIODevice* device = deviceManager.getCurrentAudioDevice();
+    if (device == nullptr) {
+        cancel();
+        return;
+    }
+
+    //getXRunCount is -1 where the device doesn't count them, the own measurements have to do then
+    const int xruns = xrunsAtStepStart >= 0 ? device->getXRunCount() - xrunsAtStepStart : 0;
+    const bool stable = device->getCurrentBufferSizeSamples() == currentSize
+        && numCallbacks > warmUpCallbacks && misses == 0 && xruns <= 0;
+
+    if (stable)
+        smallestStable = currentSize;
+
+    if (!stable || sizesToTry.isEmpty())
+        finish(smallestStable);
+    else
+        startStep();
+}
+
+void BufferSizeCalibrator::finish(int bufferSize)
+{
+    stopTimer();
+    deviceManager.removeAudioCallback(this);
+
+    juce::AudioDeviceManager::AudioDeviceSetup setup = originalSetup;
+    if (bufferSize > 0)
+        setup.bufferSize = bufferSize;
+    deviceManager.setAudioDeviceSetup(setup, true);
+
+    if (onFinished)
+        onFinished(bufferSize);
+}
+
+void BufferSizeCalibrator::audioDeviceAboutToStart(juce::AudioIODevice* device)
+{
+    const int bufferSize = device->getCurrentBufferSizeSamples();
+    const double sampleRate = device->getCurrentSampleRate();
+    blockMs = sampleRate > 0 ? bufferSize * 1000.0 / sampleRate : 0;
+    lastCallbackMs = 0;
+
+    //one second of noise per source, read in a circle
+    const int sourceLength = juce::jmax((int)sampleRate, 2 * bufferSize);
+    sources.setSize(4, sourceLength);
+    juce::Random random;
+    for (int channel = 0; channel < sources.getNumChannels(); ++channel) {
+        float* data = sources.getWritePointer(channel);
+        for (int i = 0; i < sourceLength; ++i)
+            data[i] = random.nextFloat() * 2.0f - 1.0f;
+    }
+    mix.setSize(2, bufferSize);
+    resampled.setSize(2, bufferSize);
+    for (juce::LagrangeInterpolator& interpolator : interpolators)
+        interpolator.reset();
+}
+
+void BufferSizeCalibrator::audioDeviceIOCallbackWithContext(const float* const*, int, float* const* outputChannelData,
+                                                            int numOutputChannels, int numSamples,
+                                                            const juce::AudioIODeviceCallbackContext&)
+{
+    const double startMs = juce::Time::getMillisecondCounterHiRes();
+    const int callback = ++numCallbacks;
+
+    //a callback twice as late as expected means the device ran dry in between
+    if (callback > warmUpCallbacks && lastCallbackMs > 0 && startMs - lastCallbackMs > 2.0 * blockMs)
+        ++misses;
+    lastCallbackMs = startMs;
+
+    renderLoad(numSamples);
+
+    if (callback > warmUpCallbacks && juce::Time::getMillisecondCounterHiRes() - startMs > maxLoad * blockMs)
+        ++misses;
+
+    //only the load is measured, nothing of it is heard
+    for (int channel = 0; channel < numOutputChannels; ++channel) {
+        if (outputChannelData[channel] != nullptr)
+            juce::FloatVectorOperations::clear(outputChannelData[channel], numSamples);
+    }
+}
+
+void BufferSizeCalibrator::renderLoad(int numSamples)
+{
+    if (numSamples > mix.getNumSamples() || sources.getNumSamples() == 0)
+        return;
+
+    const int sourceLength = sources.getNumSamples();
+    const int needed = (int)std::ceil(numSamples * resampleRatio) + 4;
+    const float fadeStep = 0.001f;
+
+    mix.clear();
+    for (int source = 0; source < 2; ++source) {
+        //wraps around before the end instead of reading over it
+        if (sourcePositions[source] + needed >= sourceLength)
+            sourcePositions[source] = 0;
+
+        int used = 0;
+        for (int channel = 0; channel < 2; ++channel) {
+            used = interpolators[source * 2 + channel].process(resampleRatio, sources.getReadPointer(source * 2 + channel, sourcePositions[source]),
+                                                               resampled.getWritePointer(channel), numSamples,
+                                                               sourceLength - sourcePositions[source], 0);
+        }
+        sourcePositions[source] += used;
+
+        //fading out the first and in the second source, like a loop transition
+        const float startGain = source == 0 ? 1.0f - fade : fade;
+        const float endGain = source == 0 ? 1.0f - (fade + fadeStep) : fade + fadeStep;
+        for (int channel = 0; channel < 2; ++channel)
+            mix.addFromWithRamp(channel, 0, resampled.getReadPointer(channel), numSamples, startGain, endGain);
+    }
+
+    fade += fadeStep;
+    if (fade >= 1.0f)
+        fade = 0;
+}
+
+int BufferSizeCalibrator::findBufferSize(const juce::XmlElement& calibrations, juce::AudioIODevice& device)
+{
+    for (auto* calibration : calibrations.getChildWithTagNameIterator("CALIBRATION")) {
+        if (calibration->getStringAttribute("deviceType") == device.getTypeName()
+            && calibration->getStringAttribute("device") == device.getName()
+            && calibration->getDoubleAttribute("sampleRate") == device.getCurrentSampleRate())
+            return juce::jmax(0, calibration->getIntAttribute("bufferSize"));
+    }
+    return notCalibrated;
+}
+
+void BufferSizeCalibrator::storeBufferSize(juce::XmlElement& calibrations, juce::AudioIODevice& device, int bufferSize)
+{
+    for (auto* calibration : calibrations.getChildWithTagNameIterator("CALIBRATION")) {
+        if (calibration->getStringAttribute("deviceType") == device.getTypeName()
+            && calibration->getStringAttribute("device") == device.getName()
+            && calibration->getDoubleAttribute("sampleRate") == device.getCurrentSampleRate()) {
+            calibrations.removeChildElement(calibration, true);
+            break;
+        }
+    }
+
+    auto* calibration = calibrations.createNewChildElement("CALIBRATION");
+    calibration->setAttribute("deviceType", device.getTypeName());
+    calibration->setAttribute("device", device.getName());
+    calibration->setAttribute("sampleRate", device.getCurrentSampleRate());
+    calibration->setAttribute("bufferSize", bufferSize);
+}
+
+juce::String BufferSizeCalibrator::getDeviceKey(juce::AudioIODevice& device)
+{
+    return device.getTypeName() + "|" + device.getName() + "|" + juce::String(device.getCurrentSampleRate());
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+
+/// <summary>
+/// Finds the smallest buffer size the open audio device can run without missing deadlines. Starts with the largest
+/// buffer size of the device and steps down, running a synthetic worst case load (two resampled sources cross faded,
+/// like a loop transition) in an extra callback for stepMs per size. A step fails on xruns reported by the device,
+/// callbacks arriving late or the load using too much of the buffer time.
+/// Results are kept per device type, device and sample rate as CALIBRATION elements in the audio device settings,
+/// also when no size was stable, so a device is only calibrated once.
+/// Only used on the message thread, the device should not be playing anything meanwhile.
+/// </summary>
+class BufferSizeCalibrator : private juce::AudioIODeviceCallback,
+                             private juce::Timer
+{
+public:
+    BufferSizeCalibrator(juce::AudioDeviceManager& deviceManager);
+    ~BufferSizeCalibrator() override;
+
+    static constexpr int stepMs = 3000;
+
+    /// <summary>
+    /// starts stepping down from the largest buffer size of the current device
+    /// </summary>
+    void start();
+
+    /// <summary>
+    /// stops and restores the buffer size from before start, onFinished isn't called
+    /// </summary>
+    void cancel();
+
+    /// <summary>
+    /// stops without touching the device, for when another device was chosen meanwhile. onFinished isn't called
+    /// </summary>
+    void abandon();
+
+    bool isRunning() const { return isTimerRunning(); }
+
+    /// <summary>
+    /// called when done, with the device already set to the smallest stable buffer size (0 if none was stable)
+    /// </summary>
+    std::function<void(int bufferSize)> onFinished;
+
+    static constexpr int notCalibrated = -1;
+
+    /// <returns>the calibrated buffer size for the device at its current sample rate, 0 if no size was stable,
+    /// notCalibrated if it wasn't calibrated yet</returns>
+    static int findBufferSize(const juce::XmlElement& calibrations, juce::AudioIODevice& device);
+    static void storeBufferSize(juce::XmlElement& calibrations, juce::AudioIODevice& device, int bufferSize);
+
+    /// <summary>
+    /// what a calibration is kept for: device type, device and sample rate
+    /// </summary>
+    static juce::String getDeviceKey(juce::AudioIODevice& device);
+
+private:
+    void audioDeviceIOCallbackWithContext(const float* const* inputChannelData, int numInputChannels,
+                                          float* const* outputChannelData, int numOutputChannels, int numSamples,
+                                          const juce::AudioIODeviceCallbackContext& context) override;
+    void audioDeviceAboutToStart(juce::AudioIODevice* device) override;
+    void audioDeviceStopped() override {}
+
+    void timerCallback() override;
+    void startStep();
+    void finish(int bufferSize);
+    void renderLoad(int numSamples);
+
+    juce::AudioDeviceManager& deviceManager;
+    juce::AudioDeviceManager::AudioDeviceSetup originalSetup;
+    juce::Array<int> sizesToTry;
+    int currentSize = 0;
+    int smallestStable = 0;
+    int xrunsAtStepStart = 0;
+
+    //written on the audio thread
+    std::atomic<int> numCallbacks{ 0 };
+    std::atomic<int> misses{ 0 };
+    double lastCallbackMs = 0;
+    double blockMs = 0;
+
+    //the load: two noise sources, each resampled like a file at another sample rate, and mixed with gain ramps
+    juce::AudioBuffer<float> sources;
+    juce::AudioBuffer<float> resampled;
+    juce::AudioBuffer<float> mix;
+    juce::LagrangeInterpolator interpolators[4];
+    int sourcePositions[2] = { 0, 0 };
+    float fade = 0;
+};
@@ -0,0 +1,306 @@
+#include "DirectoryWatcher.h"
+
+#if JUCE_LINUX
+ #include <sys/inotify.h>
+ #include <sys/vfs.h>
+ #include <poll.h>
+ #include <unistd.h>
+#endif
+
+DirectoryWatcher::DirectoryWatcher() : juce::Thread("directoryWatcher")
+{
+#if JUCE_LINUX
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd >= 0)
+        startThread(juce::Thread::Priority::low);
+#endif
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+    cancelPendingUpdate();
+    stopThread(10000);
+
+#if JUCE_LINUX
+    if (inotifyFd >= 0)
+        ::close(inotifyFd);
+#endif
+}
+
+void DirectoryWatcher::setLibraryRoots(const std::vector<juce::File>& roots)
+{
+    const juce::ScopedLock sl(lock);
+    libraryRoots = roots;
+    librariesChanged = true;
+}
+
+void DirectoryWatcher::setBrowsedDirectory(const juce::File& directory)
+{
+    const juce::ScopedLock sl(lock);
+    if (browsedDirectory != directory) {
+        browsedDirectory = directory;
+        browsedDirectoryChanged = true;
+    }
+}
+
+bool DirectoryWatcher::canWatch([[maybe_unused]] const juce::File& directory) const
+{
+#if JUCE_LINUX
+    if (inotifyFd < 0 || !directory.isDirectory())
+        return false;
+
+    struct statfs fs;
+    if (statfs(directory.getFullPathName().toRawUTF8(), &fs) != 0)
+        return false;
+
+    switch ((unsigned long)fs.f_type) {
+    case 0x6969:        //NFS
+    case 0x517B:        //SMB
+    case 0xFF534D42:    //CIFS
+    case 0xFE534D42:    //SMB2
+        return false;
+    default:
+        return true;
+    }
+#else
+    return false;
+#endif
+}
+
+void DirectoryWatcher::addEvent(Event&& event)
+{
+    {
+        const juce::ScopedLock sl(lock);
+        pendingEvents.push_back(std::move(event));
+    }
+    triggerAsyncUpdate();
+}
+
+void DirectoryWatcher::handleAsyncUpdate()
+{
+    std::vector<Event> events;
+    {
+        const juce::ScopedLock sl(lock);
+        events.swap(pendingEvents);
+    }
+
+    if (!events.empty() && onEvents)
+        onEvents(events);
+}
+
+void DirectoryWatcher::run()
+{
+#if JUCE_LINUX
+    while (!threadShouldExit()) {
+        bool updateLibraries, updateBrowsed;
+        {
+            const juce::ScopedLock sl(lock);
+            updateLibraries = librariesChanged;
+            updateBrowsed = browsedDirectoryChanged || librariesChanged;
+            librariesChanged = browsedDirectoryChanged = false;
+        }
+
+        if (updateLibraries)
+            updateLibraryWatches();
+        if (updateBrowsed)
+            updateBrowsedWatch();
+
+        pollfd pfd{ inotifyFd, POLLIN, 0 };
+        if (poll(&pfd, 1, 200) > 0 && (pfd.revents & POLLIN) != 0)
+            readEvents();
+    }
+
+    removeAllWatches();
+#endif
+}
+
+#if JUCE_LINUX
+void DirectoryWatcher::updateLibraryWatches()
+{
+    std::vector<juce::File> roots;
+    {
+        const juce::ScopedLock sl(lock);
+        roots = libraryRoots;
+    }
+
+    auto contains = [](const std::vector<juce::File>& files, const juce::File& file) {
+        return std::find(files.begin(), files.end(), file) != files.end();
+    };
+
+    //a library inside another one shares its watches, those are added again after the other one is gone
+    bool rewatchNested = false;
+    for (const juce::File& root : watchedRoots) {
+        if (contains(roots, root))
+            continue;
+
+        removeWatchesOf(root);
+        for (const juce::File& kept : roots) {
+            if (kept.isAChildOf(root) || root.isAChildOf(kept))
+                rewatchNested = true;
+        }
+    }
+
+    for (const juce::File& root : roots) {
+        if ((rewatchNested || !contains(watchedRoots, root)) && canWatch(root))
+            addWatch(root, true, root);
+    }
+    watchedRoots = roots;
+}
+
+void DirectoryWatcher::updateBrowsedWatch()
+{
+    juce::File browsed;
+    {
+        const juce::ScopedLock sl(lock);
+        browsed = browsedDirectory;
+    }
+
+    //a library watch may have taken over the same directory meanwhile, that one stays
+    auto old = watches.find(browsedWatch);
+    if (old != watches.end() && old->second.libRoot == juce::File()) {
+        inotify_rm_watch(inotifyFd, browsedWatch);
+        watches.erase(old);
+    }
+    browsedWatch = -1;
+
+    //the browsed directory is usually inside a library and watched already
+    for (auto& watch : watches) {
+        if (watch.second.directory == browsed)
+            return;
+    }
+
+    if (canWatch(browsed))
+        addWatch(browsed, false, {});
+}
+
+void DirectoryWatcher::addWatch(const juce::File& directory, bool recursive, const juce::File& libRoot)
+{
+    const juce::uint32 mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_ONLYDIR;
+
+    int wd = inotify_add_watch(inotifyFd, directory.getFullPathName().toRawUTF8(), mask);
+    if (wd < 0) {
+        //usually fs.inotify.max_user_watches reached
+        addEvent({ Event::Type::overflow, directory });
+        return;
+    }
+
+    watches[wd] = { directory, recursive, libRoot };
+    if (libRoot == juce::File())
+        browsedWatch = wd;
+
+    if (recursive) {
+        for (const juce::DirectoryEntry& entry : juce::RangedDirectoryIterator(directory, false, "*", juce::File::findDirectories)) {
+            if (threadShouldExit())
+                return;
+            addWatch(entry.getFile(), true, libRoot);
+        }
+    }
+}
+
+void DirectoryWatcher::removeWatchesOf(const juce::File& libRoot)
+{
+    for (auto it = watches.begin(); it != watches.end();) {
+        if (it->second.libRoot == libRoot) {
+            inotify_rm_watch(inotifyFd, it->first);
+            it = watches.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+void DirectoryWatcher::removeAllWatches()
+{
+    for (auto& watch : watches)
+        inotify_rm_watch(inotifyFd, watch.first);
+    watches.clear();
+    watchedRoots.clear();
+    browsedWatch = -1;
+}
+
+void DirectoryWatcher::readEvents()
+{
+    alignas(inotify_event) char buffer[16384];
+    std::unordered_map<juce::uint32, Event> movedFrom;
+
+    for (;;) {
+        ssize_t len = ::read(inotifyFd, buffer, sizeof(buffer));
+        if (len <= 0)
+            break;
+
+        for (char* ptr = buffer; ptr < buffer + len;) {
+            const inotify_event* ev = reinterpret_cast<const inotify_event*>(ptr);
+            ptr += sizeof(inotify_event) + ev->len;
+
+            if ((ev->mask & IN_Q_OVERFLOW) != 0) {
+                addEvent({ Event::Type::overflow });
+                continue;
+            }
+
+            auto watch = watches.find(ev->wd);
+            if (watch == watches.end())
+                continue;
+
+            if ((ev->mask & IN_IGNORED) != 0) {
+                watches.erase(watch);
+                continue;
+            }
+
+            if (ev->len == 0)
+                continue;
+
+            const bool isDir = (ev->mask & IN_ISDIR) != 0;
+            const bool recursive = watch->second.recursive;
+            juce::File file = watch->second.directory.getChildFile(juce::String::fromUTF8(ev->name));
+
+            if ((ev->mask & IN_MOVED_FROM) != 0) {
+                //the matching IN_MOVED_TO has the same cookie
+                movedFrom[ev->cookie] = { Event::Type::removed, file, {}, isDir };
+            }
+            else if ((ev->mask & IN_MOVED_TO) != 0) {
+                auto from = movedFrom.find(ev->cookie);
+                if (from != movedFrom.end()) {
+                    if (isDir)
+                        directoryRenamed(from->second.file, file);
+                    addEvent({ Event::Type::renamed, file, from->second.file, isDir });
+                    movedFrom.erase(from);
+                }
+                else {
+                    //moved in from outside of all watched directories
+                    if (isDir && recursive)
+                        addWatch(file, true, watch->second.libRoot);
+                    addEvent({ Event::Type::created, file, {}, isDir });
+                }
+            }
+            else if ((ev->mask & IN_CREATE) != 0) {
+                if (isDir && recursive)
+                    addWatch(file, true, watch->second.libRoot);
+                addEvent({ Event::Type::created, file, {}, isDir });
+            }
+            else if ((ev->mask & IN_DELETE) != 0) {
+                addEvent({ Event::Type::removed, file, {}, isDir });
+            }
+            else if ((ev->mask & IN_CLOSE_WRITE) != 0) {
+                addEvent({ Event::Type::modified, file, {}, isDir });
+            }
+        }
+    }
+
+    //moved out of all watched directories
+    for (auto& from : movedFrom)
+        addEvent(std::move(from.second));
+}
+
+void DirectoryWatcher::directoryRenamed(const juce::File& oldDir, const juce::File& newDir)
+{
+    //watches stay on the moved directories, only the remembered paths change
+    for (auto& watch : watches) {
+        juce::File& dir = watch.second.directory;
+        if (dir == oldDir)
+            dir = newDir;
+        else if (dir.isAChildOf(oldDir))
+            dir = newDir.getChildFile(dir.getRelativePathFrom(oldDir));
+    }
+}
+#endif
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <unordered_map>
+
+
+/// <summary>
+/// Tells about files being created, removed, renamed or rewritten inside the music libraries (recursive)
+/// and inside the directory shown in the file browser. Uses inotify on Linux, other systems have
+/// no watcher and canWatch() always returns false.
+/// </summary>
+class DirectoryWatcher : private juce::Thread,
+                         private juce::AsyncUpdater
+{
+public:
+    struct Event
+    {
+        enum class Type
+        {
+            created,
+            removed,
+            renamed,
+            modified,
+            overflow    //events got lost, everything has to be rescanned
+        };
+
+        Type type;
+        juce::File file;
+        juce::File oldFile; //only for renamed
+        bool isDirectory = false;
+    };
+
+    DirectoryWatcher();
+    ~DirectoryWatcher() override;
+
+    void setLibraryRoots(const std::vector<juce::File>& roots);
+    void setBrowsedDirectory(const juce::File& directory);
+
+    /// <summary>
+    /// returns true if changes in this directory will be reported. Network file systems are not watched,
+    /// since changes from other machines would not be seen.
+    /// </summary>
+    bool canWatch(const juce::File& directory) const;
+
+    //called on the message thread with all events since the last call
+    std::function<void(const std::vector<Event>&)> onEvents;
+
+private:
+    void run() override;
+    void handleAsyncUpdate() override;
+    void addEvent(Event&& event);
+
+    juce::CriticalSection lock;
+    std::vector<juce::File> libraryRoots;
+    juce::File browsedDirectory;
+    bool librariesChanged = false;
+    bool browsedDirectoryChanged = false;
+    std::vector<Event> pendingEvents;
+
+#if JUCE_LINUX
+    //library watches stay as long as the library, browsing only adds or removes the one watch of the browsed directory
+    void updateLibraryWatches();
+    void updateBrowsedWatch();
+    void addWatch(const juce::File& directory, bool recursive, const juce::File& libRoot);
+    void removeWatchesOf(const juce::File& libRoot);
+    void removeAllWatches();
+    void readEvents();
+    void directoryRenamed(const juce::File& oldDir, const juce::File& newDir);
+
+    struct Watch
+    {
+        juce::File directory;
+        bool recursive;
+        juce::File libRoot;     //the library this watch belongs to, empty for the browsed directory
+    };
+
+    int inotifyFd = -1;
+    std::unordered_map<int, Watch> watches;
+    std::vector<juce::File> watchedRoots;
+    int browsedWatch = -1;
+#endif
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DirectoryWatcher)
+};
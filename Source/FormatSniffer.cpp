@@ -0,0 +1,200 @@
+#include "FormatSniffer.h"
+#include "AsyncFileReader.h"
+
+FormatSniffer::FormatSniffer(juce::AudioFormatManager& formatManager_) : formatManager(formatManager_)
+{
+}
+
+FormatSniffer::Container FormatSniffer::sniff(const juce::uint8* header, size_t numBytes)
+{
+    auto hasTag = [header, numBytes](size_t offset, const char* tag) {
+        return numBytes >= offset + 4 && memcmp(header + offset, tag, 4) == 0;
+    };
+
+    if ((hasTag(0, "RIFF") || hasTag(0, "RF64")) && hasTag(8, "WAVE"))
+        return Container::wav;
+
+    if (hasTag(0, "FORM") && (hasTag(8, "AIFF") || hasTag(8, "AIFC")))
+        return Container::aiff;
+
+    if (hasTag(0, "fLaC"))
+        return Container::flac;
+
+    if (hasTag(0, "OggS"))
+        return Container::ogg;
+
+    //an ID3v2 tag is almost always followed by mpeg frames
+    if (numBytes >= 3 && memcmp(header, "ID3", 3) == 0)
+        return Container::mp3;
+
+    //frame sync, layer bits 00 would be AAC
+    if (numBytes >= 2 && header[0] == 0xFF && (header[1] & 0xE0) == 0xE0 && (header[1] & 0x06) != 0)
+        return Container::mp3;
+
+    static const juce::uint8 asfGuid[] = { 0x30, 0x26, 0xB2, 0x75, 0x8E, 0x66, 0xCF, 0x11 };
+    if (numBytes >= sizeof(asfGuid) && memcmp(header, asfGuid, sizeof(asfGuid)) == 0)
+        return Container::asf;
+
+    return Container::unknown;
+}
+
+juce::AudioFormatReader* FormatSniffer::createReaderFor(const juce::File& file)
+{
+    //reads blocks ahead in the background, decoding rarely waits for the disk
+    std::unique_ptr<juce::InputStream> in = AsyncFileReader::getShared().createInputStream(file);
+    if (in == nullptr)
+        return nullptr;
+
+    const juce::String path = file.getFullPathName();
+    juce::AudioFormat* format = nullptr;
+    {
+        const juce::ScopedLock sl(lock);
+        format = findCached(path);
+    }
+
+    if (format == nullptr) {
+        juce::uint8 header[16];
+        int numRead = in->read(header, sizeof(header));
+        format = getFormat(sniff(header, (size_t)juce::jmax(0, numRead)));
+        in->setPosition(0);
+    }
+
+    if (format != nullptr) {
+        //the stream gets deleted by the format if opening fails
+        if (juce::AudioFormatReader* reader = format->createReaderFor(in.release(), true)) {
+            const juce::ScopedLock sl(lock);
+            remember(path, format);
+            return reader;
+        }
+    }
+
+    {
+        const juce::ScopedLock sl(lock);
+        forget(path);
+    }
+
+    return formatManager.createReaderFor(file);
+}
+
+juce::AudioFormat* FormatSniffer::findFormatFor(const juce::File& file)
+{
+    {
+        const juce::ScopedLock sl(lock);
+        if (juce::AudioFormat* format = findCached(file.getFullPathName()))
+            return format;
+    }
+
+    juce::FileInputStream in(file);
+    if (in.failedToOpen())
+        return nullptr;
+
+    juce::uint8 header[16];
+    int numRead = in.read(header, sizeof(header));
+    juce::AudioFormat* format = getFormat(sniff(header, (size_t)juce::jmax(0, numRead)));
+
+    if (format != nullptr) {
+        const juce::ScopedLock sl(lock);
+        remember(file.getFullPathName(), format);
+    }
+
+    return format;
+}
+
+void FormatSniffer::clearCache()
+{
+    const juce::ScopedLock sl(lock);
+    formatByPath.clear();
+    recent.clear();
+    cachedBytes = 0;
+}
+
+size_t FormatSniffer::getMemoryUsage() const
+{
+    const juce::ScopedLock sl(lock);
+    return cachedBytes;
+}
+
+std::vector<MemoryBudget::Entry> FormatSniffer::getEvictableEntries() const
+{
+    const juce::ScopedLock sl(lock);
+
+    //the longer ago a path was used, the less likely it's opened again soon
+    std::vector<MemoryBudget::Entry> evictable;
+    size_t index = 0;
+    for (const Cached& cached : recent) {
+        if (index % entriesPerBlock == 0)
+            evictable.push_back({ (juce::int64)index, 0, 1.0 / (double)(evictable.size() + 1) });
+        evictable.back().bytes += getEntryBytes(cached.path);
+        ++index;
+    }
+    return evictable;
+}
+
+void FormatSniffer::evict(juce::int64 id)
+{
+    const juce::ScopedLock sl(lock);
+
+    //id is the number of entries before the block
+    while (recent.size() > (size_t)juce::jmax((juce::int64)0, id)) {
+        cachedBytes -= getEntryBytes(recent.back().path);
+        formatByPath.erase(recent.back().path);
+        recent.pop_back();
+    }
+}
+
+juce::AudioFormat* FormatSniffer::findCached(const juce::String& path)
+{
+    auto it = formatByPath.find(path);
+    if (it == formatByPath.end())
+        return nullptr;
+
+    recent.splice(recent.begin(), recent, it->second);
+    return it->second->format;
+}
+
+void FormatSniffer::remember(const juce::String& path, juce::AudioFormat* format)
+{
+    auto it = formatByPath.find(path);
+    if (it != formatByPath.end()) {
+        it->second->format = format;
+        recent.splice(recent.begin(), recent, it->second);
+        return;
+    }
+
+    recent.push_front({ path, format });
+    formatByPath.emplace(path, recent.begin());
+    cachedBytes += getEntryBytes(path);
+
+    while (recent.size() > maxCachedPaths) {
+        cachedBytes -= getEntryBytes(recent.back().path);
+        formatByPath.erase(recent.back().path);
+        recent.pop_back();
+    }
+
+    memoryUsageGrew();
+}
+
+void FormatSniffer::forget(const juce::String& path)
+{
+    auto it = formatByPath.find(path);
+    if (it == formatByPath.end())
+        return;
+
+    cachedBytes -= getEntryBytes(path);
+    recent.erase(it->second);
+    formatByPath.erase(it);
+}
+
+juce::AudioFormat* FormatSniffer::getFormat(Container container) const
+{
+    //the registered format for the usual extension, so the same one AudioFormatManager would pick first
+    switch (container) {
+    case Container::wav:    return formatManager.findFormatForFileExtension(".wav");
+    case Container::aiff:   return formatManager.findFormatForFileExtension(".aiff");
+    case Container::flac:   return formatManager.findFormatForFileExtension(".flac");
+    case Container::ogg:    return formatManager.findFormatForFileExtension(".ogg");
+    case Container::mp3:    return formatManager.findFormatForFileExtension(".mp3");
+    case Container::asf:    return formatManager.findFormatForFileExtension(".wma");
+    default:                return nullptr;
+    }
+}
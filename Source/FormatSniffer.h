@@ -0,0 +1,85 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "AudioFile.h"
+#include "MemoryBudget.h"
+#include <list>
+#include <unordered_map>
+
+
+/// <summary>
+/// Finds the AudioFormat of a file by its first bytes instead of trying the registered formats one after another,
+/// so creating a reader needs one small read and one header parse. The format found is remembered per path,
+/// for the most recently used maxCachedPaths files, the memory budget can drop the least recently used before that.
+/// Files which can't be recognised (or are misnamed in a way the sniffing doesn't handle) fall back to the AudioFormatManager.
+/// All functions are thread safe.
+/// </summary>
+class FormatSniffer : public MemoryBudget::Cache
+{
+public:
+    FormatSniffer(juce::AudioFormatManager& formatManager);
+
+    enum class Container
+    {
+        unknown,
+        wav,
+        aiff,
+        flac,
+        ogg,
+        mp3,
+        asf
+    };
+
+    /// <summary>
+    /// recognises the container from the first bytes of a file, 12 bytes are enough
+    /// </summary>
+    static Container sniff(const juce::uint8* header, size_t numBytes);
+
+    juce::AudioFormatReader* createReaderFor(const juce::File& file);
+    juce::AudioFormat* findFormatFor(const juce::File& file);
+
+    /// <summary>
+    /// the registered format reading this container, nullptr if there is none
+    /// </summary>
+    juce::AudioFormat* getFormat(Container container) const;
+
+    juce::AudioFormatManager& getFormatManager() { return formatManager; }
+    void clearCache();
+
+    //beyond that the least recently used are forgotten, sniffing them again is one small read
+    static constexpr size_t maxCachedPaths = 50000;
+
+    size_t getMemoryUsage() const override;
+
+    /// <summary>
+    /// the remembered paths in blocks, least recently used last. Evicting a block drops the older ones too,
+    /// they are worth less and would be evicted first anyway
+    /// </summary>
+    std::vector<MemoryBudget::Entry> getEvictableEntries() const override;
+    void evict(juce::int64 id) override;
+
+private:
+    struct Cached
+    {
+        juce::String path;
+        juce::AudioFormat* format;
+    };
+
+    //these need the lock held. find moves the path to the front
+    juce::AudioFormat* findCached(const juce::String& path);
+    void remember(const juce::String& path, juce::AudioFormat* format);
+    void forget(const juce::String& path);
+
+    //list node and map node, plus the path
+    static size_t getEntryBytes(const juce::String& path) { return sizeof(Cached) + sizeof(juce::String) + 6 * sizeof(void*) + path.getNumBytesAsUTF8(); }
+    static constexpr size_t entriesPerBlock = 1024;
+
+    juce::AudioFormatManager& formatManager;
+
+    juce::CriticalSection lock;
+    std::list<Cached> recent;   //most recently used first
+    std::unordered_map<juce::String, std::list<Cached>::iterator, StringHash> formatByPath;
+    size_t cachedBytes = 0;     //of all entries
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(FormatSniffer)
+};
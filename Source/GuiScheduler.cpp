@@ -0,0 +1,59 @@
+#include "GuiScheduler.h"
+
+GuiScheduler::GuiScheduler()
+{
+    juce::Desktop::getInstance().addGlobalMouseListener(this);
+    activity();
+}
+
+GuiScheduler::~GuiScheduler()
+{
+    juce::Desktop::getInstance().removeGlobalMouseListener(this);
+}
+
+void GuiScheduler::setPlaying(bool isPlaying)
+{
+    playing = isPlaying;
+
+    //the last position after stopping still has to be shown
+    activity();
+}
+
+void GuiScheduler::setMinimised(bool isMinimised)
+{
+    minimised = isMinimised;
+    update();
+}
+
+void GuiScheduler::activity()
+{
+    lastActivity = juce::Time::getMillisecondCounter();
+    if (!idleTimer.isTimerRunning())
+        idleTimer.startTimer(idleDelay);
+    update();
+}
+
+void GuiScheduler::idleCheck()
+{
+    //mouse movements only set lastActivity, so the timer is restarted for the rest of the delay instead of on every event
+    const juce::uint32 sinceActivity = juce::Time::getMillisecondCounter() - lastActivity;
+    if (sinceActivity < (juce::uint32)idleDelay) {
+        idleTimer.startTimer(idleDelay - (int)sinceActivity);
+        return;
+    }
+
+    idleTimer.stopTimer();
+    update();
+}
+
+void GuiScheduler::update()
+{
+    const bool recentActivity = idleTimer.isTimerRunning();
+    const bool shouldBeActive = !minimised && (playing || recentActivity);
+    if (shouldBeActive == active)
+        return;
+
+    active = shouldBeActive;
+    if (onActiveChanged)
+        onActiveChanged(active);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+
+/// <summary>
+/// Decides when the periodic refreshing of the GUI (playhead frames, file browser checks) is worth running.
+/// It is active while playing or for idleDelay after the last mouse activity anywhere in the app or the last transport change,
+/// and never while the window is minimised. Going idle costs no timer at all, mouse activity wakes it up again.
+/// Only used on the message thread.
+/// </summary>
+class GuiScheduler : private juce::MouseListener
+{
+public:
+    GuiScheduler();
+    ~GuiScheduler() override;
+
+    static constexpr int idleDelay = 5000; //ms
+
+    /// <summary>
+    /// called when periodic refreshing should start (true) or stop (false)
+    /// </summary>
+    std::function<void(bool)> onActiveChanged;
+
+    bool isActive() const { return active; }
+
+    void setPlaying(bool isPlaying);
+    void setMinimised(bool isMinimised);
+
+    /// <summary>
+    /// something changed that the GUI has to show, keeps it active for idleDelay
+    /// </summary>
+    void activity();
+
+private:
+    void mouseMove(const juce::MouseEvent&) override { activity(); }
+    void mouseDown(const juce::MouseEvent&) override { activity(); }
+    void mouseDrag(const juce::MouseEvent&) override { activity(); }
+    void mouseWheelMove(const juce::MouseEvent&, const juce::MouseWheelDetails&) override { activity(); }
+
+    void update();
+    void idleCheck();
+
+    bool active = true;
+    bool playing = false;
+    bool minimised = false;
+    juce::uint32 lastActivity = 0;
+    juce::TimedCallback idleTimer{ [this] { idleCheck(); } };
+};
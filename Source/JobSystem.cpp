@@ -0,0 +1,329 @@
+#include "JobSystem.h"
+
+struct JobSystem::Job
+{
+    Priority priority = Priority::scan;
+    std::function<void()> work;
+    std::shared_ptr<CancellationToken::State> token;
+
+    //the dependencies not finished yet, plus one while run() is still adding them
+    std::atomic<int> waitingFor{ 1 };
+    bool counted = false;   //in token->numQueued
+
+    juce::CriticalSection lock;
+    bool finished = false;
+    std::vector<std::shared_ptr<Job>> dependents;
+    juce::WaitableEvent finishedEvent{ true };
+
+    bool isBulk() const { return priority >= Priority::analysis; }
+};
+
+//==============================================================================
+JobSystem::CancellationToken::CancellationToken() : state(std::make_shared<State>())
+{
+}
+
+void JobSystem::CancellationToken::cancel() const
+{
+    state->cancelled = true;
+}
+
+bool JobSystem::CancellationToken::isCancelled() const
+{
+    return state->cancelled;
+}
+
+bool JobSystem::CancellationToken::isIdle() const
+{
+    return state->numQueued == 0;
+}
+
+bool JobSystem::Handle::isFinished() const
+{
+    if (job == nullptr)
+        return true;
+
+    const juce::ScopedLock sl(job->lock);
+    return job->finished;
+}
+
+//==============================================================================
+class JobSystem::Worker : public juce::Thread
+{
+public:
+    Worker(JobSystem& owner_, int index_)
+        : juce::Thread("jobs " + juce::String(index_)), owner(owner_), index(index_)
+    {
+    }
+
+    void run() override
+    {
+        current = this;
+
+        while (!threadShouldExit()) {
+            const juce::uint32 seen = owner.changes;
+
+            if (std::shared_ptr<Job> job = owner.takeJob(index)) {
+                owner.execute(job);
+                continue;
+            }
+
+            //nothing this worker may take, sleep until something is queued or a bulk job frees its place.
+            //every one of those bumps changes, so nothing is missed without polling
+            std::unique_lock<std::mutex> sl(owner.sleepLock);
+            owner.sleeping.wait(sl, [this, seen] { return owner.changes != seen || threadShouldExit(); });
+        }
+
+        current = nullptr;
+    }
+
+    static thread_local Worker* current;
+
+    JobSystem& owner;
+    const int index;
+};
+
+thread_local JobSystem::Worker* JobSystem::Worker::current = nullptr;
+
+//==============================================================================
+JobSystem::JobSystem(int numWorkers)
+{
+    numWorkers = juce::jmax(0, numWorkers);
+
+    //one worker is kept for the urgent classes, only a single worker (benchmarks) runs everything
+    maxBulkJobs = juce::jmax(1, numWorkers - 1);
+
+    for (int i = 0; i < numWorkers; ++i) {
+        local.push_back(std::make_unique<Queue>());
+        workers.push_back(std::make_unique<Worker>(*this, i));
+    }
+
+    for (auto& worker : workers)
+        worker->startThread(juce::Thread::Priority::normal);
+}
+
+JobSystem::~JobSystem()
+{
+    for (auto& worker : workers)
+        worker->signalThreadShouldExit();
+    wakeWorkers();
+
+    for (auto& worker : workers)
+        worker->stopThread(10000);
+}
+
+JobSystem& JobSystem::getShared()
+{
+    //the urgent classes keep a worker of their own, even if the os has to share the core between them
+    static JobSystem jobs(juce::jmax(2, juce::SystemStats::getNumCpus()));
+    return jobs;
+}
+
+JobSystem::Handle JobSystem::run(Priority priority, std::function<void()> work, const CancellationToken& token, const std::vector<Handle>& after)
+{
+    auto job = std::make_shared<Job>();
+    job->priority = priority;
+    job->work = std::move(work);
+    job->token = token.state;
+
+    for (const Handle& dependency : after) {
+        if (dependency.job == nullptr)
+            continue;
+
+        const juce::ScopedLock sl(dependency.job->lock);
+        if (!dependency.job->finished) {
+            dependency.job->dependents.push_back(job);
+            ++job->waitingFor;
+        }
+    }
+
+    if (--job->waitingFor == 0)
+        enqueue(job);
+
+    return Handle(job);
+}
+
+void JobSystem::enqueue(const std::shared_ptr<Job>& job)
+{
+    //dropped right away, nothing has to wait for it
+    if (job->token->cancelled) {
+        finish(job);
+        return;
+    }
+
+    job->counted = true;
+    ++job->token->numQueued;
+
+    const int workerIndex = getCurrentWorkerIndex();
+    Queue& queue = workerIndex >= 0 ? *local[(size_t)workerIndex] : submitted;
+    {
+        const juce::ScopedLock sl(queue.lock);
+        queue.jobs[(int)job->priority].push_back(job);
+    }
+
+    wakeWorkers();
+}
+
+void JobSystem::wakeWorkers()
+{
+    {
+        std::lock_guard<std::mutex> sl(sleepLock);
+        ++changes;
+    }
+    sleeping.notify_all();
+}
+
+std::shared_ptr<JobSystem::Job> JobSystem::takeFrom(Queue& queue, int priority, bool newest)
+{
+    const juce::ScopedLock sl(queue.lock);
+    std::deque<std::shared_ptr<Job>>& jobs = queue.jobs[priority];
+    if (jobs.empty())
+        return nullptr;
+
+    std::shared_ptr<Job> job;
+    if (newest) {
+        job = std::move(jobs.back());
+        jobs.pop_back();
+    }
+    else {
+        job = std::move(jobs.front());
+        jobs.pop_front();
+    }
+    return job;
+}
+
+std::shared_ptr<JobSystem::Job> JobSystem::takeJob(int workerIndex)
+{
+    for (int priority = 0; priority < numPriorities; ++priority) {
+        const bool bulk = priority >= (int)Priority::analysis;
+
+        //a bulk job only starts if a worker is left for the urgent classes
+        if (bulk) {
+            int running = runningBulkJobs;
+            do {
+                if (running >= maxBulkJobs)
+                    return nullptr;
+            } while (!runningBulkJobs.compare_exchange_weak(running, running + 1));
+        }
+
+        //own jobs newest first (they are likely still in the cache), everything else oldest first
+        std::shared_ptr<Job> job;
+        if (workerIndex >= 0)
+            job = takeFrom(*local[(size_t)workerIndex], priority, true);
+        if (job == nullptr)
+            job = takeFrom(submitted, priority, false);
+        for (size_t i = 1; job == nullptr && i <= local.size(); ++i) {
+            const size_t victim = (size_t)(workerIndex + (int)i) % local.size();
+            if ((int)victim != workerIndex)
+                job = takeFrom(*local[victim], priority, false);
+        }
+
+        if (job != nullptr)
+            return job;
+
+        if (bulk)
+            --runningBulkJobs;
+    }
+
+    return nullptr;
+}
+
+void JobSystem::execute(const std::shared_ptr<Job>& job)
+{
+    if (!job->token->cancelled)
+        job->work();
+
+    finish(job);
+
+    if (job->isBulk()) {
+        --runningBulkJobs;
+        wakeWorkers();
+    }
+}
+
+void JobSystem::finish(const std::shared_ptr<Job>& job)
+{
+    //whatever the work refers to is released with it
+    job->work = nullptr;
+
+    std::vector<std::shared_ptr<Job>> dependents;
+    {
+        const juce::ScopedLock sl(job->lock);
+        job->finished = true;
+        dependents.swap(job->dependents);
+    }
+    job->finishedEvent.signal();
+
+    if (job->counted) {
+        --job->token->numQueued;
+        job->token->jobFinished.signal();
+    }
+
+    for (const std::shared_ptr<Job>& dependent : dependents) {
+        if (--dependent->waitingFor == 0)
+            enqueue(dependent);
+    }
+}
+
+void JobSystem::wait(const Handle& handle)
+{
+    if (handle.job == nullptr)
+        return;
+
+    const int workerIndex = getCurrentWorkerIndex();
+    if (workerIndex < 0) {
+        handle.job->finishedEvent.wait(-1);
+        return;
+    }
+
+    //the job might be queued behind this one, so run jobs instead of blocking a worker
+    while (!handle.isFinished()) {
+        if (std::shared_ptr<Job> job = takeJob(workerIndex))
+            execute(job);
+        else
+            handle.job->finishedEvent.wait(1);
+    }
+}
+
+void JobSystem::cancelAndWait(const CancellationToken& token)
+{
+    cancel(token);
+
+    while (token.state->numQueued > 0)
+        token.state->jobFinished.wait(10);
+}
+
+void JobSystem::cancel(const CancellationToken& token)
+{
+    token.cancel();
+
+    //queued jobs of the token would otherwise wait for a free worker just to be dropped
+    std::vector<std::shared_ptr<Job>> dropped;
+    auto drop = [&dropped, &token](Queue& queue) {
+        const juce::ScopedLock sl(queue.lock);
+        for (auto& jobs : queue.jobs) {
+            for (auto it = jobs.begin(); it != jobs.end();) {
+                if ((*it)->token == token.state) {
+                    dropped.push_back(std::move(*it));
+                    it = jobs.erase(it);
+                }
+                else {
+                    ++it;
+                }
+            }
+        }
+    };
+
+    drop(submitted);
+    for (auto& queue : local)
+        drop(*queue);
+
+    for (const std::shared_ptr<Job>& job : dropped)
+        finish(job);
+}
+
+int JobSystem::getCurrentWorkerIndex() const
+{
+    const Worker* worker = Worker::current;
+    return worker != nullptr && &worker->owner == this ? worker->index : -1;
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+
+/// <summary>
+/// One pool of worker threads, one per core but at least two, for all background work of the app, so new features don't add threads of their own.
+/// Jobs have a priority class and workers always take the most urgent job there is. Jobs of the bulk classes (analysis, scan)
+/// never occupy all workers, one stays free for opening and prefetching files, so what the user waits for never queues behind them.
+/// Jobs started from a worker go to that worker's own queue and are stolen by idle workers, so a job splitting itself
+/// into parts keeps them close. Jobs can wait for other jobs to finish before they start, and can be cancelled with a token.
+/// All functions are thread safe.
+/// </summary>
+class JobSystem
+{
+    struct Job;
+
+public:
+    //most urgent first
+    enum class Priority
+    {
+        interactive,    //what the user is waiting for right now, opening a file
+        prefetch,       //what the user will likely need next, saving settings
+        analysis,       //waveforms, fingerprints
+        scan            //walking libraries, reading headers, saving the metadata cache
+    };
+
+    static constexpr int numPriorities = 4;
+
+    /// <summary>
+    /// cancels all jobs started with it. Jobs that didn't start yet are dropped, running jobs should check isCancelled().
+    /// Copies share the same state.
+    /// </summary>
+    class CancellationToken
+    {
+    public:
+        CancellationToken();
+
+        void cancel() const;
+        bool isCancelled() const;
+
+        /// <summary>
+        /// true if none of its jobs is queued or running anymore
+        /// </summary>
+        bool isIdle() const;
+
+    private:
+        friend class JobSystem;
+
+        struct State
+        {
+            std::atomic<bool> cancelled{ false };
+            std::atomic<int> numQueued{ 0 };    //queued or running
+            juce::WaitableEvent jobFinished;
+        };
+
+        std::shared_ptr<State> state;
+    };
+
+    /// <summary>
+    /// refers to a started job, for waiting for it or starting others after it
+    /// </summary>
+    class Handle
+    {
+    public:
+        Handle() = default;
+
+        /// <summary>
+        /// true once the job ran or was dropped, and for empty handles
+        /// </summary>
+        bool isFinished() const;
+
+    private:
+        friend class JobSystem;
+        explicit Handle(std::shared_ptr<Job> job_) : job(std::move(job_)) {}
+
+        std::shared_ptr<Job> job;
+    };
+
+    /// <param name="numWorkers">with 0 queued jobs never run, for callers doing all the work themselves (benchmarks)</param>
+    explicit JobSystem(int numWorkers);
+    ~JobSystem();
+
+    /// <summary>
+    /// the job system used by the app, with a worker per core. A single core gets two, so a bulk job never takes the only one
+    /// </summary>
+    static JobSystem& getShared();
+
+    /// <summary>
+    /// starts work once all jobs in after are finished (or dropped)
+    /// </summary>
+    Handle run(Priority priority, std::function<void()> work, const CancellationToken& token = {}, const std::vector<Handle>& after = {});
+
+    /// <summary>
+    /// waits until the job is finished. On a worker of this system other jobs are run meanwhile, so waiting for parts can't deadlock.
+    /// </summary>
+    void wait(const Handle& handle);
+
+    /// <summary>
+    /// cancels the token, drops its queued jobs and waits for its running ones. For destructors of objects whose jobs refer to them.
+    /// Must not be called from one of the token's own jobs.
+    /// </summary>
+    void cancelAndWait(const CancellationToken& token);
+
+    /// <summary>
+    /// cancels the token and drops its queued jobs without waiting for its running ones, for the message thread.
+    /// Whatever those refer to must stay alive until the token isIdle()
+    /// </summary>
+    void cancel(const CancellationToken& token);
+
+    int getNumWorkers() const { return (int)workers.size(); }
+
+private:
+    class Worker;
+
+    struct Queue
+    {
+        juce::CriticalSection lock;
+        std::deque<std::shared_ptr<Job>> jobs[numPriorities];
+    };
+
+    void enqueue(const std::shared_ptr<Job>& job);
+    std::shared_ptr<Job> takeJob(int workerIndex);
+    std::shared_ptr<Job> takeFrom(Queue& queue, int priority, bool newest);
+    void execute(const std::shared_ptr<Job>& job);
+    void finish(const std::shared_ptr<Job>& job);
+    void wakeWorkers();
+
+    //index of the calling thread among this system's workers, -1 for other threads
+    int getCurrentWorkerIndex() const;
+
+    Queue submitted;    //from threads which aren't workers
+    std::vector<std::unique_ptr<Queue>> local;
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    int maxBulkJobs = 1;
+    std::atomic<int> runningBulkJobs{ 0 };
+
+    std::mutex sleepLock;
+    std::condition_variable sleeping;
+    std::atomic<juce::uint32> changes{ 0 };     //bumped whenever a job is queued or a bulk job finishes
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(JobSystem)
+};
@@ -0,0 +1,207 @@
+#include "LibraryScanner.h"
+#include "AsyncFileReader.h"
+
+LibraryScanner::LibraryScanner(FormatSniffer& formatSniffer_, MetadataCache& cache_, SearchIndex& searchIndex_, const juce::FileFilter& fileFilter_)
+    : formatSniffer(formatSniffer_),
+      cache(cache_),
+      searchIndex(searchIndex_),
+      fileFilter(fileFilter_)
+{
+}
+
+LibraryScanner::~LibraryScanner()
+{
+    stop();
+}
+
+void LibraryScanner::scan(const std::vector<juce::File>& libRoots)
+{
+    //a job walking a slow library might take a while to notice, the message thread doesn't wait for that.
+    //jobs of the old scan only store headers they read, they never get to removing entries
+    JobSystem::getShared().cancel(jobs);
+    cancelled.push_back(jobs);
+    cancelled.erase(std::remove_if(cancelled.begin(), cancelled.end(), [](const JobSystem::CancellationToken& token) { return token.isIdle(); }),
+                    cancelled.end());
+    jobs = JobSystem::CancellationToken();
+
+    {
+        const juce::ScopedLock sl(libsLock);
+        libsToScan = libRoots;
+    }
+
+    cache.setLibraries(libRoots);
+    searchIndex.removeLibrariesExcept(libRoots);
+
+    scanning = true;
+    const JobSystem::CancellationToken token = jobs;
+    JobSystem::getShared().run(JobSystem::Priority::scan, [this, token] { scanLibraries(token); }, token);
+}
+
+void LibraryScanner::stop()
+{
+    for (const JobSystem::CancellationToken& token : cancelled)
+        JobSystem::getShared().cancelAndWait(token);
+    cancelled.clear();
+
+    JobSystem::getShared().cancelAndWait(jobs);
+    jobs = JobSystem::CancellationToken();
+    scanning = false;
+}
+
+void LibraryScanner::scanFiles(const juce::Array<juce::File>& files)
+{
+    std::vector<juce::File> libs;
+    {
+        const juce::ScopedLock sl(libsLock);
+        libs = libsToScan;
+    }
+
+    for (const juce::File& libRoot : libs) {
+        juce::Array<juce::File> inLib;
+        for (const juce::File& file : files) {
+            if (file.isAChildOf(libRoot))
+                inLib.add(file);
+        }
+
+        if (inLib.isEmpty())
+            continue;
+
+        const JobSystem::CancellationToken token = jobs;
+        JobSystem::getShared().run(JobSystem::Priority::scan, [this, libRoot, inLib, token] {
+            cache.loadLibrary(libRoot);
+
+            juce::Array<juce::File> toRead;
+            for (const juce::File& file : inLib) {
+                if (file.isDirectory()) {
+                    for (const juce::DirectoryEntry& entry : juce::RangedDirectoryIterator(file, true, "*", juce::File::findFiles)) {
+                        if (fileFilter.isFileSuitable(entry.getFile()))
+                            toRead.add(entry.getFile());
+                    }
+                }
+                else if (fileFilter.isFileSuitable(file)) {
+                    toRead.add(file);
+                }
+            }
+
+            for (const juce::File& file : toRead)
+                searchIndex.add(libRoot, file.getRelativePathFrom(libRoot));
+
+            readHeaders(libRoot, toRead, token);
+            triggerAsyncUpdate();
+        }, token);
+    }
+}
+
+void LibraryScanner::scanLibraries(const JobSystem::CancellationToken& token)
+{
+    std::vector<juce::File> libs;
+    {
+        const juce::ScopedLock sl(libsLock);
+        libs = libsToScan;
+    }
+
+    std::vector<JobSystem::Handle> scanned;
+    for (const juce::File& libRoot : libs) {
+        if (token.isCancelled())
+            return;
+
+        //read here rather than in scan(), which runs on the message thread
+        cache.loadLibrary(libRoot);
+
+        if (libRoot.isDirectory())
+            scanned.push_back(scanLibrary(libRoot, token));
+    }
+
+    JobSystem::getShared().run(JobSystem::Priority::scan, [this] {
+        scanning = false;
+        triggerAsyncUpdate();
+    }, token, scanned);
+}
+
+JobSystem::Handle LibraryScanner::scanLibrary(const juce::File& libRoot, const JobSystem::CancellationToken& token)
+{
+    auto existing = std::make_shared<std::unordered_set<juce::String, StringHash>>();
+    juce::Array<juce::File> batch;
+    std::vector<JobSystem::Handle> batches;
+
+    auto submitBatch = [&] {
+        if (batch.isEmpty())
+            return;
+
+        batches.push_back(JobSystem::getShared().run(JobSystem::Priority::scan, [this, libRoot, files = batch, token] {
+            readHeaders(libRoot, files, token);
+        }, token));
+        batch.clearQuick();
+    };
+
+    for (const juce::DirectoryEntry& entry : juce::RangedDirectoryIterator(libRoot, true, "*", juce::File::findFiles)) {
+        if (token.isCancelled())
+            break;
+
+        const juce::File& file = entry.getFile();
+        if (!fileFilter.isFileSuitable(file))
+            continue;
+
+        juce::String relPath = file.getRelativePathFrom(libRoot);
+        existing->insert(relPath);
+        searchIndex.add(libRoot, relPath);
+
+        //unchanged files are not touched again
+        if (cache.isUpToDate(libRoot, relPath, entry.getFileSize(), entry.getModificationTime().toMilliseconds()))
+            continue;
+
+        batch.add(file);
+        if (batch.size() >= filesPerJob)
+            submitBatch();
+    }
+    submitBatch();
+
+    //entries of files which are gone are removed once all headers are read, a cancelled scan never gets there
+    return JobSystem::getShared().run(JobSystem::Priority::scan, [this, libRoot, existing] {
+        cache.removeAllExcept(libRoot, *existing);
+        searchIndex.removeAllExcept(libRoot, *existing);
+        cache.save(libRoot);
+    }, token, batches);
+}
+
+void LibraryScanner::readHeaders(const juce::File& libRoot, const juce::Array<juce::File>& files, const JobSystem::CancellationToken& token)
+{
+    //all headers of the batch are requested at once, on a network drive that hides most of the round trips
+    AsyncFileReader::getShared().warmUp(files, headerBytes);
+
+    for (const juce::File& file : files) {
+        if (token.isCancelled())
+            return;
+
+        AudioFileMetadata metadata;
+        metadata.relPath = file.getRelativePathFrom(libRoot);
+        metadata.size = file.getSize();
+        metadata.modificationTime = file.getLastModificationTime().toMilliseconds();
+
+        //the reader parses the header on creation, no samples are decoded
+        std::unique_ptr<juce::AudioFormatReader> reader(formatSniffer.createReaderFor(file));
+
+        if (reader != nullptr) {
+            metadata.sampleRate = reader->sampleRate;
+            metadata.lengthInSamples = reader->lengthInSamples;
+            metadata.length = reader->sampleRate > 0 ? reader->lengthInSamples / reader->sampleRate : 0;
+            metadata.numChannels = (int)reader->numChannels;
+            metadata.formatName = reader->getFormatName();
+
+            for (auto& key : reader->metadataValues.getAllKeys()) {
+                juce::String value = reader->metadataValues[key];
+                if (value.length() <= 256)
+                    metadata.tags.set(key, value);
+            }
+        }
+
+        //unreadable files are stored too, so they are not retried until they change
+        cache.store(libRoot, std::move(metadata));
+    }
+}
+
+void LibraryScanner::handleAsyncUpdate()
+{
+    if (onScanFinished)
+        onScanFinished();
+}
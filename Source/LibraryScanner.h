@@ -0,0 +1,67 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "MetadataCache.h"
+#include "SearchIndex.h"
+#include "FormatSniffer.h"
+#include "JobSystem.h"
+
+
+/// <summary>
+/// Walks all music libraries in the background and fills the MetadataCache. Only headers are read
+/// (by creating and directly destroying a reader) and only for files which are new or changed since the last scan.
+/// Every file found goes into the SearchIndex, so searching works while the scan is still running.
+/// </summary>
+class LibraryScanner : private juce::AsyncUpdater
+{
+public:
+    LibraryScanner(FormatSniffer& formatSniffer, MetadataCache& cache, SearchIndex& searchIndex, const juce::FileFilter& fileFilter);
+    ~LibraryScanner() override;
+
+    /// <summary>
+    /// (re)starts scanning the given libraries. A scan which is still running gets cancelled without waiting for it,
+    /// it's called on the message thread.
+    /// </summary>
+    void scan(const std::vector<juce::File>& libRoots);
+
+    /// <summary>
+    /// cancels everything and waits for running jobs, for shutting down
+    /// </summary>
+    void stop();
+
+    /// <summary>
+    /// reads the headers of single new or changed files (or everything inside new directories)
+    /// without walking the whole library again
+    /// </summary>
+    void scanFiles(const juce::Array<juce::File>& files);
+
+    bool isScanning() const { return scanning; }
+
+    //called on the message thread
+    std::function<void()> onScanFinished;
+
+private:
+    void handleAsyncUpdate() override;
+
+    void scanLibraries(const JobSystem::CancellationToken& token);
+
+    //walks the library and starts jobs reading the headers, the returned job cleans up after them
+    JobSystem::Handle scanLibrary(const juce::File& libRoot, const JobSystem::CancellationToken& token);
+    void readHeaders(const juce::File& libRoot, const juce::Array<juce::File>& files, const JobSystem::CancellationToken& token);
+
+    FormatSniffer& formatSniffer;
+    MetadataCache& cache;
+    SearchIndex& searchIndex;
+    const juce::FileFilter& fileFilter;
+
+    JobSystem::CancellationToken jobs;     //replaced when a scan is stopped
+    std::vector<JobSystem::CancellationToken> cancelled;   //of earlier scans whose running jobs may not have noticed yet
+    std::atomic<bool> scanning{ false };
+    static constexpr int filesPerJob = 32;
+    static constexpr int headerBytes = 64 * 1024;
+
+    juce::CriticalSection libsLock;
+    std::vector<juce::File> libsToScan;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LibraryScanner)
+};
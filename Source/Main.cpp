@@ -8,6 +8,8 @@
 
 #include <JuceHeader.h>
 #include "MainComponent.h"
+#include "Benchmarks.h"
+#include "StartupTrace.h"
 
 //==============================================================================
 class LoopyAudioPlayerApplication  : public juce::JUCEApplication
@@ -25,6 +27,12 @@ public:
     {
         // This method is where you should put your application's initialisation code..
 
+        if (Benchmarks::runFromCommandLine(commandLine)) {
+            quit();
+            return;
+        }
+
+        StartupTrace::mark("initialise");
         mainWindow.reset (new MainWindow (getApplicationName()));
     }
 
@@ -88,6 +96,14 @@ public:
             JUCEApplication::getInstance()->systemRequestedQuit();
         }
 
+        void minimisationStateChanged (bool isNowMinimised) override
+        {
+            DocumentWindow::minimisationStateChanged (isNowMinimised);
+
+            if (auto* mainComp = dynamic_cast<MainComponent*> (getContentComponent()))
+                mainComp->windowMinimised (isNowMinimised);
+        }
+
         /* Note: Be careful if you override any DocumentWindow methods - the base
            class uses a lot of them, so by overriding you might break its functionality.
            It's best to do all your work in your content component instead, but if
@@ -1,8 +1,22 @@
 #include "MainComponent.h"
 
 //==============================================================================
-MainComponent::MainComponent()
+MainComponent::Options MainComponent::Options::forApp()
+{
+    Options options;
+    options.settingsFile = juce::File::getSpecialLocation(juce::File::SpecialLocationType::currentExecutableFile).getParentDirectory().getChildFile("settings.json");
+    options.appDataDirectory = juce::File::getSpecialLocation(juce::File::SpecialLocationType::userApplicationDataDirectory).getChildFile("LoopyAudioPlayer");
+    return options;
+}
+
+MainComponent::MainComponent() : MainComponent(Options::forApp())
+{
+}
+
+MainComponent::MainComponent(const Options& options)
        :juce::AudioAppComponent(customDeviceManager),
+        appDataDirectory(options.appDataDirectory),
+        opensAudioDevice(options.openAudioDevice),
         deviceSelector(customDeviceManager,
         0,     // minimum input channels
         0,     // maximum input channels
@@ -13,18 +27,26 @@ MainComponent::MainComponent()
         false, // treat channels as stereo pairs
         true) // hide advanced options
 {
+    StartupTrace::mark("constructor");
+
+    settingsFile = options.settingsFile;
+
+    //parsing and indexing a big settings file is the slowest part of the start, so it runs while the ui gets built
+    if (options.loadSettingsOnStart)
+        startLoadingSettings();
+
     setSize(1000, 700);
     setMinimumWidth(220);
     setMinimumHeight(120);
 
-    createButtonImages();
+    createButtonIcons();
 
-    playButton.setImage(playImage);
+    playButton.setIcon(playIcon);
     playButton.onClick = [this] { playButtonClicked(); };
     playButton.setEnabled(false);
     addAndMakeVisible(playButton);
 
-    stopButton.setImage(stopImage);
+    stopButton.setIcon(stopIcon);
     stopButton.onClick = [this] { stopButtonClicked(); };
     stopButton.setEnabled(false);
     addAndMakeVisible(stopButton);
@@ -33,7 +55,7 @@ MainComponent::MainComponent()
     loopButton.setEnabled(true);
     addAndMakeVisible(loopButton);
 
-    settingsButton.setImage(settingsImage);
+    settingsButton.setIcon(settingsIcon);
     settingsButton.onClick = [this] {settingsButtonClicked(); };
     settingsButton.setEnabled(true);
     addAndMakeVisible(settingsButton);
@@ -65,10 +87,22 @@ MainComponent::MainComponent()
     timeLine.setRange(0.0,0.01,0.01);
     timeLine.setValue(0.0);
     timeLine.onValueChange = [this](bool userChanged=false) {timeLineValueChanged(userChanged); };
-    timeLine.onTimerCallback = [this]() {updateTimeLine(); };
+    timeLine.onFrame = [this]() {updateTimeLine(); };
     timeLine.onLoopMarkerChange = [this](double left, double right) {setLoopTimeStamps(left, right); };
     timeLine.addInputBoxAsChild(this);
-    timeLine.startTimer(timeLine.guiRefreshTime);
+    timeLine.setWaveform(&waveform);
+    waveform.onProgress = [this]() {timeLine.repaintStaticLayer(); };
+
+    memoryBudget.addCache(PathTable::getShared(), "Paths", MemoryBudget::Priority::index);
+    memoryBudget.addCache(metadataCache, "Metadata", MemoryBudget::Priority::index);
+    memoryBudget.addCache(searchIndex, "Search index", MemoryBudget::Priority::index);
+    memoryBudget.addCache(allFiles, "Records", MemoryBudget::Priority::index);
+    memoryBudget.addCache(formatSniffer, "Formats", MemoryBudget::Priority::index);
+    memoryBudget.addCache(waveform, "Waveform", MemoryBudget::Priority::display);
+    memoryBudget.addCache(readerPool, "Recently played", MemoryBudget::Priority::recent);
+    memoryBudget.onUsageChecked = [this]() {updateMemoryUsage(); };
+    readAheadThread.startThread(juce::Thread::Priority::high);
+    guiScheduler.onActiveChanged = [this](bool active) {guiActiveChanged(active); };
     addAndMakeVisible(timeLine);
 
     fileBrowser.setAdditionalPathsInCombo(&musicLibs);
@@ -97,23 +131,46 @@ MainComponent::MainComponent()
 
     formatManager.registerBasicFormats();
     transportSource.addChangeListener(this);
+    customDeviceManager.addChangeListener(this);
+
+    libraryScanner = std::make_unique<LibraryScanner>(formatSniffer, metadataCache, searchIndex, fileBrowser.audioFileFilter);
+    libraryScanner->onScanFinished = [this]() {libraryScanFinished(); };
+    fingerprinter = std::make_unique<Fingerprinter>(formatSniffer);
+    prefetcher = std::make_unique<AudioPrefetcher>(formatSniffer);
+    prefetcher->onPrefetchFinished = [this](const juce::File& file, bool success) {prefetchFinished(file, success); };
+    fingerprinter->onFingerprintReady = [this](const juce::File& file, const AudioFingerprint::Value& fingerprint) {fingerprintReady(file, fingerprint); };
+    myLookAndFeel.getAudioFileDetails = [this](const juce::File& file) {return getAudioFileDetails(file); };
+    fileBrowser.onSearch = [this](const juce::String& query) {return searchLibraries(query); };
+    directoryWatcher.onEvents = [this](const std::vector<DirectoryWatcher::Event>& events) {filesChangedOnDisk(events); };
 
     changeState(TransportState::Stopped);
     playButton.setEnabled(false);
     changeLoopmode(notLooping);
 
-    musicLibs = std::vector<juce::File>();
-    allFiles = std::vector<AudioFile>();
-    audioDeviceSettings = juce::File(juce::File::getSpecialLocation(juce::File::SpecialLocationType::userApplicationDataDirectory).getChildFile("LoopyAudioPlayer").getChildFile("audioDeviceSettings.xml"));
-
-    loadAllSettingsFromFile();
+    audioDeviceSettings = appDataDirectory.getChildFile("audioDeviceSettings.xml");
+    settingsAutoSaver = std::make_unique<SettingsAutoSaver>(settingsFile);
 
-    initAudioSettings();
+    //opening the device can take a few hundred ms with some drivers, so it waits until the window is up
+    if (opensAudioDevice) {
+        juce::Component::SafePointer<MainComponent> safeThis(this);
+        juce::MessageManager::callAsync([safeThis]() {
+            if (safeThis != nullptr) {
+                safeThis->initAudioSettings();
+                safeThis->startupPhaseFinished("audioDeviceOpened");
+            }
+        });
+    }
 
+    StartupTrace::mark("constructorFinished");
 }
 
 MainComponent::~MainComponent()
 {
+    customDeviceManager.removeChangeListener(this);
+    cancelPriming();
+    libraryScanner->stop();
+    if (bufferSizeCalibrator != nullptr)
+        bufferSizeCalibrator->cancel();
     saveAllSettingsToFile();
     shutdownAudio();
 }
@@ -125,7 +182,10 @@ void MainComponent::paint (juce::Graphics& g)
     // (Our component is opaque, so we must completely fill the background with a solid colour)
     g.fillAll (getLookAndFeel().findColour (juce::ResizableWindow::backgroundColourId));
 
-
+    if (!firstFrameTraced) {
+        firstFrameTraced = true;
+        startupPhaseFinished("firstFrame");
+    }
 }
 
 void MainComponent::resized()
@@ -285,6 +345,143 @@ void MainComponent::musicLibChanged()
     fileBrowser.updateMusicLibsInCombo();
     updateMusicLibsComboBox();
     browserRootChanged(fileBrowser.getRoot());
+    settingsChanged();
+
+    libraryScanner->scan(musicLibs);
+    directoryWatcher.setLibraryRoots(musicLibs);
+}
+
+void MainComponent::libraryScanFinished()
+{
+    //files which were never opened on this device get their length from the scan
+    for (AudioFile& audioFile : allFiles) {
+        if (audioFile.length > 0 || !audioFile.hasRelPathToLib())
+            continue;
+
+        const juce::String relPath = audioFile.getRelPathToLib();
+        for (const juce::File& libRoot : musicLibs) {
+            if (auto metadata = metadataCache.find(libRoot, relPath)) {
+                audioFile.length = metadata->length;
+                allFiles.recordChanged(audioFile);
+                break;
+            }
+        }
+    }
+
+    fileBrowser.repaint();
+}
+
+juce::String MainComponent::getAudioFileDetails(const juce::File& file)
+{
+    //no validation here, this is called for every painted row
+    auto metadata = metadataCache.find(file, false);
+    if (!metadata || metadata->sampleRate <= 0)
+        return {};
+
+    int secs = juce::roundToInt(metadata->length);
+    juce::String length = juce::String(secs / 60) + ":" + juce::String(secs % 60).paddedLeft('0', 2);
+
+    return length + "  " + juce::String(metadata->sampleRate / 1000.0, 1) + "kHz";
+}
+
+std::vector<juce::mod::FileBrowserComponent::SearchResult> MainComponent::searchLibraries(const juce::String& query)
+{
+    std::vector<juce::mod::FileBrowserComponent::SearchResult> results;
+
+    for (const SearchIndex::Result& found : searchIndex.search(query, maxSearchResults)) {
+        loadShardOfLibraryContaining(found.file);
+        AudioFile* audioFile = findKnownFile(found.file, found.relPath);
+        bool hasLoopSettings = audioFile != nullptr
+            && (audioFile->hasCustomSetting(AudioFile::CustomSetting::LoopStart) || audioFile->hasCustomSetting(AudioFile::CustomSetting::LoopEnd));
+        results.push_back({ found.file, found.relPath, hasLoopSettings });
+    }
+
+    return results;
+}
+
+void MainComponent::filesChangedOnDisk(const std::vector<DirectoryWatcher::Event>& events)
+{
+    using Type = DirectoryWatcher::Event::Type;
+
+    const juce::File& root = fileBrowser.getRoot();
+    juce::Array<juce::File> changedFiles;
+    bool rescanAll = false;
+
+    for (const DirectoryWatcher::Event& event : events) {
+        switch (event.type) {
+        case Type::created:
+        case Type::modified:
+            changedFiles.addIfNotAlreadyThere(event.file);
+            readerPool.remove(event.file);
+            break;
+        case Type::removed:
+            readerPool.remove(event.file);
+            //settings of removed files are kept, the file may come back
+            metadataCache.fileRemoved(event.file);
+            searchIndex.fileRemoved(event.file);
+            break;
+        case Type::renamed:
+            readerPool.remove(event.oldFile);
+            metadataCache.fileRenamed(event.oldFile, event.file);
+            searchIndex.fileRenamed(event.oldFile, event.file, musicLibs);
+            audioFileMoved(event.oldFile, event.file);
+            break;
+        case Type::overflow:
+            rescanAll = true;
+            break;
+        }
+
+        if (event.file.getParentDirectory() == root || event.oldFile.getParentDirectory() == root)
+            fileBrowser.directoryContentsChanged(root);
+    }
+
+    if (rescanAll) {
+        //some changes are unknown, back to refreshing on focus and a full scan
+        fileBrowser.setRootIsWatched(false);
+        fileBrowser.refresh();
+        libraryScanner->scan(musicLibs);
+    }
+    else if (!changedFiles.isEmpty()) {
+        libraryScanner->scanFiles(changedFiles);
+    }
+    else {
+        fileBrowser.repaint();
+    }
+}
+
+void MainComponent::audioFileMoved(const juce::File& oldFile, const juce::File& newFile)
+{
+    const juce::String oldPath = oldFile.getFullPathName();
+
+    //every record path is interned, so if the old path is unknown no record is affected
+    const PathTable& paths = PathTable::getShared();
+    const PathTable::Id oldId = paths.find(oldPath);
+    if (oldId == PathTable::empty)
+        return;
+
+    //collect first, setPaths changes the indices
+    std::vector<AudioFile*> moved;
+    for (AudioFile& audioFile : allFiles) {
+        if (audioFile.absPathId == oldId || paths.isWithin(audioFile.absPathId, oldId))
+            moved.push_back(&audioFile);
+    }
+
+    for (AudioFile* audioFile : moved) {
+        juce::File file(newFile.getFullPathName() + audioFile->getAbsPath().substring(oldPath.length()));
+
+        juce::String relPath = "";
+        for (const juce::File& libRoot : musicLibs) {
+            if (file.isAChildOf(libRoot)) {
+                relPath = file.getRelativePathFrom(libRoot);
+                break;
+            }
+        }
+
+        allFiles.setPaths(*audioFile, file.getFullPathName(), relPath);
+    }
+
+    if (!moved.empty())
+        settingsChanged();
 }
 
 void MainComponent::playButtonClicked()
@@ -346,17 +543,35 @@ void MainComponent::musicLibRootButtonClicked() {
 void MainComponent::settingsButtonClicked()
 {
     settingsViewWindow.setVisible(true);
+    updateMemoryUsage();
 
 }
 
+void MainComponent::updateMemoryUsage()
+{
+    if (!settingsViewWindow.isVisible())
+        return;
+
+    juce::String text = "Memory used by caches: " + juce::File::descriptionOfSizeInBytes((juce::int64)memoryBudget.getTotalUsage())
+        + " of " + juce::File::descriptionOfSizeInBytes((juce::int64)memoryBudget.getBudget());
+    for (const MemoryBudget::Usage& usage : memoryBudget.getUsage())
+        text << "\n    " << usage.name << ": " << juce::File::descriptionOfSizeInBytes((juce::int64)usage.bytes);
+
+    settingsViewWindow.settingsViewContentComponent.memoryLabel.setText(text, juce::dontSendNotification);
+}
+
 void MainComponent::openAudioSettings()
 {
+    //the selector shows the open device
+    audioIdleTimer.stopTimer();
+    resumeAudioDevice();
     deviceSelectorWindow.setVisible(true);
 }
 
 void MainComponent::closeAudioSettings()
 {
     deviceSelectorWindow.setVisible(false);
+    startAudioIdleTimer();
 }
 
 void MainComponent::updateMusicLibsComboBox()
@@ -374,6 +589,7 @@ void MainComponent::onDefaultCrossFadeToggleChange()
     juce::ToggleButton* toggle = &settingsViewWindow.settingsViewContentComponent.defaultCrossFadeToggle;
 
     defaultCrossFadeActive = toggle->getToggleState();
+    settingsChanged();
 }
 
 void MainComponent::onDefaultCrossFadeTextEditShow()
@@ -396,14 +612,14 @@ void MainComponent::onDefaultCrossFadeTextEditHide()
     }
 
     defaultCrossFadeLength = n;
-
+    settingsChanged();
 }
 
-void MainComponent::createButtonImages()
+void MainComponent::createButtonIcons()
 {
-
+    //icons are drawn into a 512x512 area, ControlButton renders them at the size they are displayed with
     int borderSize = 64;
-    int imageSize = 512;
+    int imageSize = ControlButton::iconSize;
 
     float outline = 15;
 
@@ -411,22 +627,6 @@ void MainComponent::createButtonImages()
     juce::Colour wholeLoopCol = juce::Colours::blue;
     juce::Colour sectionLoopCol = juce::Colours::orange;
 
-    playImage = juce::Image(juce::Image::ARGB, imageSize, imageSize, true);
-    juce::Graphics playGraphics(playImage);
-    pauseImage = juce::Image(juce::Image::ARGB, imageSize, imageSize, true);
-    juce::Graphics pauseGraphics(pauseImage);
-    stopImage = juce::Image(juce::Image::ARGB, imageSize, imageSize, true);
-    juce::Graphics stopGraphics(stopImage);
-    noLoopImage = juce::Image(juce::Image::ARGB, imageSize, imageSize, true);
-    juce::Graphics noLoopGraphics(noLoopImage);
-    wholeLoopImage = juce::Image(juce::Image::ARGB, imageSize, imageSize, true);
-    juce::Graphics wholeLoopGraphics(wholeLoopImage);
-    sectionLoopImage = juce::Image(juce::Image::ARGB, imageSize, imageSize, true);
-    juce::Graphics sectionLoopGraphics(sectionLoopImage);
-    settingsImage = juce::Image(juce::Image::ARGB, imageSize, imageSize, true);
-    juce::Graphics settingsGraphics(settingsImage);
-
-
     imageSize = imageSize - 2 * borderSize;
 
     juce::Path playShape;
@@ -437,32 +637,38 @@ void MainComponent::createButtonImages()
 
     playShape = playShape.createPathWithRoundedCorners(0.1 * imageSize);
 
-    playGraphics.setOrigin(borderSize, borderSize);
-    playGraphics.setColour(juce::Colours::green);
-    playGraphics.fillPath(playShape);
-    playGraphics.setColour(juce::Colours::black);
-    playGraphics.strokePath(playShape, juce::PathStrokeType::PathStrokeType(outline));
+    playIcon = [=](juce::Graphics& g) {
+        g.setOrigin(borderSize, borderSize);
+        g.setColour(juce::Colours::green);
+        g.fillPath(playShape);
+        g.setColour(juce::Colours::black);
+        g.strokePath(playShape, juce::PathStrokeType::PathStrokeType(outline));
+    };
 
     
     juce::Path pauseShape;
     pauseShape.addRoundedRectangle(0, 0, 0.33 * imageSize, imageSize, 0.1 * imageSize);
     pauseShape.addRoundedRectangle(0.66*imageSize, 0, 0.33 * imageSize, imageSize, 0.1 * imageSize);
 
-    pauseGraphics.setOrigin(borderSize, borderSize);
-    pauseGraphics.setColour(juce::Colours::yellow);
-    pauseGraphics.fillPath(pauseShape);
-    pauseGraphics.setColour(juce::Colours::black);
-    pauseGraphics.strokePath(pauseShape, juce::PathStrokeType::PathStrokeType(outline));
+    pauseIcon = [=](juce::Graphics& g) {
+        g.setOrigin(borderSize, borderSize);
+        g.setColour(juce::Colours::yellow);
+        g.fillPath(pauseShape);
+        g.setColour(juce::Colours::black);
+        g.strokePath(pauseShape, juce::PathStrokeType::PathStrokeType(outline));
+    };
 
 
     juce::Path stopShape;
     stopShape.addRoundedRectangle(0, 0, imageSize, imageSize, 0.1 * imageSize);
 
-    stopGraphics.setOrigin(borderSize, borderSize);
-    stopGraphics.setColour(juce::Colours::red);
-    stopGraphics.fillPath(stopShape);
-    stopGraphics.setColour(juce::Colours::black);
-    stopGraphics.strokePath(stopShape, juce::PathStrokeType::PathStrokeType(outline));
+    stopIcon = [=](juce::Graphics& g) {
+        g.setOrigin(borderSize, borderSize);
+        g.setColour(juce::Colours::red);
+        g.fillPath(stopShape);
+        g.setColour(juce::Colours::black);
+        g.strokePath(stopShape, juce::PathStrokeType::PathStrokeType(outline));
+    };
 
 
     juce::Path loopShape;
@@ -487,45 +693,51 @@ void MainComponent::createButtonImages()
     noLoopShape.addRectangle(- outerRadius - loopArrowWidth, -0.05 * imageSize, 2*(outerRadius + loopArrowWidth), 0.1 * imageSize);
     
 
-    noLoopGraphics.setOrigin(imageSize/2+borderSize, imageSize / 2 + borderSize);
-    noLoopGraphics.setColour(noLoopCol.darker(0.2));
-    noLoopGraphics.fillPath(loopShape);
-    noLoopGraphics.setColour(juce::Colours::black);
-    noLoopGraphics.strokePath(loopShape, juce::PathStrokeType::PathStrokeType(outline));
+    noLoopIcon = [=](juce::Graphics& g) {
+        g.setOrigin(imageSize/2+borderSize, imageSize / 2 + borderSize);
+        g.setColour(noLoopCol.darker(0.2));
+        g.fillPath(loopShape);
+        g.setColour(juce::Colours::black);
+        g.strokePath(loopShape, juce::PathStrokeType::PathStrokeType(outline));
 
-    noLoopGraphics.setColour(juce::Colours::red);
-    noLoopGraphics.fillPath(noLoopShape, juce::AffineTransform::rotation(-0.25 * juce::float_Pi));
-    noLoopGraphics.setColour(juce::Colours::black);
-    noLoopGraphics.strokePath(noLoopShape, juce::PathStrokeType::PathStrokeType(0.5*outline), juce::AffineTransform::rotation(-0.25 * juce::float_Pi));
+        g.setColour(juce::Colours::red);
+        g.fillPath(noLoopShape, juce::AffineTransform::rotation(-0.25 * juce::float_Pi));
+        g.setColour(juce::Colours::black);
+        g.strokePath(noLoopShape, juce::PathStrokeType::PathStrokeType(0.5*outline), juce::AffineTransform::rotation(-0.25 * juce::float_Pi));
+    };
 
     juce::Path wholeLoopShape;
     wholeLoopShape.addRoundedRectangle(0, 0, 0.2 * imageSize, imageSize, 0.025*imageSize);
     wholeLoopShape.addRoundedRectangle(0.8*imageSize, 0, 0.2 * imageSize, imageSize, 0.025*imageSize);
 
 
-    wholeLoopGraphics.setOrigin(borderSize, borderSize);
-    wholeLoopGraphics.setColour(juce::Colours::blue);
-    wholeLoopGraphics.fillPath(wholeLoopShape);
-    wholeLoopGraphics.setColour(juce::Colours::black);
-    wholeLoopGraphics.strokePath(wholeLoopShape, juce::PathStrokeType::PathStrokeType(outline));
+    wholeLoopIcon = [=](juce::Graphics& g) {
+        g.setOrigin(borderSize, borderSize);
+        g.setColour(juce::Colours::blue);
+        g.fillPath(wholeLoopShape);
+        g.setColour(juce::Colours::black);
+        g.strokePath(wholeLoopShape, juce::PathStrokeType::PathStrokeType(outline));
 
-    wholeLoopGraphics.setOrigin(imageSize / 2, imageSize / 2);
-    wholeLoopGraphics.setColour(noLoopCol.interpolatedWith(wholeLoopCol ,0.6));
-    wholeLoopGraphics.fillPath(loopShape);
-    wholeLoopGraphics.setColour(juce::Colours::black);
-    wholeLoopGraphics.strokePath(loopShape, juce::PathStrokeType::PathStrokeType(outline));
+        g.setOrigin(imageSize / 2, imageSize / 2);
+        g.setColour(noLoopCol.interpolatedWith(wholeLoopCol ,0.6));
+        g.fillPath(loopShape);
+        g.setColour(juce::Colours::black);
+        g.strokePath(loopShape, juce::PathStrokeType::PathStrokeType(outline));
+    };
 
 
     juce::Image loopMarker = timeLine.getActiveLoopMarkerIcon();
-    sectionLoopGraphics.setOrigin(borderSize, borderSize);
-    sectionLoopGraphics.drawImage(loopMarker, juce::Rectangle<float>(0, 0, 0.2 * imageSize, imageSize), juce::RectanglePlacement::xLeft | juce::RectanglePlacement::yTop);
-    sectionLoopGraphics.drawImage(loopMarker, juce::Rectangle<float>(0.8 * imageSize, 0, 0.2*imageSize, imageSize), juce::RectanglePlacement::xRight | juce::RectanglePlacement::yTop);
+    sectionLoopIcon = [=](juce::Graphics& g) {
+        g.setOrigin(borderSize, borderSize);
+        g.drawImage(loopMarker, juce::Rectangle<float>(0, 0, 0.2 * imageSize, imageSize), juce::RectanglePlacement::xLeft | juce::RectanglePlacement::yTop);
+        g.drawImage(loopMarker, juce::Rectangle<float>(0.8 * imageSize, 0, 0.2*imageSize, imageSize), juce::RectanglePlacement::xRight | juce::RectanglePlacement::yTop);
 
-    sectionLoopGraphics.setOrigin(imageSize / 2, imageSize / 2);
-    sectionLoopGraphics.setColour(noLoopCol.interpolatedWith(sectionLoopCol, 0.5));
-    sectionLoopGraphics.fillPath(loopShape);
-    sectionLoopGraphics.setColour(juce::Colours::black);
-    sectionLoopGraphics.strokePath(loopShape, juce::PathStrokeType::PathStrokeType(outline));
+        g.setOrigin(imageSize / 2, imageSize / 2);
+        g.setColour(noLoopCol.interpolatedWith(sectionLoopCol, 0.5));
+        g.fillPath(loopShape);
+        g.setColour(juce::Colours::black);
+        g.strokePath(loopShape, juce::PathStrokeType::PathStrokeType(outline));
+    };
 
 
     juce::Path settingsShape;
@@ -538,8 +750,6 @@ void MainComponent::createButtonImages()
     float toothRelWidth = 0.5;//1:only tooth, 0 no tooth
     int nTooths = 8;
 
-    float curAngle = 0;
-
     settingsShape.startNewSubPath(0, outerCirlceRadius);
 
     for (int i = 0; i < nTooths; ++i) {
@@ -558,11 +768,13 @@ void MainComponent::createButtonImages()
     settingsShape = settingsShape.createPathWithRoundedCorners(0.05 * imageSize);
     settingsShape.setUsingNonZeroWinding(false);
 
-    settingsGraphics.setOrigin(imageSize / 2 + borderSize, imageSize / 2 + borderSize);
-    settingsGraphics.setColour(noLoopCol.darker(0.2));
-    settingsGraphics.fillPath(settingsShape);
-    settingsGraphics.setColour(juce::Colours::black);
-    settingsGraphics.strokePath(settingsShape, juce::PathStrokeType::PathStrokeType(outline));
+    settingsIcon = [=](juce::Graphics& g) {
+        g.setOrigin(imageSize / 2 + borderSize, imageSize / 2 + borderSize);
+        g.setColour(noLoopCol.darker(0.2));
+        g.fillPath(settingsShape);
+        g.setColour(juce::Colours::black);
+        g.strokePath(settingsShape, juce::PathStrokeType::PathStrokeType(outline));
+    };
 
 
 }
@@ -571,6 +783,7 @@ void MainComponent::volSliderValueChanged()
 {
     curVolume = volSlider.getValue();
     transportSource.setGain(curVolume);
+    settingsChanged();
 }
 
 void MainComponent::timeLineValueChanged(bool userChanged)
@@ -607,7 +820,6 @@ void MainComponent::timeLineValueChanged(bool userChanged)
 
 
         transportSource.setPosition(newTime);
-        timeLine.startTimer(timeLine.guiRefreshTime);
     }
     else {
         updateTimeLine();
@@ -624,6 +836,8 @@ void MainComponent::onCrossFadeCheckBoxChange()
     if (currentFile) {
         currentFile->crossFadeActive = toggleState;
         currentFile->setCustomSetting(AudioFile::CustomSetting::CrossFadeActive, true);
+        allFiles.recordChanged(*currentFile);
+        settingsChanged();
     }
 }
 
@@ -644,6 +858,8 @@ void MainComponent::onCrossFadeTextEditHide(bool userChanged) {
     if (userChanged && currentFile) {
         currentFile->crossFadeLength = n;
         currentFile->setCustomSetting(AudioFile::CustomSetting::CrossFadeLength, true);
+        allFiles.recordChanged(*currentFile);
+        settingsChanged();
     }
 
     if (crossFadeCheckBox.getToggleState()) {
@@ -652,24 +868,75 @@ void MainComponent::onCrossFadeTextEditHide(bool userChanged) {
     }
 }
 
+void MainComponent::selectionChanged()
+{
+    //also covers selecting with the keyboard
+    if (fileBrowser.getNumSelectedFiles() == 1)
+        prefetchFile(fileBrowser.getSelectedFile(0));
+}
+
+void MainComponent::fileClicked(const juce::File& file, const juce::MouseEvent& e)
+{
+    prefetchFile(file);
+}
+
+void MainComponent::prefetchFile(const juce::File& file, JobSystem::Priority priority)
+{
+    //a file being opened must not be cancelled by selecting another one
+    if (!file.existsAsFile() || (pendingOpenFile != juce::File() && pendingOpenFile != file))
+        return;
+
+    if (readerPool.contains(file))
+        return;
+
+    juce::String relPath = "";
+    for (const juce::File& libRoot : musicLibs) {
+        if (file.isAChildOf(libRoot)) {
+            relPath = file.getRelativePathFrom(libRoot);
+            break;
+        }
+    }
+
+    //the loop start gets primed too, if there is a saved one
+    double loopStart = 0;
+    if (const AudioFile* audioFile = findKnownFile(file, relPath)) {
+        if (audioFile->hasCustomSetting(AudioFile::CustomSetting::LoopStart))
+            loopStart = audioFile->loopStart;
+    }
+
+    prefetcher->prefetch(file, loopStart, priority);
+}
+
 void MainComponent::fileDoubleClicked(const juce::File& file)
 {
-    openFile(file);
-    changeState(Starting);
+    openFile(file, true);
 }
 
 void MainComponent::prepareToPlay(int samplesPerBlockExpected, double sampleRate)
 {
     transportSource.prepareToPlay(samplesPerBlockExpected, sampleRate);
     curSampleRate = sampleRate;
+    if (auto* device = customDeviceManager.getCurrentAudioDevice())
+        playheadClock.setOutputLatency(device->getOutputLatencyInSamples() / sampleRate);
+    if (realtimeAudio)
+        RealtimeSupport::unlockBuffer(transitionBuffer);
     transitionBuffer = juce::AudioSampleBuffer(2, maxCrossFade * sampleRate + 2*samplesPerBlockExpected);
     transitionChannelInfo = juce::AudioSourceChannelInfo(transitionBuffer);
 
+    //a restarted device has a new thread
+    audioThreadId = nullptr;
+    if (realtimeAudio) {
+        RealtimeSupport::lockBuffer(transitionBuffer, "transition buffer");
+        realtimeSetupTimer.startTimer(100);
+    }
+
 }
 
 void MainComponent::getNextAudioBlock(const juce::AudioSourceChannelInfo& bufferToFill)
 {
-
+    audioThreadId.store(juce::Thread::getCurrentThreadId(), std::memory_order_relaxed);
+    playheadClock.publish(transportSource.getNextReadPosition() / curSampleRate, bufferToFill.numSamples / curSampleRate,
+                          readerSource.get() != nullptr && state == TransportState::Playing);
 
     if (readerSource.get() == nullptr || state!=TransportState::Playing)
     {
@@ -801,6 +1068,9 @@ void MainComponent::releaseResources()
 
 void MainComponent::changeListenerCallback(juce::ChangeBroadcaster* source)
 {
+    if (source == &customDeviceManager)
+        audioDeviceChanged();
+
     if (source == &transportSource)
     {
         if (!inTransition) {
@@ -825,10 +1095,14 @@ void MainComponent::changeState(TransportState newState)
         case Stopped:
             playButton.setEnabled(true);
             stopButton.setEnabled(false);
-            playButton.setImage(playImage);
+            playButton.setIcon(playIcon);
             playButton.setColour(juce::TextButton::buttonColourId, juce::Colours::green);
             transportSource.setPosition(0.0);
             timeLine.setClickableTimeStamp(true);
+            reportUnderruns();
+            startAudioIdleTimer();
+            if (calibrationPending)
+                applyBufferSizeCalibration();
             break;
         case Pausing:
             inTransition = false;
@@ -836,25 +1110,36 @@ void MainComponent::changeState(TransportState newState)
             timeLine.setClickableTimeStamp(true);
             break;
         case Paused:
-            playButton.setImage(playImage);
+            playButton.setIcon(playIcon);
             playButton.setColour(juce::TextButton::buttonColourId, juce::Colours::green);
             timeLine.setClickableTimeStamp(true);
+            reportUnderruns();
+            startAudioIdleTimer();
+            if (calibrationPending)
+                applyBufferSizeCalibration();
             break;
         case Starting:
-            playButton.setImage(pauseImage);
+            playButton.setIcon(pauseIcon);
+            audioIdleTimer.stopTimer();
+            resumeAudioDevice();
+            //started again once stopped
+            if (bufferSizeCalibrator != nullptr && bufferSizeCalibrator->isRunning()) {
+                bufferSizeCalibrator->cancel();
+                calibrationPending = true;
+            }
             transportSource.start();
             timeLine.setClickableTimeStamp(false);
             break;
 
         case Playing:
-            playButton.setImage(pauseImage);
+            playButton.setIcon(pauseIcon);
             playButton.setColour(juce::TextButton::buttonColourId, juce::Colours::orange);
             stopButton.setEnabled(true);
             timeLine.setClickableTimeStamp(false);
             break;
 
         case Stopping:
-            playButton.setImage(playImage);
+            playButton.setIcon(playIcon);
             playButton.setColour(juce::TextButton::buttonColourId, juce::Colours::green);
             if (transportSource.isPlaying()) {
                 transportSource.setPosition(0);
@@ -867,9 +1152,21 @@ void MainComponent::changeState(TransportState newState)
             timeLine.setClickableTimeStamp(true);
             break;
         }
+
+        guiScheduler.setPlaying(state == Starting || state == Playing);
     }
 }
 
+void MainComponent::guiActiveChanged(bool active)
+{
+    timeLine.setFrameCallbacksActive(active);
+    fileBrowser.setPeriodicChecksActive(active);
+
+    //shows what happened while idle
+    if (active)
+        updateTimeLine();
+}
+
 void MainComponent::changeLoopmode(Loopmode newLoopmode) {
 
         loopmode = newLoopmode;
@@ -879,7 +1176,7 @@ void MainComponent::changeLoopmode(Loopmode newLoopmode) {
         case notLooping:
 
             inTransition = false;
-            loopButton.setImage(noLoopImage);
+            loopButton.setIcon(noLoopIcon);
             timeLine.setLoopMarkersActive(false);
             timeLine.setWholeLoopMarkersActive(false);
 
@@ -896,7 +1193,7 @@ void MainComponent::changeLoopmode(Loopmode newLoopmode) {
         case loopWhole:
             
             inTransition = false;
-            loopButton.setImage(wholeLoopImage);
+            loopButton.setIcon(wholeLoopIcon);
             timeLine.setLoopMarkersActive(false);
             timeLine.setWholeLoopMarkersActive(true);
 
@@ -917,7 +1214,7 @@ void MainComponent::changeLoopmode(Loopmode newLoopmode) {
                 break;
             }
 
-            loopButton.setImage(sectionLoopImage);
+            loopButton.setIcon(sectionLoopIcon);
             timeLine.setLoopMarkersActive(true);
             timeLine.setWholeLoopMarkersActive(false);
             if (readerSource != nullptr)
@@ -942,7 +1239,7 @@ void MainComponent::changeLoopmode(Loopmode newLoopmode) {
         case fakeLoopSection:
             //same visual als loopSection, but no loop
             inTransition = false;
-            loopButton.setImage(sectionLoopImage);
+            loopButton.setIcon(sectionLoopIcon);
             timeLine.setLoopMarkersActive(true);
             timeLine.setWholeLoopMarkersActive(false);
 
@@ -971,6 +1268,8 @@ void MainComponent::initTimeLine() {
 
    
     timeLine.setRange(0.0, transportSource.getLengthInSeconds(), 0);
+    timeLine.setSampleRate(transportSource.getLengthInSeconds() > 0 ? transportSource.getTotalLength() / transportSource.getLengthInSeconds() : 0);
+    timeLine.resetZoom();
     timeLine.updateLoopMarkers();
     updateTimeLine();
 }
@@ -981,16 +1280,26 @@ void MainComponent::updateTimeLine()
     if (!timeLine.mouseIsDragged) {
 
         if (transportSource.getLengthInSeconds() > 0 && transportSource.getTotalLength() > 0) {
-            timeLine.setValue(transportSource.getNextReadPosition()/curSampleRate);
+            timeLine.setPlayheadPosition(getAudiblePosition());
             timeLine.updateInputBoxValue();
         }
         else
         {
-            timeLine.setValue(0);
+            timeLine.setPlayheadPosition(0);
         }
     }
 }
 
+double MainComponent::getAudiblePosition() const
+{
+    //the transport reads ahead of what is heard, the clock corrects that and moves smoothly between audio callbacks
+    double seconds;
+    if (state == Playing && playheadClock.getAudiblePosition(juce::Time::getMillisecondCounterHiRes(), seconds))
+        return juce::jmin(seconds, transportSource.getLengthInSeconds());
+
+    return transportSource.getNextReadPosition() / curSampleRate;
+}
+
 void MainComponent::setLoopTimeStamps(double loopStart, double loopEnd) {
 
     if (loopStart < 0)
@@ -1005,6 +1314,8 @@ void MainComponent::setLoopTimeStamps(double loopStart, double loopEnd) {
 
         currentFile->setCustomSetting(AudioFile::CustomSetting::LoopStart, loopStart != 0);
         currentFile->setCustomSetting(AudioFile::CustomSetting::LoopEnd, loopEnd != transportSource.getLengthInSeconds());
+        allFiles.recordChanged(*currentFile);
+        settingsChanged();
     }
     timeLine.setLoopMarkerOnValues(loopStart, loopEnd, false);
 
@@ -1028,6 +1339,8 @@ void MainComponent::setLoopTimeStamps(double loopStart, double loopEnd) {
 
 void MainComponent::browserRootChanged(const juce::File& newRoot)
 {
+    loadShardOfLibraryContaining(newRoot);
+
     bool isLibRoot = false;
     for (juce::File libRoot : musicLibs) {
         if (newRoot == libRoot) {
@@ -1042,6 +1355,11 @@ void MainComponent::browserRootChanged(const juce::File& newRoot)
     else {
         fileBrowser.setMusicLibState(false);
     }
+
+    directoryWatcher.setBrowsedDirectory(newRoot);
+    fileBrowser.setRootIsWatched(directoryWatcher.canWatch(newRoot));
+
+    settingsChanged();
 }
 
 AudioFile* MainComponent::findFileInAllFiles(const juce::File& file) {
@@ -1052,66 +1370,255 @@ AudioFile* MainComponent::findFileInAllFiles(const juce::File& file) {
     // 1. find same relative path from a musicLibRoot
     for (juce::File libRoot : musicLibs) {
         if (file.isAChildOf(libRoot)) {
+            loadLibraryShard(libRoot);
             relPath = file.getRelativePathFrom(libRoot);
 
-            for (auto it = allFiles.begin(); it != allFiles.end(); it++) {
-                if (relPath == it->relPathToLib) {
-                    it->length = length;
-                    return &*it;
-                }
+            if (AudioFile* found = allFiles.findByRelPath(relPath)) {
+                found->length = length;
+                allFiles.recordChanged(*found);
+                requestFingerprint(*found, file);
+                return found;
             }
         }
     }
 
     // 2. find same absolute path
-    for (auto it = allFiles.begin();it!=allFiles.end(); it++) {
-        if (absPath == it->absPath) {
-            it->length = transportSource.getLengthInSeconds();
-            it->relPathToLib = it->relPathToLib=="" ? relPath : it->relPathToLib;
-            return &*it;
-        }
+    if (AudioFile* found = allFiles.findByAbsPath(absPath)) {
+        found->length = length;
+        allFiles.recordChanged(*found);
+        if (!found->hasRelPathToLib())
+            allFiles.setPaths(*found, found->getAbsPath(), relPath);
+        requestFingerprint(*found, file);
+        return found;
     }
 
+    // 3. same content: happens in fingerprintReady(), as soon as the fingerprint of this file is computed
+
     //if nothing found -> new file
     AudioFile newFile(absPath, 0, length);
-    newFile.relPathToLib = relPath;
+    newFile.setRelPathToLib(relPath);
     newFile.length = length;
     newFile.crossFadeActive = defaultCrossFadeActive;
     newFile.crossFadeLength = defaultCrossFadeLength;
 
-    // last: find same filename and same length and ASK if same loopmarkers should be applied
+    AudioFile& added = allFiles.add(std::move(newFile));
+    requestFingerprint(added, file);
+
+    // last: find same filename and same length and ASK if same loopmarkers should be applied.
+    // only for files saved before fingerprints existed, all others are matched by their fingerprint.
+    // the file plays with default settings until the question is answered
     juce::String fileName = file.getFileName();
+    for (AudioFile& candidate : allFiles) {
+        if (&candidate != &added
+            && !candidate.fingerprint.computed
+            && (float)length == candidate.length
+            && fileName == PathTable::getShared().getFileName(candidate.absPathId)) {
+            askForSameLoopMarkers(added, candidate, file);
+            break;
+        }
+    }
+
+    return &added;
+
+}
+
+void MainComponent::askForSameLoopMarkers(const AudioFile& newRecord, const AudioFile& candidate, const juce::File& file)
+{
     juce::String newLine = juce::String(juce::newLine.getDefault());
-    for (auto it = allFiles.begin(); it != allFiles.end(); it++) {
-        if (fileName == juce::File(it->absPath).getFileName() 
-            && length == it->length) {
-            int answer = juce::AlertWindow::showYesNoCancelBox(juce::MessageBoxIconType::QuestionIcon, "possible Loopmarker found!",
-                juce::String("Found Loopmarker for a File with same name and length originally located here:") + newLine +
-                it->absPath + newLine + newLine +
-                "Should these Loopmarker positions be used for this file?" + newLine + newLine +
-                "Use Same: same Loopmarkers, changes will be saved to file above" + newLine +
-                "Copy: same Loopmarkers, changes will only affect this file" + newLine +
-                "Neither: loopmarkers as if never opened before",
-                "Use Same", "Copy", "Neither", nullptr, nullptr);
-            switch (answer) {
-            case 1:
-                return &*it;
-                break;
-            case 2:
-                newFile.loopStart = it->loopStart;
-                newFile.loopEnd = it->loopEnd;
-                break;
-            default:
-                break;
-            }
+    juce::Component::SafePointer<MainComponent> safeThis(this);
+    const PathTable::Id newPath = newRecord.absPathId;
+    const PathTable::Id candidatePath = candidate.absPathId;
+
+    juce::AlertWindow::showYesNoCancelBox(juce::MessageBoxIconType::QuestionIcon, "possible Loopmarker found!",
+        juce::String("Found Loopmarker for a File with same name and length originally located here:") + newLine +
+        candidate.getAbsPath() + newLine + newLine +
+        "Should these Loopmarker positions be used for this file?" + newLine + newLine +
+        "Use Same: same Loopmarkers, changes will be saved to file above" + newLine +
+        "Copy: same Loopmarkers, changes will only affect this file" + newLine +
+        "Neither: loopmarkers as if never opened before",
+        "Use Same", "Copy", "Neither", nullptr,
+        juce::ModalCallbackFunction::create([safeThis, newPath, candidatePath, file](int answer) {
+            if (safeThis != nullptr)
+                safeThis->sameLoopMarkersAnswered(answer, newPath, candidatePath, file);
+        }));
+}
+
+void MainComponent::sameLoopMarkersAnswered(int answer, PathTable::Id newPath, PathTable::Id candidatePath, const juce::File& file)
+{
+    //looked up again, records may have been moved or replaced while the question was shown
+    AudioFile* newRecord = allFiles.findByAbsPath(newPath);
+    AudioFile* candidate = allFiles.findByAbsPath(candidatePath);
+    if (newRecord == nullptr || candidate == nullptr || newRecord == candidate)
+        return;
+
+    //the settings file or a library shard loaded meanwhile and had own settings for this file, those aren't overwritten
+    if (!newRecord->hasCustomSetting(AudioFile::CustomSetting::None))
+        return;
 
+    //another file may have been opened meanwhile
+    const bool isStillOpen = currentFile == newRecord;
 
+    switch (answer) {
+    case 1:
+        requestFingerprint(*candidate, file);
+        if (isStillOpen) {
+            currentFile = candidate;
+            applyCurrentFileSettings();
         }
+        break;
+    case 2:
+        if (isStillOpen) {
+            setLoopTimeStamps(candidate->loopStart, candidate->loopEnd);
+        }
+        else {
+            newRecord->loopStart = candidate->loopStart;
+            newRecord->loopEnd = candidate->loopEnd;
+            newRecord->setCustomSetting(AudioFile::CustomSetting::LoopStart, candidate->hasCustomSetting(AudioFile::CustomSetting::LoopStart));
+            newRecord->setCustomSetting(AudioFile::CustomSetting::LoopEnd, candidate->hasCustomSetting(AudioFile::CustomSetting::LoopEnd));
+            allFiles.recordChanged(*newRecord);
+            settingsChanged();
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+AudioFile* MainComponent::findKnownFile(const juce::File& file, const juce::String& relPath) const
+{
+    //same order as findFileInAllFiles(), but without creating records or asking
+    if (AudioFile* found = allFiles.findByRelPath(relPath))
+        return found;
+    return allFiles.findByAbsPath(file.getFullPathName());
+}
+
+void MainComponent::requestFingerprint(const AudioFile& audioFile, const juce::File& file)
+{
+    if (!audioFile.fingerprint.computed)
+        fingerprinter->addFile(file);
+}
+
+void MainComponent::fingerprintReady(const juce::File& file, const AudioFingerprint::Value& fingerprint)
+{
+    AudioFile* audioFile = allFiles.findByAbsPath(file.getFullPathName());
+    if (audioFile == nullptr)
+        return;
+
+    if (audioFile->fingerprint != fingerprint) {
+        allFiles.setFingerprint(*audioFile, fingerprint);
+        settingsChanged();
     }
 
-    allFiles.push_back(newFile);
-    return &allFiles.back();
+    //the settings follow the file: a renamed, moved or copied file without own settings yet gets those of the known record
+    if (!audioFile->hasCustomSetting(AudioFile::CustomSetting::None))
+        return;
+
+    const AudioFileIndex::FingerprintMatch found = allFiles.findByFingerprint(fingerprint, [audioFile](const AudioFile& candidate) {
+        return &candidate != audioFile && !candidate.hasCustomSetting(AudioFile::CustomSetting::None);
+    });
+    if (found.file == nullptr)
+        return;
+
+    AudioFile* sameContent = found.file;
+    const juce::File knownFile(sameContent->getAbsPath());
+
+    //only sounds alike, e.g. another encoding of the same recording or just a similar track
+    if (found.match == AudioFingerprint::Match::similar) {
+        askForSettingsOf(audioFile->absPathId, sameContent->absPathId, false, knownFile.existsAsFile());
+        return;
+    }
+
+    if (knownFile.existsAsFile()) {
+        //a copy, both keep their own settings from now on
+        audioFile->copySettingsFrom(*sameContent);
+        allFiles.recordChanged(*audioFile);
+        if (currentFile == audioFile)
+            applyCurrentFileSettings();
+        settingsChanged();
+    }
+    else if (knownFile.getParentDirectory().isDirectory()) {
+        //gone from where it was, so it moved or was renamed
+        takeOverRecord(*audioFile, *sameContent);
+    }
+    else {
+        //the whole directory is gone, which may just be a drive that isn't connected
+        askForSettingsOf(audioFile->absPathId, sameContent->absPathId, true, false);
+    }
+}
+
+void MainComponent::askForSettingsOf(PathTable::Id newPath, PathTable::Id knownPath, bool sameContent, bool knownFileExists)
+{
+    juce::String newLine = juce::String(juce::newLine.getDefault());
+    juce::Component::SafePointer<MainComponent> safeThis(this);
+    const PathTable& paths = PathTable::getShared();
+
+    const juce::String title = sameContent ? "same File found!" : "similar File found!";
+    const juce::String found = sameContent
+        ? "This file has the same content as a file with own settings, which is not reachable right now:"
+        : "This file sounds like a file with own settings, e.g. the same recording encoded differently:";
+
+    //a file that is still there can't have moved
+    if (knownFileExists) {
+        juce::AlertWindow::showOkCancelBox(juce::MessageBoxIconType::QuestionIcon, title,
+            found + newLine + paths.toString(knownPath) + newLine + newLine +
+            "Copy: this file gets a copy of the settings" + newLine +
+            "Neither: settings as if never opened before",
+            "Copy", "Neither", nullptr,
+            juce::ModalCallbackFunction::create([safeThis, newPath, knownPath](int answer) {
+                if (safeThis != nullptr)
+                    safeThis->fileMovedAnswered(answer == 1 ? 2 : 0, newPath, knownPath);
+            }));
+        return;
+    }
 
+    juce::AlertWindow::showYesNoCancelBox(juce::MessageBoxIconType::QuestionIcon, title,
+        found + newLine + paths.toString(knownPath) + newLine + newLine +
+        "Moved: the settings move to this file" + newLine +
+        "Copy: this file gets a copy of the settings" + newLine +
+        "Neither: settings as if never opened before",
+        "Moved", "Copy", "Neither", nullptr,
+        juce::ModalCallbackFunction::create([safeThis, newPath, knownPath](int answer) {
+            if (safeThis != nullptr)
+                safeThis->fileMovedAnswered(answer, newPath, knownPath);
+        }));
+}
+
+void MainComponent::fileMovedAnswered(int answer, PathTable::Id newPath, PathTable::Id knownPath)
+{
+    //looked up again, the records may have changed while the question was shown
+    AudioFile* newRecord = allFiles.findByAbsPath(newPath);
+    AudioFile* known = allFiles.findByAbsPath(knownPath);
+    if (newRecord == nullptr || known == nullptr || newRecord == known || !newRecord->hasCustomSetting(AudioFile::CustomSetting::None))
+        return;
+
+    switch (answer) {
+    case 1:
+        takeOverRecord(*newRecord, *known);
+        break;
+    case 2:
+        newRecord->copySettingsFrom(*known);
+        allFiles.recordChanged(*newRecord);
+        if (currentFile == newRecord)
+            applyCurrentFileSettings();
+        settingsChanged();
+        break;
+    default:
+        break;
+    }
+}
+
+void MainComponent::takeOverRecord(AudioFile& newRecord, AudioFile& known)
+{
+    //the new record only had default settings, the known one moves to its path and replaces it
+    allFiles.setPaths(known, newRecord.absPathId, newRecord.relPathToLibId);
+    known.length = newRecord.length;
+    allFiles.recordChanged(known);
+
+    if (currentFile == &newRecord) {
+        currentFile = &known;
+        applyCurrentFileSettings();
+    }
+    settingsChanged();
 }
 
 void MainComponent::setCrossFade(double time)
@@ -1124,163 +1631,435 @@ void MainComponent::setCrossFade(double time)
 
 }
 
-void MainComponent::openFile(const juce::File& file)
+void MainComponent::openFile(const juce::File& file, bool startPlaying)
 {
+    if (file == juce::File{} || !file.existsAsFile())
+        return;
 
-    if (file != juce::File{})
-    {
-        juce::AudioFormatReader* reader = formatManager.createReaderFor(file);
+    //reading and decoding happens in a prefetcher job, the current file keeps playing meanwhile
+    pendingOpenFile = file;
+    pendingOpenStartsPlaying = startPlaying;
+
+    //recently played files are still open
+    if (auto source = readerPool.take(file))
+        finishOpening(file, std::move(source));
+    else if (auto source = prefetcher->take(file))
+        finishOpening(file, std::move(source));
+    else
+        prefetchFile(file, JobSystem::Priority::interactive);
+}
 
-        if (reader != nullptr)
-        {
-            auto newSource = std::make_unique<juce::AudioFormatReaderSource>(reader, true);
-            transportSource.setSource(newSource.get(),0, nullptr, reader->sampleRate);
+void MainComponent::prefetchFinished(const juce::File& file, bool success)
+{
+    if (file != pendingOpenFile)
+        return;
 
+    if (success) {
+        if (auto source = prefetcher->take(file)) {
+            finishOpening(file, std::move(source));
+            return;
+        }
+    }
 
-            playButton.setEnabled(true);
-            readerSource.reset(newSource.release());
-            
-            playButton.setEnabled(true);
+    //not readable
+    pendingOpenFile = juce::File();
+}
 
+void MainComponent::finishOpening(const juce::File& file, std::unique_ptr<juce::AudioFormatReaderSource> newSource)
+{
+    pendingOpenFile = juce::File();
 
-            currentFile =  findFileInAllFiles(file);
-            initTimeLine();
+    //the current source may still be primed, it's only played again from the pool
+    cancelPriming();
 
-            changeLoopmode(loopmode);
+    if (realtimeAudio)
+        lockAudioMemory(newSource.get());
 
-            double loopStart = currentFile->hasCustomSetting(AudioFile::CustomSetting::LoopStart) ? currentFile->loopStart : 0;
-            double loopEnd = currentFile->hasCustomSetting(AudioFile::CustomSetting::LoopEnd) ? currentFile->loopEnd : DBL_MAX;
+    if (auto* primed = dynamic_cast<PrimedAudioFormatReaderSource*>(newSource.get()))
+        primed->setReadAheadThread(&readAheadThread);
 
-            setLoopTimeStamps(loopStart, loopEnd);
+    transportSource.setSource(newSource.get(),0, nullptr, newSource->getAudioFormatReader()->sampleRate);
 
-            crossFadeCheckBox.setToggleState(
-                currentFile->hasCustomSetting(AudioFile::CustomSetting::CrossFadeActive)
-                    ? currentFile->crossFadeActive
-                    : defaultCrossFadeActive,
-                juce::NotificationType::dontSendNotification);
+    //the previous source isn't used by the transport anymore, keep it for switching back
+    readerPool.add(readerSourceFile, readerSourceIdentity, std::move(readerSource));
+    readerSource = std::move(newSource);
+    reportedUnderruns = 0;
+    if (auto* primed = dynamic_cast<PrimedAudioFormatReaderSource*>(readerSource.get()))
+        reportedUnderruns = primed->getNumUnderruns();
+    readerSourceFile = file;
+    readerSourceIdentity = ReaderPool::Identity::of(file);
+    waveform.setFile(file);
 
-            crossFadeLabel.setText(
-                juce::String(currentFile->hasCustomSetting(AudioFile::CustomSetting::CrossFadeLength)
-                    ? currentFile->crossFadeLength
-                    : defaultCrossFadeLength),
-                juce::NotificationType::dontSendNotification);
+    playButton.setEnabled(true);
 
-            onCrossFadeTextEditHide(false);
+    currentFile =  findFileInAllFiles(file);
+    initTimeLine();
 
-        }
-    }
+    changeLoopmode(loopmode);
+
+    applyCurrentFileSettings();
 
+    if (pendingOpenStartsPlaying)
+        changeState(Starting);
 }
 
+void MainComponent::applyCurrentFileSettings()
+{
+    if (currentFile == nullptr)
+        return;
 
-void MainComponent::saveAllSettingsToFile() {
-    juce::File here = juce::File::getSpecialLocation(juce::File::SpecialLocationType::currentExecutableFile).getParentDirectory();
-    juce::File settingsFile = here.getChildFile("settings.json");
-    settingsFile.create();
+    double loopStart = currentFile->hasCustomSetting(AudioFile::CustomSetting::LoopStart) ? currentFile->loopStart : 0;
+    double loopEnd = currentFile->hasCustomSetting(AudioFile::CustomSetting::LoopEnd) ? currentFile->loopEnd : DBL_MAX;
 
-    juce::DynamicObject* obj = new juce::DynamicObject();
-    juce::var json(obj);
+    setLoopTimeStamps(loopStart, loopEnd);
 
-    obj->setProperty("volume", curVolume);
-    obj->setProperty("currentFileBrowserPath",fileBrowser.getRoot().getFullPathName());
+    crossFadeCheckBox.setToggleState(
+        currentFile->hasCustomSetting(AudioFile::CustomSetting::CrossFadeActive)
+            ? currentFile->crossFadeActive
+            : defaultCrossFadeActive,
+        juce::NotificationType::dontSendNotification);
 
-    //currentFile = nullptr;
+    crossFadeLabel.setText(
+        juce::String(currentFile->hasCustomSetting(AudioFile::CustomSetting::CrossFadeLength)
+            ? currentFile->crossFadeLength
+            : defaultCrossFadeLength),
+        juce::NotificationType::dontSendNotification);
 
-    obj->setProperty("defaultCrossFadeActive", defaultCrossFadeActive);
-    obj->setProperty("defaultCrossFadeLength", defaultCrossFadeLength);
+    onCrossFadeTextEditHide(false);
+}
 
 
-    juce::var roots;
-    for (juce::File file : musicLibs) {
-        juce::DynamicObject* fileObj = new juce::DynamicObject();
-        fileObj->setProperty("path", file.getFullPathName());
-        roots.append(juce::var(fileObj));
+SettingsSnapshot MainComponent::createSettingsSnapshot()
+{
+    SettingsSnapshot snapshot;
+
+    snapshot.volume = curVolume;
+    snapshot.currentFileBrowserPath = fileBrowser.getRoot().getFullPathName();
+    snapshot.defaultCrossFadeActive = defaultCrossFadeActive;
+    snapshot.defaultCrossFadeLength = defaultCrossFadeLength;
+    snapshot.audioIdleTimeout = audioIdleTimeout;
+    snapshot.realtimeAudio = realtimeAudio;
+    snapshot.realtimeCores = realtimeCores;
+    snapshot.memoryBudget = (int)(memoryBudget.getBudget() >> 20);
+    snapshot.musicLibs = musicLibs;
+
+    for (const juce::File& libRoot : musicLibs) {
+        if (loadedShards.contains(libRoot.getFullPathName()))
+            snapshot.libraryShards.push_back(libRoot);
     }
-    obj->setProperty("musicLibs", roots);
 
-    juce::var files;
-    for(AudioFile file : allFiles) {
-        if(!file.hasCustomSetting(AudioFile::CustomSetting::None))
-            files.append(file.toVar());
-    }
-    obj->setProperty("audioFiles", files);
+    //shared with the index, only blocks with changed records are copied
+    snapshot.records = allFiles.getSettingsBlocks();
 
+    return snapshot;
+}
+
+void MainComponent::settingsChanged()
+{
+    ++settingsRevision;
+
+    //only runs while there is something to save
+    if (settingsLoaded && !autoSaveTimer.isTimerRunning())
+        autoSaveTimer.startTimer(autoSaveInterval);
+}
+
+void MainComponent::autoSaveIfChanged()
+{
+    autoSaveTimer.stopTimer();
+    if (!settingsLoaded || settingsRevision == savedSettingsRevision)
+        return;
+
+    savedSettingsRevision = settingsRevision;
+    settingsAutoSaver->save(createSettingsSnapshot());
+}
 
-    settingsFile.replaceWithText(juce::JSON::toString(json));
+void MainComponent::saveAllSettingsToFile() {
+    autoSaveTimer.stopTimer();
 
+    //closed before the settings were read, saving now would drop all of them
+    if (settingsLoaded) {
+        settingsAutoSaver->saveNow(createSettingsSnapshot());
+        savedSettingsRevision = settingsRevision;
+    }
 
+    if (!opensAudioDevice)
+        return;
+
+    saveAudioSettings();
+}
+
+void MainComponent::saveAudioSettings()
+{
     auto audioSettings = customDeviceManager.createStateXml();
+    if (audioSettings == nullptr)
+        audioSettings = std::make_unique<juce::XmlElement>("DEVICESETUP");
+
+    //the device manager doesn't know about them
+    for (auto* calibration : bufferSizeCalibrations.getChildIterator())
+        audioSettings->addChildElement(new juce::XmlElement(*calibration));
+
     audioDeviceSettings.create();
-    audioSettings.get()->writeTo(audioDeviceSettings);
+    audioSettings->writeTo(audioDeviceSettings);
+}
+
+void MainComponent::startLoadingSettings()
+{
+    juce::Component::SafePointer<MainComponent> safeThis(this);
+    JobSystem::getShared().run(JobSystem::Priority::interactive, [file = settingsFile, safeThis]() {
+        auto loaded = std::make_shared<LoadedSettings>(readSettingsFile(file));
+        StartupTrace::mark("settingsParsed");
+
+        juce::MessageManager::callAsync([safeThis, loaded]() {
+            if (safeThis != nullptr)
+                safeThis->applyLoadedSettings(*loaded);
+        });
+    });
 }
 
 void MainComponent::loadAllSettingsFromFile() {
-    juce::File here = juce::File::getSpecialLocation(juce::File::SpecialLocationType::currentExecutableFile).getParentDirectory();
-    juce::File settingsFile = here.getChildFile("settings.json");
-    settingsFile.create();
-    juce::FileInputStream in(settingsFile);
+    //synchronous version of what the constructor starts in the background
+    LoadedSettings loaded = readSettingsFile(settingsFile);
+    applyLoadedSettings(loaded);
+}
+
+MainComponent::LoadedSettings MainComponent::readSettingsFile(const juce::File& file)
+{
+    LoadedSettings loaded;
+    loaded.audioFiles = std::make_unique<AudioFileIndex>();
+
+    file.create();
+    juce::FileInputStream in(file);
     juce::var input = juce::JSON::parse(in);
 
     juce::DynamicObject* obj = input.getDynamicObject();
     if (obj != nullptr) {
         juce::var prop;
 
-        prop = obj->getProperty("volume");
+        loaded.volume = obj->getProperty("volume");
+        loaded.defaultCrossFadeActive = obj->getProperty("defaultCrossFadeActive");
+        loaded.defaultCrossFadeLength = obj->getProperty("defaultCrossFadeLength");
+        loaded.audioIdleTimeout = obj->getProperty("audioIdleTimeout");
+        loaded.realtimeAudio = obj->getProperty("realtimeAudio");
+        loaded.realtimeCores = obj->getProperty("realtimeCores");
+        loaded.memoryBudget = obj->getProperty("memoryBudget");
+        loaded.currentFileBrowserPath = obj->getProperty("currentFileBrowserPath");
+
+        prop = obj->getProperty("musicLibs");
         if (prop != juce::var()) {
-            curVolume = (double)prop;
-            volSlider.setValue(curVolume);
+            for (juce::var var : *prop.getArray()) {
+                loaded.musicLibs.push_back(juce::File(var.getDynamicObject()->getProperty("path")));
+            }
         }
 
-        prop = obj->getProperty("defaultCrossFadeActive");
+        prop = obj->getProperty("audioFiles");
         if (prop != juce::var()) {
-            defaultCrossFadeActive = (bool)prop;
-            settingsViewWindow.settingsViewContentComponent.defaultCrossFadeToggle.setToggleState(defaultCrossFadeActive, juce::dontSendNotification);
+            for (juce::var var : *prop.getArray()) {
+                loaded.audioFiles->add(AudioFile::fromVar(var));
+            }
         }
+    }
 
-        prop = obj->getProperty("defaultCrossFadeLength");
-        if (prop != juce::var()) {
-            defaultCrossFadeLength = (double)prop;
-            settingsViewWindow.settingsViewContentComponent.defaultCrossFadeLabel.setText(juce::String(defaultCrossFadeLength),juce::dontSendNotification);
+    return loaded;
+}
+
+void MainComponent::applyLoadedSettings(LoadedSettings& loaded)
+{
+    if (loaded.volume != juce::var()) {
+        curVolume = (double)loaded.volume;
+        volSlider.setValue(curVolume);
+    }
+
+    if (loaded.defaultCrossFadeActive != juce::var()) {
+        defaultCrossFadeActive = (bool)loaded.defaultCrossFadeActive;
+        settingsViewWindow.settingsViewContentComponent.defaultCrossFadeToggle.setToggleState(defaultCrossFadeActive, juce::dontSendNotification);
+    }
+
+    if (loaded.defaultCrossFadeLength != juce::var()) {
+        defaultCrossFadeLength = (double)loaded.defaultCrossFadeLength;
+        settingsViewWindow.settingsViewContentComponent.defaultCrossFadeLabel.setText(juce::String(defaultCrossFadeLength), juce::dontSendNotification);
+    }
+
+    if (loaded.audioIdleTimeout != juce::var()) {
+        audioIdleTimeout = juce::jmax(0, (int)loaded.audioIdleTimeout);
+        startAudioIdleTimer();
+    }
+
+    if (loaded.realtimeCores != juce::var())
+        realtimeCores = loaded.realtimeCores.toString();
+
+    //MB, the caches need some room to be of any use
+    if (loaded.memoryBudget != juce::var())
+        memoryBudget.setBudget((size_t)juce::jmax(16, (int)loaded.memoryBudget) << 20);
+
+    if ((bool)loaded.realtimeAudio && opensAudioDevice) {
+        realtimeAudio = true;
+        lockAudioMemory(readerSource.get());
+
+        //an already open device is restarted, so the transition buffer is locked and the thread set up while nothing plays
+        if (customDeviceManager.getCurrentAudioDevice() != nullptr && state != Playing && state != Starting) {
+            customDeviceManager.closeAudioDevice();
+            customDeviceManager.restartLastAudioDevice();
         }
+    }
 
-    
+    //libraries added before the settings were read stay
+    for (const juce::File& lib : loaded.musicLibs) {
+        if (std::find(musicLibs.begin(), musicLibs.end(), lib) == musicLibs.end())
+            musicLibs.push_back(lib);
+    }
 
-        prop = obj->getProperty("musicLibs");
-        if (prop != juce::var()) {
-            for (juce::var var : *prop.getArray()) {
-                juce::File file = juce::File(var.getDynamicObject()->getProperty("path"));
+    if (loaded.currentFileBrowserPath != juce::var())
+        fileBrowser.setRoot(juce::File(loaded.currentFileBrowserPath));
 
-                musicLibs.push_back(file);
-            }
+    //files opened before the settings were read only have fresh records, the saved ones replace them.
+    //the early records are copied, questions still open about them find the copies by path id
+    allFiles.swapWith(*loaded.audioFiles);
+    for (AudioFile& earlyRecord : *loaded.audioFiles) {
+        if (allFiles.findByAbsPath(earlyRecord.absPathId) == nullptr)
+            allFiles.add(AudioFile(earlyRecord));
+    }
+
+    if (currentFile != nullptr) {
+        currentFile = allFiles.findByAbsPath(currentFile->absPathId);
+        applyCurrentFileSettings();
+    }
+    loaded.audioFiles.reset();
+
+    settingsLoaded = true;
+    musicLibChanged();
+
+    //what was just loaded is what is on disk
+    savedSettingsRevision = settingsRevision;
+    autoSaveTimer.startTimer(autoSaveInterval);
+
+    startupPhaseFinished("settingsApplied");
+}
+
+void MainComponent::loadLibraryShard(const juce::File& libRoot)
+{
+    const juce::String key = libRoot.getFullPathName();
+    if (loadedShards.contains(key) || loadingShards.contains(key))
+        return;
+
+    auto unreadable = unreadableShards.find(key);
+    if (unreadable != unreadableShards.end() && unreadable->second == SettingsSnapshot::getShardFile(libRoot).getLastModificationTime())
+        return;
+
+    loadingShards.add(key);
+
+    juce::Component::SafePointer<MainComponent> safeThis(this);
+    JobSystem::getShared().run(JobSystem::Priority::interactive, [libRoot, safeThis]() {
+        auto shard = std::make_shared<LoadedShard>(readLibraryShard(libRoot));
+
+        juce::MessageManager::callAsync([safeThis, libRoot, shard]() {
+            if (safeThis != nullptr)
+                safeThis->applyLibraryShard(libRoot, *shard);
+        });
+    });
+}
+
+MainComponent::LoadedShard MainComponent::readLibraryShard(const juce::File& libRoot)
+{
+    LoadedShard shard;
+
+    const juce::File shardFile = SettingsSnapshot::getShardFile(libRoot);
+    if (!shardFile.existsAsFile()) {
+        shard.readable = true;
+        return shard;
+    }
+
+    shard.modificationTime = shardFile.getLastModificationTime();
+    juce::FileInputStream in(shardFile);
+    juce::var input = juce::JSON::parse(in);
+
+    juce::DynamicObject* obj = input.getDynamicObject();
+    if (in.failedToOpen() || obj == nullptr)
+        return shard;
+
+    shard.readable = true;
+    juce::var prop = obj->getProperty("audioFiles");
+    if (prop.isArray()) {
+        for (juce::var var : *prop.getArray()) {
+            AudioFile audioFile = AudioFile::fromVar(var);
+            if (!audioFile.hasRelPathToLib())
+                continue;
+
+            //the library may have been somewhere else when the shard was written
+            audioFile.setAbsPath(libRoot.getChildFile(audioFile.getRelPathToLib()).getFullPathName());
+            shard.audioFiles.push_back(std::move(audioFile));
         }
+    }
 
-        prop = obj->getProperty("currentFileBrowserPath");
-        if (prop != juce::var()) {
-            juce::File loadedRoot = juce::File(prop);
-            fileBrowser.setRoot(loadedRoot);
+    return shard;
+}
 
-            bool found = false;
-            for (auto libRoot : musicLibs) {
-                if (libRoot == loadedRoot) {
-                    found = true;
-                    break;
-                }
-            }
+void MainComponent::applyLibraryShard(const juce::File& libRoot, LoadedShard& shard)
+{
+    const juce::String key = libRoot.getFullPathName();
+    loadingShards.removeString(key);
+
+    //removed meanwhile
+    if (std::find(musicLibs.begin(), musicLibs.end(), libRoot) == musicLibs.end())
+        return;
+
+    //never overwrite a shard that couldn't be read, it might be written by a newer version or still be syncing
+    if (!shard.readable) {
+        unreadableShards[key] = shard.modificationTime;
+        return;
+    }
+    unreadableShards.erase(key);
+
+    PathTable& paths = PathTable::getShared();
+    const PathTable::Id rootId = paths.intern(key);
+
+    for (AudioFile& audioFile : shard.audioFiles) {
+        //records from the global file (written before shards existed) win, they move to the shard on the next save.
+        //the same relative path in another library is a different file
+        AudioFile* existing = allFiles.findByAbsPath(audioFile.absPathId);
+        if (existing == nullptr) {
+            AudioFile* sameRelPath = allFiles.findByRelPath(audioFile.relPathToLibId);
+            if (sameRelPath != nullptr && paths.isWithin(sameRelPath->absPathId, rootId))
+                existing = sameRelPath;
         }
 
-        prop = obj->getProperty("audioFiles");
-        if (prop != juce::var()) {
-            for (juce::var var : *prop.getArray()) {
-                AudioFile file = AudioFile::fromVar(var);
+        if (existing == nullptr) {
+            allFiles.add(std::move(audioFile));
+            continue;
+        }
 
-                allFiles.push_back(file);
-            }
+        //a record without settings was made while the shard loaded (e.g. the file was opened), the shard's settings apply to it
+        if (existing->hasCustomSetting(AudioFile::CustomSetting::None) && !audioFile.hasCustomSetting(AudioFile::CustomSetting::None)) {
+            existing->copySettingsFrom(audioFile);
+            allFiles.recordChanged(*existing);
+
+            if (!existing->fingerprint.computed && audioFile.fingerprint.computed)
+                allFiles.setFingerprint(*existing, audioFile.fingerprint);
+
+            if (existing == currentFile)
+                applyCurrentFileSettings();
         }
+    }
+
+    loadedShards.add(key);
+    fileBrowser.repaint();
+}
 
+void MainComponent::loadShardOfLibraryContaining(const juce::File& file)
+{
+    for (const juce::File& libRoot : musicLibs) {
+        if (file == libRoot || file.isAChildOf(libRoot)) {
+            loadLibraryShard(libRoot);
+            return;
+        }
     }
+}
 
-    musicLibChanged();
+void MainComponent::startupPhaseFinished(const juce::String& name)
+{
+    StartupTrace::mark(name);
 
+    if (--startupPhasesLeft == 0)
+        StartupTrace::writeTo(appDataDirectory.getChildFile("startupTrace.json"));
 }
 
 void MainComponent::initAudioSettings()
@@ -1330,28 +2109,214 @@ void MainComponent::initAudioSettings()
     auto settings = juce::XmlDocument::parse(audioDeviceSettings);
     setAudioChannels(0, 2, settings.get());
 
+    if (settings != nullptr) {
+        for (auto* calibration : settings->getChildWithTagNameIterator("CALIBRATION"))
+            bufferSizeCalibrations.addChildElement(new juce::XmlElement(*calibration));
+    }
+
+#if JUCE_LINUX
+    //ALSA and JACK just start with their default buffer size
+    applyBufferSizeCalibration();
+#else
+    //elsewhere the saved buffer size is used, only another device gets the calibrated one
+    if (auto* device = customDeviceManager.getCurrentAudioDevice())
+        calibrationDeviceKey = BufferSizeCalibrator::getDeviceKey(*device);
+#endif
+
+    //nothing plays right after the start
+    startAudioIdleTimer();
+}
+
+void MainComponent::applyBufferSizeCalibration()
+{
+    juce::AudioIODevice* device = customDeviceManager.getCurrentAudioDevice();
+    if (device == nullptr)
+        return;
+
+    calibrationDeviceKey = BufferSizeCalibrator::getDeviceKey(*device);
+    calibrationPending = false;
+
+    //0: calibrated, but no size was stable, the device keeps its own
+    const int calibrated = BufferSizeCalibrator::findBufferSize(bufferSizeCalibrations, *device);
+    if (calibrated != BufferSizeCalibrator::notCalibrated) {
+        if (calibrated > 0 && device->getCurrentBufferSizeSamples() != calibrated) {
+            auto setup = customDeviceManager.getAudioDeviceSetup();
+            setup.bufferSize = calibrated;
+            customDeviceManager.setAudioDeviceSetup(setup, true);
+        }
+        return;
+    }
+
+    //the calibration would be heard
+    if (state == Playing || state == Starting) {
+        calibrationPending = true;
+        return;
+    }
+
+    //first start on this device, calibrated while nothing plays. Pressing play cancels it
+    if (bufferSizeCalibrator == nullptr)
+        bufferSizeCalibrator = std::make_unique<BufferSizeCalibrator>(customDeviceManager);
+
+    bufferSizeCalibrator->onFinished = [this](int bufferSize) {
+        juce::AudioIODevice* calibratedDevice = customDeviceManager.getCurrentAudioDevice();
+        if (calibratedDevice == nullptr)
+            return;
+
+        BufferSizeCalibrator::storeBufferSize(bufferSizeCalibrations, *calibratedDevice, bufferSize);
+        saveAudioSettings();
+    };
+    bufferSizeCalibrator->start();
+}
+
+void MainComponent::audioDeviceChanged()
+{
+    //closed for the idle power mode, or no device at all
+    juce::AudioIODevice* device = customDeviceManager.getCurrentAudioDevice();
+    if (device == nullptr)
+        return;
+
+    //the same device: the calibrator's own steps, a buffer size chosen by the user or a restart after idling
+    if (BufferSizeCalibrator::getDeviceKey(*device) == calibrationDeviceKey)
+        return;
+
+    //calibrating the device that was replaced, its original setup isn't restored
+    if (bufferSizeCalibrator != nullptr)
+        bufferSizeCalibrator->abandon();
+
+    applyBufferSizeCalibration();
 }
 
+void MainComponent::setUpRealtimeAudioThread()
+{
+    //polled until the first callback of the device ran
+    const juce::Thread::ThreadID thread = audioThreadId.load(std::memory_order_relaxed);
+    if (thread == nullptr)
+        return;
+
+    //done again after every start of the device, even if the new thread got the id of the old one
+    realtimeSetupTimer.stopTimer();
+    const juce::Array<int> cores = RealtimeSupport::parseCores(realtimeCores);
+    RealtimeSupport::setRealtimePriority(thread, RealtimeSupport::audioPriority, "audio thread");
+    RealtimeSupport::pinToCores(thread, cores, "audio thread");
 
+    //the audio thread only plays what this one decoded, it mustn't be the one starved instead
+    if (const juce::Thread::ThreadID readAhead = readAheadThread.getThreadId()) {
+        RealtimeSupport::setRealtimePriority(readAhead, RealtimeSupport::readAheadPriority, "read ahead thread");
+        RealtimeSupport::pinToCores(readAhead, cores, "read ahead thread");
+    }
+    RealtimeSupport::writeTo(appDataDirectory.getChildFile("realtime.json"));
+}
+
+void MainComponent::lockAudioMemory(juce::AudioFormatReaderSource* source)
+{
+    if (source == readerSource.get())
+        cancelPriming();
+
+    if (auto* primed = dynamic_cast<PrimedAudioFormatReaderSource*>(source))
+        primed->lockInMemory();
+}
 
-void ControlButton::setImage(juce::Image& image)
+void MainComponent::startAudioIdleTimer()
 {
-    normalImage = image;
+    audioIdleTimer.stopTimer();
+    if (opensAudioDevice && audioIdleTimeout > 0 && state != Playing && state != Starting)
+        audioIdleTimer.startTimer(audioIdleTimeout * 1000);
+}
+
+void MainComponent::suspendAudioDevice()
+{
+    audioIdleTimer.stopTimer();
+    if (audioDeviceSuspended || state == Playing || state == Starting || deviceSelectorWindow.isVisible()
+        || customDeviceManager.getCurrentAudioDevice() == nullptr)
+        return;
+
+    if (bufferSizeCalibrator != nullptr && bufferSizeCalibrator->isRunning()) {
+        startAudioIdleTimer();
+        return;
+    }
+
+    //no callbacks at all instead of rendering silence
+    customDeviceManager.closeAudioDevice();
+    audioDeviceSuspended = true;
+
+    //the device is closed, so the source can be changed. Playing continues from memory until the decoder caught up again.
+    //Decoded in a job, which is cancelled before the device is opened again or the source replaced
+    if (auto* primed = dynamic_cast<PrimedAudioFormatReaderSource*>(readerSource.get())) {
+        const juce::int64 position = primed->getNextReadPosition();
+        const int numSamples = (int)(AudioPrefetcher::primedLength * primed->getAudioFormatReader()->sampleRate);
+        JobSystem::CancellationToken token = primeJobs;
+
+        JobSystem::getShared().run(JobSystem::Priority::prefetch, [primed, position, numSamples, token]() {
+            primed->primeRegion(position, numSamples, [&token]() { return token.isCancelled(); });
+        }, token);
+    }
+}
+
+void MainComponent::resumeAudioDevice()
+{
+    if (!audioDeviceSuspended)
+        return;
+
+    //the audio thread reads the primed regions, a prime still running stops after its current chunk
+    cancelPriming();
+
+    audioDeviceSuspended = false;
+    customDeviceManager.restartLastAudioDevice();
+}
+
+void MainComponent::reportUnderruns()
+{
+    //the read ahead thread fell behind while playing, e.g. a slow disk or a busy machine
+    if (auto* primed = dynamic_cast<PrimedAudioFormatReaderSource*>(readerSource.get())) {
+        const int numUnderruns = primed->getNumUnderruns();
+        if (numUnderruns > reportedUnderruns)
+            juce::Logger::writeToLog("audio: held " + juce::String(numUnderruns - reportedUnderruns) + " times until decoded, "
+                                     + readerSourceFile.getFullPathName());
+        reportedUnderruns = numUnderruns;
+    }
+}
+
+void MainComponent::cancelPriming()
+{
+    JobSystem::getShared().cancelAndWait(primeJobs);
+    primeJobs = {};
+}
+
+
+
+void ControlButton::setIcon(const Icon& newIcon)
+{
+    icon = &newIcon;
     resized();
 }
 
 void ControlButton::resized()
 {
+    //nothing to render before the first layout
+    if (icon == nullptr || getWidth() <= 0 || getHeight() <= 0)
+        return;
 
-    int size = juce::jmax(juce::jmin(getWidth(), getHeight()), 1);
-    juce::Image scaledImage = normalImage.rescaled(size, size, juce::Graphics::ResamplingQuality::highResamplingQuality);
+    //rendered for the physical pixels actually shown, every size only once per icon
+    float scale = juce::Component::getApproximateScaleFactorForComponent(this);
+    int size = juce::jmax(juce::roundToInt(juce::jmin(getWidth(), getHeight()) * scale), 1);
 
-    setImages(true, false, true,
-        scaledImage, 1, juce::Colours::transparentWhite,
-        scaledImage, 1, juce::Colours::white.withAlpha(0.1f),
-        scaledImage, 1, juce::Colours::white.withAlpha(0.3f));
+    if (size != renderedSize) {
+        renderedIcons.clear();
+        renderedSize = size;
+    }
 
+    juce::Image& image = renderedIcons[icon];
+    if (image.isNull()) {
+        image = juce::Image(juce::Image::ARGB, size, size, true);
+        juce::Graphics g(image);
+        g.addTransform(juce::AffineTransform::scale((float)size / iconSize));
+        (*icon)(g);
+    }
 
+    setImages(true, false, true,
+        image, 1, juce::Colours::transparentWhite,
+        image, 1, juce::Colours::white.withAlpha(0.1f),
+        image, 1, juce::Colours::white.withAlpha(0.3f));
 }
 
 
@@ -1512,4 +2477,10 @@ void SettingsViewContentComponent::initFlexBoxes()
         .withFlex(1, 1, 50)
     );
 
+    fb.items.add(juce::FlexItem(memoryLabel)
+        .withMargin(juce::FlexItem::Margin(0, 40, 20, 40))
+        .withMinHeight(80)
+        .withFlex(1, 1, 90)
+    );
+
 }
@@ -5,6 +5,18 @@
 #include "AudioFile.h"
 #include "OwnLookAndFeel.h"
 #include "mod_FileBrowserComponent.h"
+#include "SettingsAutoSaver.h"
+#include "LibraryScanner.h"
+#include "AudioFileIndex.h"
+#include "DirectoryWatcher.h"
+#include "AudioPrefetcher.h"
+#include "ReaderPool.h"
+#include "StartupTrace.h"
+#include "PlayheadClock.h"
+#include "GuiScheduler.h"
+#include "BufferSizeCalibrator.h"
+#include "RealtimeSupport.h"
+#include "MemoryBudget.h"
 
 
 
@@ -13,11 +25,10 @@
 class FileBrowserCompHelper 
 {
 public:
-    FileBrowserCompHelper() : thread("fileThread"),
+    FileBrowserCompHelper() :
         audioFileFilter("*.mp3;*.wav;*.flac;*.ogg;*.wmv;*.aif;*.aiff;*.asf;*.wma;*.wm;*.bwf", "*", "AudioFiles")
     {}
 
-    juce::TimeSliceThread thread;
     const juce::WildcardFileFilter audioFileFilter;
 };
 
@@ -50,8 +61,12 @@ public:
     ControlButton() {};
     ~ControlButton() {};
 
-    void setImage(juce::Image& image);
-    void resized();
+    //draws the icon into an area of iconSize x iconSize
+    using Icon = std::function<void(juce::Graphics&)>;
+    static constexpr int iconSize = 512;
+
+    void setIcon(const Icon& newIcon);
+    void resized() override;
 
     std::function< void()> onLeftClick;
     std::function< void()> onRightClick;
@@ -69,9 +84,9 @@ protected:
     }
 
 private:
-    juce::Image normalImage;
-    juce::Image overImage;
-    juce::Image downImage;
+    const Icon* icon = nullptr;
+    std::map<const Icon*, juce::Image> renderedIcons;
+    int renderedSize = 0;
 
 };
 
@@ -122,6 +137,11 @@ public:
         crossFadeUnitLabel.setFont(juce::Font(14));
         crossFadeUnitLabel.setInterceptsMouseClicks(false, false);
         addAndMakeVisible(crossFadeUnitLabel);
+
+        memoryLabel.setJustificationType(juce::Justification::topLeft);
+        memoryLabel.setFont(juce::Font(14));
+        memoryLabel.setInterceptsMouseClicks(false, false);
+        addAndMakeVisible(memoryLabel);
     }
     ~SettingsViewContentComponent() {};
 
@@ -141,6 +161,8 @@ public:
     juce::Label defaultCrossFadeLabel;
     juce::Label crossFadeUnitLabel;
 
+    juce::Label memoryLabel;    //usage of the caches, see MemoryBudget
+
 
     void resized() {
 
@@ -166,7 +188,7 @@ public:
 
         setContentComponent(&settingsViewContentComponent);
         setBackgroundColour(getLookAndFeel().findColour(juce::ResizableWindow::backgroundColourId));
-        setSize(550, 350);
+        setSize(550, 420);
         setResizable(false, false);
         setDraggable(true);
 
@@ -206,8 +228,32 @@ class MainComponent : public juce::AudioAppComponent,
 {
 public:
     //==============================================================================
+    /// <summary>
+    /// where the component keeps its files and what it starts by itself. Tools like the benchmarks
+    /// give it a temporary directory instead of the app's and drive it through the functions below.
+    /// </summary>
+    struct Options
+    {
+        juce::File settingsFile;
+        juce::File appDataDirectory;        //metadata and waveform caches, audio device settings, diagnostics
+        bool openAudioDevice = true;        //without device the owner pulls the audio callback itself
+        bool loadSettingsOnStart = true;    //otherwise they are only read by loadAllSettingsFromFile()
+
+        /// <summary>
+        /// settings next to the executable, everything else in the user's application data directory
+        /// </summary>
+        static Options forApp();
+    };
+
     MainComponent() ;
+    explicit MainComponent(const Options& options);
     ~MainComponent() override;
+
+    /// <summary>
+    /// called by the window, nothing periodic is refreshed while minimised
+    /// </summary>
+    void windowMinimised(bool isNowMinimised) { guiScheduler.setMinimised(isNowMinimised); }
+    bool isGuiActive() const { return guiScheduler.isActive(); }
     //==============================================================================
     void prepareToPlay(int samplesPerBlockExpected, double sampleRate) override;
     void getNextAudioBlock(const juce::AudioSourceChannelInfo& bufferToFill) override;
@@ -215,6 +261,37 @@ public:
     //==============================================================================
     void paint(juce::Graphics&) override;
     void resized() override;
+    //==============================================================================
+    bool isSettingsLoaded() const { return settingsLoaded; }
+    void loadAllSettingsFromFile();
+
+    //everything from the settings file, read on a worker thread so the window can show up meanwhile
+    struct LoadedSettings
+    {
+        juce::var volume;
+        juce::var defaultCrossFadeActive;
+        juce::var defaultCrossFadeLength;
+        juce::var audioIdleTimeout;
+        juce::var realtimeAudio;
+        juce::var realtimeCores;
+        juce::var memoryBudget;
+        juce::var currentFileBrowserPath;
+        std::vector<juce::File> musicLibs;
+        std::unique_ptr<AudioFileIndex> audioFiles;
+    };
+
+    static LoadedSettings readSettingsFile(const juce::File& file);
+
+    /// <summary>
+    /// the record with the settings of file, a new one if there is none yet
+    /// </summary>
+    AudioFile* findFileInAllFiles(const juce::File& file);
+    size_t getRecordsMemoryUsage() const { return allFiles.getMemoryUsage(); }
+
+    void openFile(const juce::File& file, bool startPlaying);
+    void stop() { changeState(Stopping); }
+    bool isStopped() const { return state == Stopped; }
+    int getMaxPooledReaders() const { return readerPool.getMaxEntries(); }
 
 
 
@@ -223,6 +300,10 @@ private:
     //==============================================================================
     // Your private member variables go here...
 
+    //from the Options, declared before the caches which live in appDataDirectory
+    const juce::File appDataDirectory;
+    const bool opensAudioDevice;
+
 
     ControlButton playButton;
     ControlButton stopButton;
@@ -248,6 +329,8 @@ private:
 
 
     TimeLine timeLine;
+    GuiScheduler guiScheduler;
+    void guiActiveChanged(bool active);
 
     enum TransportState
     {
@@ -258,7 +341,7 @@ private:
         Paused,
         Stopping
     };
-    TransportState state;
+    TransportState state = Stopped;
 
     enum Loopmode
     {
@@ -270,14 +353,29 @@ private:
     Loopmode loopmode;
 
 
+    //declared before all caches, so it outlives them
+    MemoryBudget memoryBudget;
+    void updateMemoryUsage();
+
+    //decodes ahead of the playing position, so the audio thread only copies from memory. Outlives the sources using it
+    juce::TimeSliceThread readAheadThread{ "Audio read ahead" };
+
     juce::AudioFormatManager formatManager;
+    FormatSniffer formatSniffer{ formatManager };
+    WaveformPyramid waveform{ formatSniffer, appDataDirectory.getChildFile("waveforms") };
     std::unique_ptr<juce::AudioFormatReaderSource> readerSource;
+    juce::File readerSourceFile;
+    ReaderPool::Identity readerSourceIdentity;
+    ReaderPool readerPool;
     juce::AudioTransportSource transportSource;
     juce::AudioSourceChannelInfo transitionChannelInfo;
     juce::AudioSampleBuffer transitionBuffer;
     double curSampleRate = 0;
     double curVolume=1;
 
+    PlayheadClock playheadClock;
+    double getAudiblePosition() const;
+
     double crossFade = 0;
     bool inTransition = false;
     double crossFadeProgress = 0;
@@ -304,9 +402,31 @@ private:
 
     FileBrowserComp fileBrowser{ &myLookAndFeel };
     std::vector<juce::File> musicLibs;
-    std::vector<AudioFile> allFiles;
+    AudioFileIndex allFiles;
     AudioFile* currentFile=nullptr;
 
+    std::unique_ptr<Fingerprinter> fingerprinter;
+    std::unique_ptr<AudioPrefetcher> prefetcher;
+    void prefetchFile(const juce::File& file, JobSystem::Priority priority = JobSystem::Priority::prefetch);
+    void requestFingerprint(const AudioFile& audioFile, const juce::File& file);
+    void fingerprintReady(const juce::File& file, const AudioFingerprint::Value& fingerprint);
+    //sameContent: the same samples, otherwise only similar. A known file that still exists can only be copied from
+    void askForSettingsOf(PathTable::Id newPath, PathTable::Id knownPath, bool sameContent, bool knownFileExists);
+    void fileMovedAnswered(int answer, PathTable::Id newPath, PathTable::Id knownPath);
+    void takeOverRecord(AudioFile& newRecord, AudioFile& known);
+
+    MetadataCache metadataCache{ appDataDirectory.getChildFile("metadataCache") };
+    SearchIndex searchIndex;
+    std::unique_ptr<LibraryScanner> libraryScanner;
+    void libraryScanFinished();
+    juce::String getAudioFileDetails(const juce::File& file);
+    std::vector<juce::mod::FileBrowserComponent::SearchResult> searchLibraries(const juce::String& query);
+    const int maxSearchResults = 500;
+
+    DirectoryWatcher directoryWatcher;
+    void filesChangedOnDisk(const std::vector<DirectoryWatcher::Event>& events);
+    void audioFileMoved(const juce::File& oldFile, const juce::File& newFile);
+
     void addMusicLib(const juce::String& libToAdd);
     void removeMusicLib(const juce::String& libToRemove);
     void musicLibChanged();
@@ -330,13 +450,13 @@ private:
     AudioDeviceSelectorWindow deviceSelectorWindow;
 
 
-    juce::Image playImage;
-    juce::Image pauseImage;
-    juce::Image stopImage;
-    juce::Image noLoopImage;
-    juce::Image wholeLoopImage;
-    juce::Image sectionLoopImage;
-    juce::Image settingsImage;
+    ControlButton::Icon playIcon;
+    ControlButton::Icon pauseIcon;
+    ControlButton::Icon stopIcon;
+    ControlButton::Icon noLoopIcon;
+    ControlButton::Icon wholeLoopIcon;
+    ControlButton::Icon sectionLoopIcon;
+    ControlButton::Icon settingsIcon;
 
     void playButtonClicked();
     void stopButtonClicked();
@@ -352,7 +472,7 @@ private:
     void onDefaultCrossFadeTextEditHide();
 
 
-    void createButtonImages();
+    void createButtonIcons();
     void volSliderValueChanged();
     void timeLineValueChanged(bool userChanged);
     void onCrossFadeCheckBoxChange();
@@ -360,10 +480,12 @@ private:
     void onCrossFadeTextEditHide(bool userChanged);
 
     void fileDoubleClicked(const juce::File& file);
-    void selectionChanged() {};
-    void fileClicked(const juce::File& file, const juce::MouseEvent& e) {};
+    void selectionChanged();
+    void fileClicked(const juce::File& file, const juce::MouseEvent& e);
     void browserRootChanged(const juce::File& newRoot);
-    AudioFile* findFileInAllFiles(const juce::File& file);
+    AudioFile* findKnownFile(const juce::File& file, const juce::String& relPath) const;
+    void askForSameLoopMarkers(const AudioFile& newRecord, const AudioFile& candidate, const juce::File& file);
+    void sameLoopMarkersAnswered(int answer, PathTable::Id newPath, PathTable::Id candidatePath, const juce::File& file);
     void setCrossFade(double time);
 
     void changeListenerCallback(juce::ChangeBroadcaster* source) override;
@@ -374,11 +496,84 @@ private:
     void initTimeLine();
     void updateTimeLine();
     void setLoopTimeStamps(double loopStart, double loopEnd);
-    void openFile(const juce::File& file);
+    void prefetchFinished(const juce::File& file, bool success);
+    void finishOpening(const juce::File& file, std::unique_ptr<juce::AudioFormatReaderSource> newSource);
+    juce::File pendingOpenFile;
+    bool pendingOpenStartsPlaying = false;
+    void applyCurrentFileSettings();
     void saveAllSettingsToFile();
-    void loadAllSettingsFromFile();
     void initAudioSettings();
 
+    //the device is closed after audioIdleTimeout secs without playing and opened again on play
+    int audioIdleTimeout = 60;  //0 keeps it open
+    bool audioDeviceSuspended = false;
+    juce::TimedCallback audioIdleTimer{ [this] { suspendAudioDevice(); } };
+    void startAudioIdleTimer();
+    void suspendAudioDevice();
+    void resumeAudioDevice();
+
+    //the source is primed in a job while the device is closed, it's cancelled before the source is played or replaced
+    JobSystem::CancellationToken primeJobs;
+    void cancelPriming();
+
+    //underruns of the read ahead are logged whenever playing stops
+    int reportedUnderruns = 0;
+    void reportUnderruns();
+
+    //smallest stable buffer size per device, found once per device by the calibrator and kept in audioDeviceSettings
+    juce::XmlElement bufferSizeCalibrations{ "CALIBRATIONS" };
+    std::unique_ptr<BufferSizeCalibrator> bufferSizeCalibrator;
+    void applyBufferSizeCalibration();
+    void audioDeviceChanged();
+    juce::String calibrationDeviceKey;      //device the calibration was applied to last, another one gets its own
+    bool calibrationPending = false;        //the device changed while playing, calibrated once stopped
+    void saveAudioSettings();
+
+    //opt-in, see RealtimeSupport. The audio thread only tells who it is, it's set up from the message thread
+    bool realtimeAudio = false;
+    juce::String realtimeCores;
+    std::atomic<juce::Thread::ThreadID> audioThreadId{ nullptr };
+    juce::TimedCallback realtimeSetupTimer{ [this] { setUpRealtimeAudioThread(); } };
+    void setUpRealtimeAudioThread();
+    void lockAudioMemory(juce::AudioFormatReaderSource* source);
+
+    void startLoadingSettings();
+    void applyLoadedSettings(LoadedSettings& loaded);
+
+    //settings of files inside a music library are kept in the library, read in the background when the library is first used
+    struct LoadedShard
+    {
+        bool readable = false;
+        juce::Time modificationTime;
+        std::vector<AudioFile> audioFiles;
+    };
+
+    void loadLibraryShard(const juce::File& libRoot);
+    void loadShardOfLibraryContaining(const juce::File& file);
+    static LoadedShard readLibraryShard(const juce::File& libRoot);
+    void applyLibraryShard(const juce::File& libRoot, LoadedShard& shard);
+    juce::StringArray loadedShards;
+    juce::StringArray loadingShards;
+    //shards which couldn't be read, with the modification time they had. Only read again once they changed
+    std::map<juce::String, juce::Time> unreadableShards;
+    bool settingsLoaded = false;
+
+    //startup trace gets written once the first frame is painted, the settings are applied and the device is open
+    void startupPhaseFinished(const juce::String& name);
+    int startupPhasesLeft = 3;
+    bool firstFrameTraced = false;
+
+    juce::File settingsFile;
+    std::unique_ptr<SettingsAutoSaver> settingsAutoSaver;
+    juce::uint32 settingsRevision = 0;
+    juce::uint32 savedSettingsRevision = 0;
+    juce::TimedCallback autoSaveTimer{ [this] { autoSaveIfChanged(); } };
+    const int autoSaveInterval = 10000; //ms
+
+    void settingsChanged();
+    void autoSaveIfChanged();
+    SettingsSnapshot createSettingsSnapshot();
+
     const double maxCrossFade = 20;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MainComponent)
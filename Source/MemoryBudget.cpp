@@ -0,0 +1,109 @@
+#include "MemoryBudget.h"
+
+MemoryBudget::Cache::~Cache()
+{
+    if (MemoryBudget* owner = budget.load())
+        owner->removeCache(*this);
+}
+
+void MemoryBudget::Cache::memoryUsageGrew()
+{
+    if (MemoryBudget* owner = budget.load())
+        owner->triggerAsyncUpdate();
+}
+
+//==============================================================================
+MemoryBudget::MemoryBudget(size_t budgetBytes) : budget(budgetBytes)
+{
+}
+
+MemoryBudget::~MemoryBudget()
+{
+    cancelPendingUpdate();
+
+    for (Registered& registered : caches)
+        registered.cache->budget = nullptr;
+}
+
+void MemoryBudget::addCache(Cache& cache, const juce::String& name, Priority priority)
+{
+    jassert(cache.budget == nullptr);
+
+    caches.push_back({ &cache, name, priority });
+    cache.budget = this;
+    triggerAsyncUpdate();
+}
+
+void MemoryBudget::removeCache(Cache& cache)
+{
+    cache.budget = nullptr;
+    caches.erase(std::remove_if(caches.begin(), caches.end(), [&cache](const Registered& registered) { return registered.cache == &cache; }),
+                 caches.end());
+}
+
+void MemoryBudget::setBudget(size_t bytes)
+{
+    budget = bytes;
+    enforce();
+}
+
+std::vector<MemoryBudget::Usage> MemoryBudget::getUsage() const
+{
+    std::vector<Usage> usage;
+    for (const Registered& registered : caches)
+        usage.push_back({ registered.name, registered.priority, registered.cache->getMemoryUsage() });
+    return usage;
+}
+
+size_t MemoryBudget::getTotalUsage() const
+{
+    size_t total = 0;
+    for (const Registered& registered : caches)
+        total += registered.cache->getMemoryUsage();
+    return total;
+}
+
+void MemoryBudget::enforce()
+{
+    size_t total = getTotalUsage();
+
+    if (total > budget) {
+        struct Candidate
+        {
+            Cache* cache;
+            Priority priority;
+            Entry entry;
+
+            double getBenefitPerByte() const { return entry.benefit / (double)juce::jmax((size_t)1, entry.bytes); }
+        };
+
+        std::vector<Candidate> candidates;
+        for (const Registered& registered : caches) {
+            for (const Entry& entry : registered.cache->getEvictableEntries())
+                candidates.push_back({ registered.cache, registered.priority, entry });
+        }
+
+        //least important caches first, within a priority what's worth least for the memory it takes
+        std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+            if (a.priority != b.priority)
+                return a.priority > b.priority;
+            return a.getBenefitPerByte() < b.getBenefitPerByte();
+        });
+
+        for (const Candidate& candidate : candidates) {
+            if (total <= budget)
+                break;
+
+            candidate.cache->evict(candidate.entry.id);
+            total -= juce::jmin(total, candidate.entry.bytes);
+        }
+    }
+
+    if (onUsageChecked)
+        onUsageChecked();
+}
+
+void MemoryBudget::handleAsyncUpdate()
+{
+    enforce();
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+
+/// <summary>
+/// Keeps the memory held by all caches of the app within one budget, so it stays bounded on small machines.
+/// Caches report how many bytes they hold and offer the entries they could drop, each with the bytes it frees
+/// and what keeping it is worth. When the total is over the budget, entries of the least important caches
+/// are evicted first, and within the same priority the ones worth least per byte. Caches which can't drop anything
+/// still count towards the total, so the others shrink to make room for them.
+/// Only used on the message thread, except Cache::memoryUsageGrew().
+/// </summary>
+class MemoryBudget : private juce::AsyncUpdater
+{
+public:
+    //most important first, evicted last
+    enum class Priority
+    {
+        index,      //metadata and paths, browsing and searching need them
+        display,    //what the waveform of the file shown needs, decoded again in the background when dropped
+        recent      //readers of recently played files, switching back to one is instant
+    };
+
+    struct Entry
+    {
+        juce::int64 id = 0;         //passed back to Cache::evict
+        size_t bytes = 0;           //what keeping it costs
+        double benefit = 0;         //what keeping it is worth, 0 to 1, e.g. how likely it's used again
+    };
+
+    /// <summary>
+    /// a cache whose memory counts towards the budget. getMemoryUsage, getEvictableEntries and evict are called on the message thread,
+    /// caches used on other threads have to lock themselves.
+    /// </summary>
+    class Cache
+    {
+    public:
+        virtual ~Cache();
+
+        virtual size_t getMemoryUsage() const = 0;
+
+        /// <summary>
+        /// what could be dropped right now. Whatever is in use (e.g. the file playing) is not offered.
+        /// </summary>
+        virtual std::vector<Entry> getEvictableEntries() const { return {}; }
+        virtual void evict(juce::int64 /*id*/) {}
+
+    protected:
+        /// <summary>
+        /// makes the budget check the total soon, can be called from any thread
+        /// </summary>
+        void memoryUsageGrew();
+
+    private:
+        friend class MemoryBudget;
+        std::atomic<MemoryBudget*> budget{ nullptr };
+    };
+
+    struct Usage
+    {
+        juce::String name;
+        Priority priority;
+        size_t bytes;
+    };
+
+    static constexpr size_t defaultBudget = (size_t)256 << 20;
+
+    explicit MemoryBudget(size_t budgetBytes = defaultBudget);
+    ~MemoryBudget() override;
+
+    /// <summary>
+    /// caches unregister themselves when they are destroyed. Caches living longer than the budget (like the PathTable) are let go by it.
+    /// </summary>
+    void addCache(Cache& cache, const juce::String& name, Priority priority);
+    void removeCache(Cache& cache);
+
+    void setBudget(size_t bytes);
+    size_t getBudget() const { return budget; }
+
+    /// <summary>
+    /// what every cache holds, in the order they were added
+    /// </summary>
+    std::vector<Usage> getUsage() const;
+    size_t getTotalUsage() const;
+
+    /// <summary>
+    /// evicts entries until the total fits the budget or nothing more can be evicted
+    /// </summary>
+    void enforce();
+
+    //called after every check, e.g. for showing the usage
+    std::function<void()> onUsageChecked;
+
+private:
+    void handleAsyncUpdate() override;
+
+    struct Registered
+    {
+        Cache* cache;
+        juce::String name;
+        Priority priority;
+    };
+
+    size_t budget;
+    std::vector<Registered> caches;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MemoryBudget)
+};
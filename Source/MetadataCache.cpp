@@ -0,0 +1,371 @@
+#include "MetadataCache.h"
+
+juce::var AudioFileMetadata::toVar() const
+{
+    juce::DynamicObject* obj = new juce::DynamicObject();
+    obj->setProperty("relPath", relPath);
+    obj->setProperty("size", size);
+    obj->setProperty("modificationTime", modificationTime);
+    obj->setProperty("length", length);
+    obj->setProperty("sampleRate", sampleRate);
+    obj->setProperty("lengthInSamples", lengthInSamples);
+    obj->setProperty("numChannels", numChannels);
+    obj->setProperty("format", formatName);
+
+    if (tags.size() > 0) {
+        juce::DynamicObject* tagObj = new juce::DynamicObject();
+        for (int i = 0; i < tags.size(); i++) {
+            tagObj->setProperty(tags.getAllKeys()[i], tags.getAllValues()[i]);
+        }
+        obj->setProperty("tags", juce::var(tagObj));
+    }
+
+    return juce::var(obj);
+}
+
+AudioFileMetadata AudioFileMetadata::fromVar(const juce::var& var)
+{
+    AudioFileMetadata metadata;
+    metadata.relPath = var.getProperty("relPath", "");
+    metadata.size = var.getProperty("size", 0);
+    metadata.modificationTime = var.getProperty("modificationTime", 0);
+    metadata.length = var.getProperty("length", 0);
+    metadata.sampleRate = var.getProperty("sampleRate", 0);
+    metadata.lengthInSamples = var.getProperty("lengthInSamples", 0);
+    metadata.numChannels = var.getProperty("numChannels", 0);
+    metadata.formatName = var.getProperty("format", "");
+
+    if (auto* tagObj = var.getProperty("tags", juce::var()).getDynamicObject()) {
+        for (auto& prop : tagObj->getProperties()) {
+            metadata.tags.set(prop.name.toString(), prop.value.toString());
+        }
+    }
+
+    return metadata;
+}
+
+size_t AudioFileMetadata::getMemoryUsage() const
+{
+    //juce::String keeps the UTF-8 bytes behind a small header, empty strings share one
+    auto stringBytes = [](const juce::String& s) { return s.isEmpty() ? (size_t)0 : s.getNumBytesAsUTF8() + 1 + 16; };
+
+    size_t bytes = sizeof(AudioFileMetadata) + stringBytes(relPath) + stringBytes(formatName);
+    for (int i = 0; i < tags.size(); i++)
+        bytes += 2 * sizeof(juce::String) + stringBytes(tags.getAllKeys()[i]) + stringBytes(tags.getAllValues()[i]);
+    return bytes;
+}
+
+
+MetadataCache::MetadataCache(const juce::File& cacheDirectory) : directory(cacheDirectory)
+{
+}
+
+void MetadataCache::setLibraries(const std::vector<juce::File>& libRoots)
+{
+    const juce::ScopedLock sl(lock);
+
+    for (const juce::File& root : libRoots) {
+        if (findLibrary(root) == nullptr) {
+            auto lib = std::make_unique<Library>();
+            lib->root = root;
+            libraries.push_back(std::move(lib));
+        }
+    }
+}
+
+void MetadataCache::loadLibrary(const juce::File& libRoot)
+{
+    {
+        const juce::ScopedLock sl(lock);
+        const Library* lib = findLibrary(libRoot);
+        if (lib == nullptr || lib->loaded)
+            return;
+    }
+
+    //parsed without holding the lock, lookups of other libraries go on meanwhile
+    std::vector<AudioFileMetadata> loaded;
+    juce::File cacheFile = getCacheFileFor(libRoot);
+    if (cacheFile.existsAsFile()) {
+        juce::var input = juce::JSON::parse(cacheFile);
+
+        //hash collision or stale file
+        if (input.getProperty("libPath", "").toString() == libRoot.getFullPathName()) {
+            if (auto* entries = input.getProperty("entries", juce::var()).getArray()) {
+                for (auto& var : *entries)
+                    loaded.push_back(AudioFileMetadata::fromVar(var));
+            }
+        }
+    }
+
+    {
+        const juce::ScopedLock sl(lock);
+        Library* lib = findLibrary(libRoot);
+        if (lib == nullptr || lib->loaded)
+            return;
+
+        lib->loaded = true;
+        for (AudioFileMetadata& metadata : loaded) {
+            juce::String key = metadata.relPath;
+            const size_t bytes = getEntryBytes(metadata);
+            if (lib->entries.emplace(key, std::move(metadata)).second)
+                entryBytes += bytes;
+        }
+    }
+
+    memoryUsageGrew();
+}
+
+std::optional<AudioFileMetadata> MetadataCache::find(const juce::File& file, bool validate) const
+{
+    const juce::ScopedLock sl(lock);
+
+    juce::String relPath;
+    const Library* lib = findLibraryContaining(file, relPath);
+    if (lib == nullptr)
+        return {};
+
+    auto it = lib->entries.find(relPath);
+    if (it == lib->entries.end())
+        return {};
+
+    if (validate && !it->second.matches(file.getSize(), file.getLastModificationTime().toMilliseconds()))
+        return {};
+
+    return it->second;
+}
+
+std::optional<AudioFileMetadata> MetadataCache::find(const juce::File& libRoot, const juce::String& relPath) const
+{
+    const juce::ScopedLock sl(lock);
+
+    if (const Library* lib = findLibrary(libRoot)) {
+        auto it = lib->entries.find(relPath);
+        if (it != lib->entries.end())
+            return it->second;
+    }
+    return {};
+}
+
+bool MetadataCache::isUpToDate(const juce::File& libRoot, const juce::String& relPath, juce::int64 size, juce::int64 modificationTime) const
+{
+    const juce::ScopedLock sl(lock);
+
+    if (const Library* lib = findLibrary(libRoot)) {
+        auto it = lib->entries.find(relPath);
+        return it != lib->entries.end() && it->second.matches(size, modificationTime);
+    }
+    return false;
+}
+
+void MetadataCache::store(const juce::File& libRoot, AudioFileMetadata&& metadata)
+{
+    const juce::ScopedLock sl(lock);
+
+    if (Library* lib = findLibrary(libRoot)) {
+        juce::String key = metadata.relPath;
+        entryBytes += getEntryBytes(metadata);
+
+        auto [it, inserted] = lib->entries.try_emplace(key);
+        if (!inserted)
+            entryBytes -= getEntryBytes(it->second);
+        it->second = std::move(metadata);
+        lib->dirty = true;
+    }
+}
+
+void MetadataCache::removeAllExcept(const juce::File& libRoot, const std::unordered_set<juce::String, StringHash>& stillExisting)
+{
+    const juce::ScopedLock sl(lock);
+
+    if (Library* lib = findLibrary(libRoot)) {
+        for (auto it = lib->entries.begin(); it != lib->entries.end();) {
+            if (stillExisting.count(it->first) == 0) {
+                entryBytes -= getEntryBytes(it->second);
+                it = lib->entries.erase(it);
+                lib->dirty = true;
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+}
+
+void MetadataCache::fileRenamed(const juce::File& oldFile, const juce::File& newFile)
+{
+    const juce::ScopedLock sl(lock);
+
+    juce::String oldRelPath, newRelPath;
+    Library* oldLib = findLibraryContaining(oldFile, oldRelPath);
+    Library* newLib = findLibraryContaining(newFile, newRelPath);
+    if (oldLib == nullptr)
+        return;
+
+    //a directory takes all entries below it along
+    const juce::String oldPrefix = oldRelPath + juce::File::getSeparatorString();
+
+    std::vector<AudioFileMetadata> moved;
+    for (auto it = oldLib->entries.begin(); it != oldLib->entries.end();) {
+        if (it->first == oldRelPath || it->first.startsWith(oldPrefix)) {
+            entryBytes -= getEntryBytes(it->second);
+            moved.push_back(std::move(it->second));
+            it = oldLib->entries.erase(it);
+            oldLib->dirty = true;
+        }
+        else {
+            ++it;
+        }
+    }
+
+    //moved out of all libraries
+    if (newLib == nullptr)
+        return;
+
+    for (AudioFileMetadata& metadata : moved) {
+        metadata.relPath = newRelPath + metadata.relPath.substring(oldRelPath.length());
+        juce::String key = metadata.relPath;
+        entryBytes += getEntryBytes(metadata);
+
+        auto [it, inserted] = newLib->entries.try_emplace(key);
+        if (!inserted)
+            entryBytes -= getEntryBytes(it->second);
+        it->second = std::move(metadata);
+    }
+    newLib->dirty = true;
+}
+
+void MetadataCache::fileRemoved(const juce::File& file)
+{
+    const juce::ScopedLock sl(lock);
+
+    juce::String relPath;
+    Library* lib = findLibraryContaining(file, relPath);
+    if (lib == nullptr)
+        return;
+
+    const juce::String prefix = relPath + juce::File::getSeparatorString();
+
+    for (auto it = lib->entries.begin(); it != lib->entries.end();) {
+        if (it->first == relPath || it->first.startsWith(prefix)) {
+            entryBytes -= getEntryBytes(it->second);
+            it = lib->entries.erase(it);
+            lib->dirty = true;
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+bool MetadataCache::save(const juce::File& libRoot)
+{
+    //only copied under the lock, lookups for painting the browser go on while it's serialised
+    std::vector<AudioFileMetadata> copied;
+    {
+        const juce::ScopedLock sl(lock);
+
+        Library* lib = findLibrary(libRoot);
+        if (lib == nullptr || !lib->dirty)
+            return true;
+
+        copied.reserve(lib->entries.size());
+        for (auto& entry : lib->entries)
+            copied.push_back(entry.second);
+        lib->dirty = false;
+    }
+
+    //saved after every scan, which is when the entries grow
+    memoryUsageGrew();
+
+    juce::DynamicObject* obj = new juce::DynamicObject();
+    juce::var var(obj);
+    obj->setProperty("libPath", libRoot.getFullPathName());
+
+    juce::var entries;
+    entries.resize((int)copied.size());
+    for (size_t i = 0; i < copied.size(); ++i)
+        entries[(int)i] = copied[i].toVar();
+    obj->setProperty("entries", entries);
+
+    //written next to it and moved over, a crash never leaves a truncated cache file
+    juce::File cacheFile = getCacheFileFor(libRoot);
+    cacheFile.getParentDirectory().createDirectory();
+    juce::TemporaryFile temp(cacheFile);
+    if (!temp.getFile().replaceWithText(juce::JSON::toString(var, true)) || !temp.overwriteTargetFileWithTemporary()) {
+        //written again with the next save
+        const juce::ScopedLock sl(lock);
+        if (Library* lib = findLibrary(libRoot))
+            lib->dirty = true;
+        return false;
+    }
+    return true;
+}
+
+void MetadataCache::saveAll()
+{
+    std::vector<juce::File> roots;
+    {
+        const juce::ScopedLock sl(lock);
+        for (auto& lib : libraries)
+            roots.push_back(lib->root);
+    }
+
+    for (auto& root : roots)
+        save(root);
+}
+
+int MetadataCache::getNumEntries() const
+{
+    const juce::ScopedLock sl(lock);
+
+    int n = 0;
+    for (auto& lib : libraries)
+        n += (int)lib->entries.size();
+    return n;
+}
+
+size_t MetadataCache::getMemoryUsage() const
+{
+    const juce::ScopedLock sl(lock);
+
+    //only the bucket arrays are summed up here, the entries are counted as they change
+    size_t bytes = entryBytes;
+    for (auto& lib : libraries)
+        bytes += lib->entries.bucket_count() * sizeof(void*);
+    return bytes;
+}
+
+MetadataCache::Library* MetadataCache::findLibrary(const juce::File& libRoot)
+{
+    for (auto& lib : libraries) {
+        if (lib->root == libRoot)
+            return lib.get();
+    }
+    return nullptr;
+}
+
+const MetadataCache::Library* MetadataCache::findLibrary(const juce::File& libRoot) const
+{
+    return const_cast<MetadataCache*>(this)->findLibrary(libRoot);
+}
+
+const MetadataCache::Library* MetadataCache::findLibraryContaining(const juce::File& file, juce::String& relPath) const
+{
+    return const_cast<MetadataCache*>(this)->findLibraryContaining(file, relPath);
+}
+
+MetadataCache::Library* MetadataCache::findLibraryContaining(const juce::File& file, juce::String& relPath)
+{
+    for (auto& lib : libraries) {
+        if (file.isAChildOf(lib->root)) {
+            relPath = file.getRelativePathFrom(lib->root);
+            return lib.get();
+        }
+    }
+    return nullptr;
+}
+
+juce::File MetadataCache::getCacheFileFor(const juce::File& libRoot) const
+{
+    return directory.getChildFile(juce::String::toHexString(libRoot.getFullPathName().hashCode64()) + ".json");
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "AudioFile.h"
+#include "MemoryBudget.h"
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+
+
+/// <summary>
+/// Header informations of a file inside a music library. Stored relative to the library root,
+/// size and modification time tell whether the entry is still valid.
+/// </summary>
+struct AudioFileMetadata
+{
+    juce::String relPath;
+    juce::int64 size = 0;
+    juce::int64 modificationTime = 0; //ms since epoch
+
+    double length = 0; //secs
+    double sampleRate = 0;
+    juce::int64 lengthInSamples = 0;
+    int numChannels = 0;
+    juce::String formatName;
+    juce::StringPairArray tags;
+
+    bool matches(juce::int64 fileSize, juce::int64 fileModificationTime) const {
+        return size == fileSize && modificationTime == fileModificationTime;
+    }
+
+    juce::var toVar() const;
+    static AudioFileMetadata fromVar(const juce::var& var);
+
+    //estimated
+    size_t getMemoryUsage() const;
+};
+
+
+/// <summary>
+/// On disk cache of AudioFileMetadata, one json file per music library.
+/// All functions are thread safe.
+/// </summary>
+class MetadataCache : public MemoryBudget::Cache
+{
+public:
+    MetadataCache(const juce::File& cacheDirectory);
+
+    /// <summary>
+    /// makes the cache know these libraries. Their cache files are read by loadLibrary
+    /// </summary>
+    void setLibraries(const std::vector<juce::File>& libRoots);
+
+    /// <summary>
+    /// reads the cache file of a library given to setLibraries, if that wasn't done yet. Parses the whole file,
+    /// so it's called from the scan jobs. Entries stored before are newer and stay.
+    /// </summary>
+    void loadLibrary(const juce::File& libRoot);
+
+    /// <summary>
+    /// looks up a file in every known library.
+    /// </summary>
+    /// <param name="file">the file to look up</param>
+    /// <param name="validate">if true the entry is only returned if size and modification time still match</param>
+    std::optional<AudioFileMetadata> find(const juce::File& file, bool validate = true) const;
+    std::optional<AudioFileMetadata> find(const juce::File& libRoot, const juce::String& relPath) const;
+
+    bool isUpToDate(const juce::File& libRoot, const juce::String& relPath, juce::int64 size, juce::int64 modificationTime) const;
+    void store(const juce::File& libRoot, AudioFileMetadata&& metadata);
+
+    /// <summary>
+    /// removes all entries of a library whose relative path is not in stillExisting
+    /// </summary>
+    void removeAllExcept(const juce::File& libRoot, const std::unordered_set<juce::String, StringHash>& stillExisting);
+
+    /// <summary>
+    /// moves the entries of a renamed file or directory to the new path, entries are kept as they are
+    /// since renaming changes neither size nor modification time
+    /// </summary>
+    void fileRenamed(const juce::File& oldFile, const juce::File& newFile);
+
+    /// <summary>
+    /// removes the entry of a deleted file or the entries of everything inside a deleted directory
+    /// </summary>
+    void fileRemoved(const juce::File& file);
+
+    /// <summary>
+    /// writes the cache file of a library if something changed. Lookups are only blocked while the entries are copied
+    /// </summary>
+    bool save(const juce::File& libRoot);
+    void saveAll();
+
+    int getNumEntries() const;
+
+    /// <summary>
+    /// estimated, every library is kept in memory as a whole, so nothing can be evicted
+    /// </summary>
+    size_t getMemoryUsage() const override;
+
+private:
+    struct Library
+    {
+        juce::File root;
+        std::unordered_map<juce::String, AudioFileMetadata, StringHash> entries;
+        bool dirty = false;
+        bool loaded = false;
+    };
+
+    Library* findLibrary(const juce::File& libRoot);
+    const Library* findLibrary(const juce::File& libRoot) const;
+    const Library* findLibraryContaining(const juce::File& file, juce::String& relPath) const;
+    Library* findLibraryContaining(const juce::File& file, juce::String& relPath);
+    juce::File getCacheFileFor(const juce::File& libRoot) const;
+
+    //key and next pointer of the node, plus the entry
+    static size_t getEntryBytes(const AudioFileMetadata& metadata) { return sizeof(juce::String) + sizeof(void*) + metadata.getMemoryUsage(); }
+
+    const juce::File directory;
+    std::vector<std::unique_ptr<Library>> libraries;
+    size_t entryBytes = 0;  //of all entries, kept up to date on every change so checking the budget doesn't walk them
+    juce::CriticalSection lock;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MetadataCache)
+};
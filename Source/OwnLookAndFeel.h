@@ -43,6 +43,22 @@ public:
     
     };
 
+    void drawFileBrowserRow(juce::Graphics& g, int width, int height,
+                            const juce::File& file, const juce::String& filename, juce::Image* icon,
+                            const juce::String& fileSizeDescription, const juce::String& fileTimeDescription,
+                            bool isDirectory, bool isItemSelected, int itemIndex,
+                            juce::DirectoryContentsDisplayComponent& dcc) override
+    {
+        //audio files show their length etc. instead of the file size, if known
+        juce::String details = (!isDirectory && getAudioFileDetails) ? getAudioFileDetails(file) : juce::String();
+
+        juce::LookAndFeel_V4::drawFileBrowserRow(g, width, height, file, filename, icon,
+                                                 details.isNotEmpty() ? details : fileSizeDescription, fileTimeDescription,
+                                                 isDirectory, isItemSelected, itemIndex, dcc);
+    }
+
+    std::function<juce::String(const juce::File&)> getAudioFileDetails;
+
 private:
     juce::Path createMusicLibShape() {
 
@@ -0,0 +1,376 @@
+#include "ParallelFlacDecoder.h"
+#include "AsyncFileReader.h"
+
+namespace
+{
+    constexpr int streamInfoSize = 34;
+    constexpr int maxFrameHeaderSize = 16;
+    constexpr int minPartSamples = 1 << 16;
+    constexpr int chunkSamples = 1 << 16;
+
+    juce::uint8 crc8(const juce::uint8* data, int numBytes)
+    {
+        juce::uint8 crc = 0;
+        for (int i = 0; i < numBytes; ++i) {
+            crc ^= data[i];
+            for (int bit = 0; bit < 8; ++bit)
+                crc = (juce::uint8)((crc & 0x80) != 0 ? (crc << 1) ^ 0x07 : crc << 1);
+        }
+        return crc;
+    }
+
+    struct FrameHeader
+    {
+        int length = 0;
+        bool variableBlockSize = false;
+        juce::uint64 number = 0;    //frame number, or the first sample for variable block sizes
+        int blockSize = 0;
+    };
+
+    //parses the frame header starting at data, length is 0 if there is none
+    FrameHeader parseFrameHeader(const juce::uint8* data, size_t available)
+    {
+        if (available < 6 || data[0] != 0xFF || (data[1] & 0xFE) != 0xF8)
+            return {};
+
+        const int blockSizeCode = data[2] >> 4;
+        const int sampleRateCode = data[2] & 0x0F;
+        const int channelCode = data[3] >> 4;
+        const int sampleSizeCode = (data[3] >> 1) & 0x07;
+        if (blockSizeCode == 0 || sampleRateCode == 0x0F || channelCode > 10 || sampleSizeCode == 3 || (data[3] & 1) != 0)
+            return {};
+
+        FrameHeader parsed;
+        parsed.variableBlockSize = (data[1] & 1) != 0;
+
+        //utf-8 like coded number
+        const juce::uint8 first = data[4];
+        int extra;
+        if ((first & 0x80) == 0)            { parsed.number = first;        extra = 0; }
+        else if ((first & 0xE0) == 0xC0)    { parsed.number = first & 0x1F; extra = 1; }
+        else if ((first & 0xF0) == 0xE0)    { parsed.number = first & 0x0F; extra = 2; }
+        else if ((first & 0xF8) == 0xF0)    { parsed.number = first & 0x07; extra = 3; }
+        else if ((first & 0xFC) == 0xF8)    { parsed.number = first & 0x03; extra = 4; }
+        else if ((first & 0xFE) == 0xFC)    { parsed.number = first & 0x01; extra = 5; }
+        else if (first == 0xFE && parsed.variableBlockSize) { parsed.number = 0; extra = 6; }
+        else return {};
+
+        size_t pos = 5;
+        for (int i = 0; i < extra; ++i, ++pos) {
+            if (pos >= available || (data[pos] & 0xC0) != 0x80)
+                return {};
+            parsed.number = (parsed.number << 6) | (data[pos] & 0x3F);
+        }
+
+        if (blockSizeCode == 1) {
+            parsed.blockSize = 192;
+        }
+        else if (blockSizeCode <= 5) {
+            parsed.blockSize = 576 << (blockSizeCode - 2);
+        }
+        else if (blockSizeCode == 6) {
+            if (pos >= available)
+                return {};
+            parsed.blockSize = data[pos] + 1;
+            pos += 1;
+        }
+        else if (blockSizeCode == 7) {
+            if (pos + 1 >= available)
+                return {};
+            parsed.blockSize = (data[pos] << 8 | data[pos + 1]) + 1;
+            pos += 2;
+        }
+        else {
+            parsed.blockSize = 256 << (blockSizeCode - 8);
+        }
+
+        if (sampleRateCode == 12)
+            pos += 1;
+        else if (sampleRateCode == 13 || sampleRateCode == 14)
+            pos += 2;
+
+        if (pos >= available || crc8(data, (int)pos) != data[pos])
+            return {};
+
+        parsed.length = (int)pos + 1;
+        return parsed;
+    }
+
+    /// <summary>
+    /// the header of a FLAC stream followed by the file from the offset of one of its frames, which the FLAC reader takes for a whole stream
+    /// </summary>
+    class SplicedInputStream : public juce::InputStream
+    {
+    public:
+        SplicedInputStream(juce::MemoryBlock header_, std::unique_ptr<juce::InputStream> file_, juce::int64 frameOffset_)
+            : header(std::move(header_)), file(std::move(file_)), frameOffset(frameOffset_)
+        {
+        }
+
+        juce::int64 getTotalLength() override { return (juce::int64)header.getSize() + file->getTotalLength() - frameOffset; }
+        bool isExhausted() override { return position >= getTotalLength(); }
+        juce::int64 getPosition() override { return position; }
+
+        bool setPosition(juce::int64 newPosition) override
+        {
+            position = juce::jlimit((juce::int64)0, getTotalLength(), newPosition);
+            return true;
+        }
+
+        int read(void* destBuffer, int maxBytesToRead) override
+        {
+            auto* dest = static_cast<char*>(destBuffer);
+            int total = 0;
+            const auto headerSize = (juce::int64)header.getSize();
+
+            if (position < headerSize) {
+                total = (int)juce::jmin((juce::int64)maxBytesToRead, headerSize - position);
+                header.copyTo(dest, (int)position, (size_t)total);
+                position += total;
+            }
+
+            if (total < maxBytesToRead) {
+                const juce::int64 filePosition = frameOffset + position - headerSize;
+                if (file->getPosition() != filePosition)
+                    file->setPosition(filePosition);
+
+                const int numRead = file->read(dest + total, maxBytesToRead - total);
+                if (numRead > 0) {
+                    total += numRead;
+                    position += numRead;
+                }
+            }
+
+            return total;
+        }
+
+    private:
+        const juce::MemoryBlock header;
+        std::unique_ptr<juce::InputStream> file;
+        const juce::int64 frameOffset;
+        juce::int64 position = 0;
+    };
+}
+
+std::unique_ptr<ParallelFlacDecoder> ParallelFlacDecoder::open(const juce::File& file, FormatSniffer& sniffer, const std::function<bool()>& shouldCancel)
+{
+    juce::AudioFormat* format = sniffer.getFormat(FormatSniffer::Container::flac);
+    if (format == nullptr || sniffer.findFormatFor(file) != format)
+        return nullptr;
+
+    std::unique_ptr<juce::InputStream> in = AsyncFileReader::getShared().createInputStream(file);
+    if (in == nullptr)
+        return nullptr;
+
+    std::unique_ptr<ParallelFlacDecoder> decoder(new ParallelFlacDecoder());
+    decoder->file = file;
+    decoder->format = format;
+
+    char magic[4];
+    if (in->read(magic, 4) != 4 || memcmp(magic, "fLaC", 4) != 0)
+        return nullptr;
+
+    //metadata blocks, only the stream info is kept
+    juce::uint8 streamInfo[streamInfoSize];
+    bool hasStreamInfo = false;
+    for (bool last = false; !last;) {
+        juce::uint8 blockHeader[4];
+        if (in->read(blockHeader, 4) != 4)
+            return nullptr;
+
+        last = (blockHeader[0] & 0x80) != 0;
+        const int type = blockHeader[0] & 0x7F;
+        const int length = blockHeader[1] << 16 | blockHeader[2] << 8 | blockHeader[3];
+
+        if (type == 0 && length >= streamInfoSize) {
+            if (in->read(streamInfo, streamInfoSize) != streamInfoSize)
+                return nullptr;
+            in->setPosition(in->getPosition() + length - streamInfoSize);
+            hasStreamInfo = true;
+        }
+        else {
+            //pictures can be large, they are skipped without reading them
+            in->setPosition(in->getPosition() + length);
+        }
+    }
+    if (!hasStreamInfo)
+        return nullptr;
+
+    const int minFrameSize = streamInfo[4] << 16 | streamInfo[5] << 8 | streamInfo[6];
+    decoder->sampleRate = (double)(streamInfo[10] << 12 | streamInfo[11] << 4 | streamInfo[12] >> 4);
+    decoder->numChannels = ((streamInfo[12] >> 1) & 0x07) + 1;
+    decoder->numSamples = (juce::int64)(streamInfo[13] & 0x0F) << 32 | (juce::int64)streamInfo[14] << 24
+        | (juce::int64)streamInfo[15] << 16 | (juce::int64)streamInfo[16] << 8 | (juce::int64)streamInfo[17];
+
+    //without the length the reader would decode the whole stream to find it, every time
+    if (decoder->numSamples <= 0 || decoder->sampleRate <= 0)
+        return nullptr;
+
+    const juce::uint8 streamInfoHeader[] = { 0x80, 0, 0, (juce::uint8)streamInfoSize };
+    decoder->header.append("fLaC", 4);
+    decoder->header.append(streamInfoHeader, sizeof(streamInfoHeader));
+    decoder->header.append(streamInfo, streamInfoSize);
+
+    //frame index. A candidate only counts if its check sum matches and it carries the number the next frame has to have
+    constexpr int chunkSize = 1 << 20;
+    std::vector<juce::uint8> buffer;
+    juce::int64 bufferStart = in->getPosition();
+    juce::int64 next = bufferStart;
+    juce::int64 nextSample = 0;
+    juce::uint64 nextFrameNumber = 0;
+    bool endOfFile = false;
+
+    while (true) {
+        if (shouldCancel && shouldCancel())
+            return nullptr;
+
+        const size_t kept = buffer.size();
+        buffer.resize(kept + chunkSize);
+        const int numRead = in->read(buffer.data() + kept, chunkSize);
+        buffer.resize(kept + (size_t)juce::jmax(0, numRead));
+        endOfFile = numRead < chunkSize;
+
+        //a header starting near the end of the buffer is parsed once the next chunk is there
+        const size_t limit = endOfFile ? buffer.size() : (buffer.size() > maxFrameHeaderSize ? buffer.size() - maxFrameHeaderSize : 0);
+        size_t pos = (size_t)(next - bufferStart);
+
+        while (pos < limit) {
+            if (buffer[pos] != 0xFF) {
+                ++pos;
+                continue;
+            }
+
+            const FrameHeader frame = parseFrameHeader(buffer.data() + pos, buffer.size() - pos);
+            const bool expected = frame.length > 0 && (frame.variableBlockSize ? frame.number == (juce::uint64)nextSample : frame.number == nextFrameNumber);
+            if (!expected) {
+                ++pos;
+                continue;
+            }
+
+            decoder->frames.push_back({ bufferStart + (juce::int64)pos, nextSample });
+            nextSample += frame.blockSize;
+            ++nextFrameNumber;
+            pos += (size_t)juce::jmax(frame.length, minFrameSize);
+        }
+
+        next = bufferStart + (juce::int64)pos;
+        if (endOfFile)
+            break;
+
+        const size_t consumed = juce::jmin(pos, buffer.size());
+        buffer.erase(buffer.begin(), buffer.begin() + (std::ptrdiff_t)consumed);
+        bufferStart += (juce::int64)consumed;
+    }
+
+    if (decoder->frames.empty() || nextSample != decoder->numSamples)
+        return nullptr;
+
+    return decoder;
+}
+
+juce::AudioFormatReader* ParallelFlacDecoder::createReaderAtFrame(size_t frame) const
+{
+    std::unique_ptr<juce::InputStream> in = AsyncFileReader::getShared().createInputStream(file);
+    if (in == nullptr)
+        return nullptr;
+
+    return format->createReaderFor(new SplicedInputStream(header, std::move(in), frames[frame].offset), true);
+}
+
+std::unique_ptr<juce::AudioFormatReader> ParallelFlacDecoder::createReader(juce::int64 startSample) const
+{
+    startSample = juce::jlimit((juce::int64)0, numSamples, startSample);
+
+    auto after = std::upper_bound(frames.begin(), frames.end(), startSample, [](juce::int64 sample, const Frame& frame) { return sample < frame.startSample; });
+    const size_t frame = (size_t)(after - frames.begin()) - 1;
+
+    juce::AudioFormatReader* reader = createReaderAtFrame(frame);
+    if (reader == nullptr)
+        return nullptr;
+
+    //the samples of the frame before startSample are decoded and dropped, reading from there on is sequential then
+    const juce::int64 lead = startSample - frames[frame].startSample;
+    if (lead > 0) {
+        juce::AudioBuffer<float> skipped(juce::jmax(1, (int)reader->numChannels), (int)lead);
+        reader->read(&skipped, 0, (int)lead, 0, true, true);
+    }
+
+    return std::make_unique<juce::AudioSubsectionReader>(reader, lead, numSamples - startSample, true);
+}
+
+bool ParallelFlacDecoder::decodeRange(float* const* dest, int numDestChannels, juce::int64 startSample, int numSamplesToDecode, const std::function<bool()>& shouldCancel) const
+{
+    std::unique_ptr<juce::AudioFormatReader> reader = createReader(startSample);
+    if (reader == nullptr)
+        return false;
+
+    std::vector<float*> channels((size_t)numDestChannels);
+    for (int done = 0; done < numSamplesToDecode; done += chunkSamples) {
+        if (shouldCancel && shouldCancel())
+            return false;
+
+        const int numToRead = juce::jmin(chunkSamples, numSamplesToDecode - done);
+        for (int channel = 0; channel < numDestChannels; ++channel)
+            channels[(size_t)channel] = dest[channel] + done;
+
+        //refers to dest, so the part is decoded right where it belongs
+        juce::AudioBuffer<float> part(channels.data(), numDestChannels, numToRead);
+        reader->read(&part, 0, numToRead, done, true, true);
+    }
+
+    return true;
+}
+
+bool ParallelFlacDecoder::decode(juce::AudioBuffer<float>& dest, int destStartSample, juce::int64 startSample, int numSamplesToDecode,
+                                 JobSystem& jobs, JobSystem::Priority priority, const std::function<bool()>& shouldCancel) const
+{
+    numSamplesToDecode = (int)juce::jmin((juce::int64)numSamplesToDecode, numSamples - startSample);
+    if (numSamplesToDecode <= 0)
+        return true;
+
+    jassert(destStartSample + numSamplesToDecode <= dest.getNumSamples());
+
+    struct Job
+    {
+        std::vector<float*> channels;
+        int numParts = 1;
+        std::atomic<int> nextPart{ 0 };
+        std::atomic<int> partsLeft{ 0 };
+        std::atomic<bool> failed{ false };
+        juce::WaitableEvent finished;
+    };
+
+    auto job = std::make_shared<Job>();
+    for (int channel = 0; channel < dest.getNumChannels(); ++channel)
+        job->channels.push_back(dest.getWritePointer(channel, destStartSample));
+
+    //a few parts per thread, so one slow part doesn't hold back the rest
+    const int numWorkers = jobs.getNumWorkers() + 1;
+    job->numParts = juce::jlimit(1, numWorkers * 2, numSamplesToDecode / minPartSamples);
+    job->partsLeft = job->numParts;
+
+    //parts are taken by whoever is free, jobs starting after all are taken do nothing
+    auto work = [this, job, startSample, numSamplesToDecode, shouldCancel] {
+        for (int part = job->nextPart++; part < job->numParts; part = job->nextPart++) {
+            const int from = (int)((juce::int64)numSamplesToDecode * part / job->numParts);
+            const int to = (int)((juce::int64)numSamplesToDecode * (part + 1) / job->numParts);
+
+            std::vector<float*> at(job->channels);
+            for (float*& channel : at)
+                channel += from;
+
+            if (job->failed || !decodeRange(at.data(), (int)at.size(), startSample + from, to - from, shouldCancel))
+                job->failed = true;
+
+            if (--job->partsLeft == 0)
+                job->finished.signal();
+        }
+    };
+
+    for (int i = 1; i < juce::jmin(numWorkers, job->numParts); ++i)
+        jobs.run(priority, work);
+
+    work();
+    job->finished.wait();
+    return !job->failed;
+}
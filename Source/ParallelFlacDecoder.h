@@ -0,0 +1,68 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "FormatSniffer.h"
+#include "JobSystem.h"
+
+
+/// <summary>
+/// Decodes a FLAC file on several threads at once. FLAC frames can be decoded on their own once their offsets are known,
+/// so open() first reads through the file once and indexes every frame (a check sum and the frame numbers make sure
+/// a sync code inside audio data isn't taken for a frame). Each part of a decode then gets a reader of its own,
+/// which is fed the stream info followed by the file from the frame containing the part's start, so nothing has to seek.
+/// All functions are thread safe.
+/// </summary>
+class ParallelFlacDecoder
+{
+public:
+    /// <summary>
+    /// indexes the frames of file
+    /// </summary>
+    /// <returns>nullptr if file isn't a FLAC file, its header doesn't state the length or the frames don't add up to it</returns>
+    static std::unique_ptr<ParallelFlacDecoder> open(const juce::File& file, FormatSniffer& sniffer, const std::function<bool()>& shouldCancel = {});
+
+    juce::int64 getNumSamples() const { return numSamples; }
+    double getSampleRate() const { return sampleRate; }
+    int getNumChannels() const { return numChannels; }
+    int getNumFrames() const { return (int)frames.size(); }
+    size_t getMemoryUsage() const { return frames.capacity() * sizeof(Frame) + header.getSize(); }
+
+    /// <summary>
+    /// decodes numSamples starting at startSample into dest from destStartSample on, which has to be allocated already.
+    /// The range is split into parts decoded as jobs and on the calling thread, which only returns when all are done.
+    /// The calling thread may be a worker of jobs, parts nobody started yet are taken over by it.
+    /// </summary>
+    /// <returns>false if shouldCancel returned true in between or decoding failed</returns>
+    bool decode(juce::AudioBuffer<float>& dest, int destStartSample, juce::int64 startSample, int numSamplesToDecode,
+                JobSystem& jobs, JobSystem::Priority priority, const std::function<bool()>& shouldCancel = {}) const;
+
+    /// <summary>
+    /// a reader whose sample 0 is startSample of the file. Reading it sequentially never seeks.
+    /// </summary>
+    /// <returns>nullptr if the file can't be read anymore</returns>
+    std::unique_ptr<juce::AudioFormatReader> createReader(juce::int64 startSample) const;
+
+private:
+    struct Frame
+    {
+        juce::int64 offset;
+        juce::int64 startSample;
+    };
+
+    ParallelFlacDecoder() = default;
+
+    bool decodeRange(float* const* dest, int numDestChannels, juce::int64 startSample, int numSamplesToDecode, const std::function<bool()>& shouldCancel) const;
+
+    //reader of the stream from frame on, its sample 0 is the first sample of that frame
+    juce::AudioFormatReader* createReaderAtFrame(size_t frame) const;
+
+    juce::File file;
+    juce::AudioFormat* format = nullptr;
+    juce::MemoryBlock header;   //"fLaC" and a copy of the stream info as the only metadata block
+    double sampleRate = 0;
+    int numChannels = 0;
+    juce::int64 numSamples = 0;
+    std::vector<Frame> frames;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ParallelFlacDecoder)
+};
@@ -0,0 +1,204 @@
+#include "PathTable.h"
+
+namespace
+{
+    size_t hashBytes(const char* data, size_t length)
+    {
+        //FNV-1a
+        juce::uint64 hash = 14695981039346656037ull;
+        for (size_t i = 0; i < length; ++i) {
+            hash ^= (juce::uint8)data[i];
+            hash *= 1099511628211ull;
+        }
+        return (size_t)hash;
+    }
+
+    size_t hashPair(juce::uint32 a, juce::uint32 b)
+    {
+        juce::uint64 x = ((juce::uint64)a << 32) | b;
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdull;
+        x ^= x >> 33;
+        return (size_t)x;
+    }
+}
+
+PathTable::PathTable()
+{
+    nodes.push_back({ empty, 0 });
+}
+
+PathTable& PathTable::getShared()
+{
+    static PathTable table;
+    return table;
+}
+
+template <typename Visit>
+bool PathTable::forEachComponent(const juce::String& path, Visit&& visit)
+{
+    const char* start = path.toRawUTF8();
+    const char separator = (char)juce::File::getSeparatorChar();
+
+    for (const char* p = start;; ++p) {
+        if (*p == separator || *p == 0) {
+            if (!visit(start, (size_t)(p - start)))
+                return false;
+            if (*p == 0)
+                return true;
+            start = p + 1;
+        }
+    }
+}
+
+PathTable::Id PathTable::intern(const juce::String& path)
+{
+    if (path.isEmpty())
+        return empty;
+
+    //most paths are already known, which only needs the read lock
+    if (Id id = find(path))
+        return id;
+
+    const juce::ScopedWriteLock swl(lock);
+
+    Id current = empty;
+    forEachComponent(path, [this, &current](const char* name, size_t length) {
+        const juce::uint32 nameOffset = internName(name, length);
+
+        Id child = findChild(current, nameOffset);
+        if (child == empty) {
+            child = (Id)nodes.size();
+            nodes.push_back({ current, nameOffset });
+            children.insert(child, hashOfNode(child), [this](juce::uint32 node) { return hashOfNode(node); });
+        }
+
+        current = child;
+        return true;
+    });
+
+    return current;
+}
+
+PathTable::Id PathTable::find(const juce::String& path) const
+{
+    if (path.isEmpty())
+        return empty;
+
+    const juce::ScopedReadLock srl(lock);
+
+    Id current = empty;
+    bool found = forEachComponent(path, [this, &current](const char* name, size_t length) {
+        const juce::uint32 nameOffset = findName(name, length);
+        if (nameOffset == 0)
+            return false;
+
+        current = findChild(current, nameOffset - 1);
+        return current != empty;
+    });
+
+    return found ? current : empty;
+}
+
+juce::String PathTable::toString(Id id) const
+{
+    const juce::ScopedReadLock srl(lock);
+
+    std::vector<const char*> components;
+    for (; id != empty && id < nodes.size(); id = nodes[id].parent)
+        components.push_back(chars.data() + nodes[id].name);
+
+    juce::String path;
+    path.preallocateBytes(components.size() * 16);
+    for (auto it = components.rbegin(); it != components.rend(); ++it) {
+        if (it != components.rbegin())
+            path << juce::File::getSeparatorChar();
+        path << juce::CharPointer_UTF8(*it);
+    }
+
+    return path;
+}
+
+juce::String PathTable::getFileName(Id id) const
+{
+    const juce::ScopedReadLock srl(lock);
+    if (id == empty || id >= nodes.size())
+        return {};
+    return juce::String(juce::CharPointer_UTF8(chars.data() + nodes[id].name));
+}
+
+PathTable::Id PathTable::getParent(Id id) const
+{
+    const juce::ScopedReadLock srl(lock);
+    return id < nodes.size() ? nodes[id].parent : empty;
+}
+
+bool PathTable::isWithin(Id id, Id ancestor) const
+{
+    const juce::ScopedReadLock srl(lock);
+    if (id >= nodes.size())
+        return false;
+
+    while (id != empty) {
+        id = nodes[id].parent;
+        if (id == ancestor)
+            return true;
+    }
+    return false;
+}
+
+size_t PathTable::getNumPaths() const
+{
+    const juce::ScopedReadLock srl(lock);
+    return nodes.size() - 1;
+}
+
+size_t PathTable::getMemoryUsage() const
+{
+    const juce::ScopedReadLock srl(lock);
+    return chars.capacity() + nodes.capacity() * sizeof(Node) + names.getMemoryUsage() + children.getMemoryUsage();
+}
+
+juce::uint32 PathTable::findName(const char* name, size_t length) const
+{
+    //returns offset + 1, so 0 can mean not found
+    return names.find(hashBytes(name, length), [this, name, length](juce::uint32 value) {
+        //the terminator of a name as long as this one has to be inside chars, only then the bytes before it are compared.
+        //names never contain 0, so a shorter stored name differs at its terminator
+        const size_t offset = value - 1;
+        if (offset + length >= chars.size() || chars[offset + length] != 0)
+            return false;
+        return memcmp(chars.data() + offset, name, length) == 0;
+    });
+}
+
+juce::uint32 PathTable::internName(const char* name, size_t length)
+{
+    if (juce::uint32 found = findName(name, length))
+        return found - 1;
+
+    const juce::uint32 offset = (juce::uint32)chars.size();
+    chars.insert(chars.end(), name, name + length);
+    chars.push_back(0);
+
+    names.insert(offset + 1, hashBytes(name, length), [this](juce::uint32 value) { return hashOfName(value - 1); });
+    return offset;
+}
+
+PathTable::Id PathTable::findChild(Id parent, juce::uint32 name) const
+{
+    return children.find(hashPair(parent, name), [this, parent, name](juce::uint32 node) {
+        return nodes[node].parent == parent && nodes[node].name == name;
+    });
+}
+
+size_t PathTable::hashOfName(juce::uint32 nameOffset) const
+{
+    const char* name = chars.data() + nameOffset;
+    return hashBytes(name, strlen(name));
+}
+
+size_t PathTable::hashOfNode(Id node) const
+{
+    return hashPair(nodes[node].parent, nodes[node].name);
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "MemoryBudget.h"
+
+
+/// <summary>
+/// Interns paths as chains of components, so a path is stored as a 32 bit id and every directory and file name
+/// is stored once, however many paths share it. Equal paths get equal ids, so comparing paths compares integers.
+/// Ids stay valid for the lifetime of the table, it only grows with the number of distinct paths.
+/// Paths are split at the native separator and come back exactly as they were interned. All functions are thread safe.
+/// </summary>
+class PathTable : public MemoryBudget::Cache
+{
+public:
+    using Id = juce::uint32;
+
+    //id of the empty path, never the id of anything else
+    static constexpr Id empty = 0;
+
+    PathTable();
+
+    /// <summary>
+    /// the table all AudioFile records use
+    /// </summary>
+    static PathTable& getShared();
+
+    Id intern(const juce::String& path);
+
+    /// <summary>
+    /// like intern, but never adds anything
+    /// </summary>
+    /// <returns>empty if the path was never interned</returns>
+    Id find(const juce::String& path) const;
+
+    juce::String toString(Id id) const;
+    juce::String getFileName(Id id) const;
+    Id getParent(Id id) const;
+
+    /// <summary>
+    /// true if id is a path below ancestor (and not ancestor itself)
+    /// </summary>
+    bool isWithin(Id id, Id ancestor) const;
+
+    size_t getNumPaths() const;
+    size_t getMemoryUsage() const override;
+
+private:
+    /// <summary>
+    /// open addressing hash set of non zero 32 bit values, which are only known by their hash and an equality test
+    /// </summary>
+    class ProbeSet
+    {
+    public:
+        template <typename Matches>
+        juce::uint32 find(size_t hash, Matches&& matches) const
+        {
+            if (slots.empty())
+                return 0;
+
+            for (size_t i = hash & mask;; i = (i + 1) & mask) {
+                const juce::uint32 value = slots[i];
+                if (value == 0 || matches(value))
+                    return value;
+            }
+        }
+
+        template <typename HashOf>
+        void insert(juce::uint32 value, size_t hash, HashOf&& hashOf)
+        {
+            //grow at 75% load
+            if ((used + 1) * 4 > slots.size() * 3) {
+                std::vector<juce::uint32> old = std::move(slots);
+                slots.assign(juce::jmax((size_t)16, old.size() * 2), 0);
+                mask = slots.size() - 1;
+                for (juce::uint32 v : old) {
+                    if (v != 0)
+                        place(v, hashOf(v));
+                }
+            }
+
+            place(value, hash);
+            ++used;
+        }
+
+        size_t getMemoryUsage() const { return slots.capacity() * sizeof(juce::uint32); }
+
+    private:
+        void place(juce::uint32 value, size_t hash)
+        {
+            size_t i = hash & mask;
+            while (slots[i] != 0)
+                i = (i + 1) & mask;
+            slots[i] = value;
+        }
+
+        std::vector<juce::uint32> slots;
+        size_t mask = 0;
+        size_t used = 0;
+    };
+
+    struct Node
+    {
+        Id parent;
+        juce::uint32 name;     //offset of the zero terminated name in chars
+    };
+
+    juce::uint32 findName(const char* name, size_t length) const;
+    juce::uint32 internName(const char* name, size_t length);
+    Id findChild(Id parent, juce::uint32 name) const;
+
+    size_t hashOfName(juce::uint32 nameOffset) const;
+    size_t hashOfNode(Id node) const;
+
+    template <typename Visit>
+    static bool forEachComponent(const juce::String& path, Visit&& visit);
+
+    std::vector<char> chars;
+    std::vector<Node> nodes;        //nodes[empty] is unused
+    ProbeSet names;                 //name offset + 1
+    ProbeSet children;              //node ids, keyed by parent and name
+
+    mutable juce::ReadWriteLock lock;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PathTable)
+};
@@ -0,0 +1,45 @@
+#include "PlayheadClock.h"
+
+void PlayheadClock::publish(double positionSeconds, double blockSeconds, bool playing) noexcept
+{
+    const double now = juce::Time::getMillisecondCounterHiRes();
+
+    //seqlock, readers retry if the sequence changed while they were reading
+    sequence.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    position.store(positionSeconds, std::memory_order_relaxed);
+    hostTimeMs.store(now, std::memory_order_relaxed);
+    blockLength.store(blockSeconds, std::memory_order_relaxed);
+    isPlaying.store(playing, std::memory_order_relaxed);
+    sequence.fetch_add(1, std::memory_order_release);
+}
+
+bool PlayheadClock::getAudiblePosition(double nowMs, double& positionSeconds) const noexcept
+{
+    double startPosition, startMs, blockSeconds;
+    bool playing;
+
+    for (;;) {
+        const juce::uint32 before = sequence.load(std::memory_order_acquire);
+        if ((before & 1) != 0)
+            continue;
+
+        startPosition = position.load(std::memory_order_relaxed);
+        startMs = hostTimeMs.load(std::memory_order_relaxed);
+        blockSeconds = blockLength.load(std::memory_order_relaxed);
+        playing = isPlaying.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence.load(std::memory_order_relaxed) == before)
+            break;
+    }
+
+    const double elapsed = (nowMs - startMs) / 1000.0;
+
+    //a few missed callbacks mean the device stopped or hangs, extrapolating further would run away
+    if (!playing || startMs <= 0 || elapsed > 4 * blockSeconds + 0.1)
+        return false;
+
+    positionSeconds = juce::jmax(0.0, startPosition + elapsed - outputLatency.load(std::memory_order_relaxed));
+    return true;
+}
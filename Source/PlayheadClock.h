@@ -0,0 +1,43 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+
+/// <summary>
+/// Hands the playback position from the audio thread to the GUI without locks.
+/// The audio callback publishes where it starts reading and when, the GUI extrapolates from that to the position
+/// that is heard right now, corrected by the output latency of the device.
+/// One writer (the audio thread), any number of readers.
+/// </summary>
+class PlayheadClock
+{
+public:
+    /// <summary>
+    /// called at the start of every audio callback
+    /// </summary>
+    /// <param name="positionSeconds">the position the callback starts reading at</param>
+    /// <param name="blockSeconds">length of the block the callback renders</param>
+    /// <param name="playing">false if the position doesn't move</param>
+    void publish(double positionSeconds, double blockSeconds, bool playing) noexcept;
+
+    /// <summary>
+    /// time between a callback rendering a sample and it being heard, as reported by the device
+    /// </summary>
+    void setOutputLatency(double seconds) noexcept { outputLatency.store(seconds, std::memory_order_relaxed); }
+
+    /// <summary>
+    /// the position heard at nowMs (juce::Time::getMillisecondCounterHiRes)
+    /// </summary>
+    /// <returns>false if nothing is playing or the audio callbacks stopped, the caller has to ask the transport then</returns>
+    bool getAudiblePosition(double nowMs, double& positionSeconds) const noexcept;
+
+private:
+    //odd while the audio thread is writing
+    std::atomic<juce::uint32> sequence{ 0 };
+    std::atomic<double> position{ 0 };
+    std::atomic<double> hostTimeMs{ 0 };
+    std::atomic<double> blockLength{ 0 };
+    std::atomic<bool> isPlaying{ false };
+
+    std::atomic<double> outputLatency{ 0 };
+};
@@ -0,0 +1,91 @@
+#include "ReaderPool.h"
+#include "AudioPrefetcher.h"
+
+ReaderPool::ReaderPool(int maxEntries_) : maxEntries(maxEntries_)
+{
+}
+
+void ReaderPool::add(const juce::File& file, const Identity& identity, std::unique_ptr<juce::AudioFormatReaderSource> source)
+{
+    if (source == nullptr)
+        return;
+
+    remove(file);
+    entries.push_front({ file, identity, std::move(source), ++nextId });
+
+    while ((int)entries.size() > maxEntries)
+        entries.pop_back();
+
+    memoryUsageGrew();
+}
+
+std::unique_ptr<juce::AudioFormatReaderSource> ReaderPool::take(const juce::File& file)
+{
+    auto it = find(file);
+    if (it == entries.end())
+        return nullptr;
+
+    std::unique_ptr<juce::AudioFormatReaderSource> source = std::move(it->source);
+    const bool unchanged = it->identity == Identity::of(file);
+    entries.erase(it);
+
+    //the decoder would read from a file that isn't there anymore in this form
+    if (!unchanged)
+        return nullptr;
+
+    source->setNextReadPosition(0);
+    return source;
+}
+
+bool ReaderPool::contains(const juce::File& file) const
+{
+    return std::any_of(entries.begin(), entries.end(), [&file](const Entry& entry) { return entry.file == file; });
+}
+
+void ReaderPool::remove(const juce::File& file)
+{
+    auto it = find(file);
+    if (it != entries.end())
+        entries.erase(it);
+}
+
+void ReaderPool::clear()
+{
+    entries.clear();
+}
+
+std::list<ReaderPool::Entry>::iterator ReaderPool::find(const juce::File& file)
+{
+    return std::find_if(entries.begin(), entries.end(), [&file](const Entry& entry) { return entry.file == file; });
+}
+
+size_t ReaderPool::getMemoryUsage() const
+{
+    size_t bytes = 0;
+    for (const Entry& entry : entries)
+        bytes += getMemoryUsageOf(entry);
+    return bytes;
+}
+
+size_t ReaderPool::getMemoryUsageOf(const Entry& entry)
+{
+    size_t bytes = readerBytes;
+    if (auto* primed = dynamic_cast<const PrimedAudioFormatReaderSource*>(entry.source.get()))
+        bytes += primed->getMemoryUsage();
+    return bytes;
+}
+
+std::vector<MemoryBudget::Entry> ReaderPool::getEvictableEntries() const
+{
+    //the longer ago a file was played, the less likely it's played again soon
+    std::vector<MemoryBudget::Entry> evictable;
+    int age = 0;
+    for (const Entry& entry : entries)
+        evictable.push_back({ entry.id, getMemoryUsageOf(entry), 1.0 / ++age });
+    return evictable;
+}
+
+void ReaderPool::evict(juce::int64 id)
+{
+    entries.remove_if([id](const Entry& entry) { return entry.id == id; });
+}
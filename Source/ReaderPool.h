@@ -0,0 +1,73 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "MemoryBudget.h"
+#include <list>
+
+
+/// <summary>
+/// Keeps the reader sources of the last played files open, together with their decoder state and primed regions,
+/// so switching back to one of them doesn't touch the disk again. The least recently used source is closed when
+/// the pool is full, or earlier by the MemoryBudget. Only used on the message thread.
+/// </summary>
+class ReaderPool : public MemoryBudget::Cache
+{
+public:
+    /// <summary>
+    /// size and modification time of a file when its reader was created, a pooled reader is only reused if both still match
+    /// </summary>
+    struct Identity
+    {
+        juce::int64 size = 0;
+        juce::int64 modificationTime = 0;
+
+        static Identity of(const juce::File& file) {
+            return { file.getSize(), file.getLastModificationTime().toMilliseconds() };
+        }
+
+        bool operator==(const Identity& other) const {
+            return size == other.size && modificationTime == other.modificationTime;
+        }
+    };
+
+    ReaderPool(int maxEntries = 8);
+
+    void add(const juce::File& file, const Identity& identity, std::unique_ptr<juce::AudioFormatReaderSource> source);
+
+    /// <summary>
+    /// removes the source of this file from the pool and returns it, rewound to the start
+    /// </summary>
+    /// <returns>nullptr if there is none or the file changed since its reader was created</returns>
+    std::unique_ptr<juce::AudioFormatReaderSource> take(const juce::File& file);
+
+    bool contains(const juce::File& file) const;
+    void remove(const juce::File& file);
+    void clear();
+
+    int getMaxEntries() const { return maxEntries; }
+
+    size_t getMemoryUsage() const override;
+    std::vector<MemoryBudget::Entry> getEvictableEntries() const override;
+    void evict(juce::int64 id) override;
+
+    //decoder state and read ahead of a reader, on top of its primed regions. Estimated, readers don't tell
+    static constexpr size_t readerBytes = 256 * 1024;
+
+private:
+    struct Entry
+    {
+        juce::File file;
+        Identity identity;
+        std::unique_ptr<juce::AudioFormatReaderSource> source;
+        juce::int64 id = 0;
+    };
+
+    std::list<Entry>::iterator find(const juce::File& file);
+    static size_t getMemoryUsageOf(const Entry& entry);
+
+    const int maxEntries;
+    juce::int64 nextId = 0;
+    std::list<Entry> entries;   //most recently used first
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ReaderPool)
+};
@@ -0,0 +1,205 @@
+#include "RealtimeSupport.h"
+
+#if JUCE_LINUX
+ #include <pthread.h>
+ #include <sched.h>
+ #include <sys/mman.h>
+ #include <sys/resource.h>
+ #include <unistd.h>
+ #include <cerrno>
+ #include <cstring>
+#endif
+
+namespace
+{
+    struct Attempt
+    {
+        juce::String what;
+        bool success;
+        juce::String details;
+    };
+
+    juce::CriticalSection lock;
+    std::vector<Attempt> attempts;
+
+    bool record(const juce::String& what, bool success, const juce::String& details)
+    {
+        juce::Logger::writeToLog("realtime: " + what + (success ? " ok" : " failed") + (details.isNotEmpty() ? ", " + details : juce::String()));
+
+        //only the latest outcome of each kind is kept, the setup is repeated on every device restart
+        const juce::ScopedLock sl(lock);
+        auto it = std::find_if(attempts.begin(), attempts.end(), [&what](const Attempt& attempt) { return attempt.what == what; });
+        if (it != attempts.end())
+            *it = { what, success, details };
+        else
+            attempts.push_back({ what, success, details });
+        return success;
+    }
+
+   #if JUCE_LINUX
+    juce::String errorText(int error)
+    {
+        return juce::String(std::strerror(error));
+    }
+
+    juce::String limitText(int resource)
+    {
+        rlimit limit;
+        if (getrlimit(resource, &limit) != 0)
+            return "unknown";
+        return limit.rlim_cur == RLIM_INFINITY ? juce::String("unlimited") : juce::String((juce::int64)limit.rlim_cur);
+    }
+   #endif
+
+    //one write per page, so they are mapped even where locking isn't allowed
+    void touchPages(void* data, size_t numBytes)
+    {
+        const size_t pageSize = 4096;
+        volatile char* bytes = static_cast<char*>(data);
+        for (size_t i = 0; i < numBytes; i += pageSize)
+            bytes[i] = bytes[i];
+        bytes[numBytes - 1] = bytes[numBytes - 1];
+    }
+
+    //0 or the error of mlock. Locking maps the pages as well, they are only touched by hand where it fails
+    int lockPages(void* data, size_t numBytes)
+    {
+        if (data == nullptr || numBytes == 0)
+            return 0;
+
+       #if JUCE_LINUX
+        if (mlock(data, numBytes) == 0)
+            return 0;
+        const int error = errno;
+       #else
+        const int error = -1;
+       #endif
+
+        touchPages(data, numBytes);
+        return error;
+    }
+
+    juce::String describeLock(size_t numBytes, int error)
+    {
+        if (error == 0)
+            return juce::String((juce::int64)numBytes) + " bytes";
+
+       #if JUCE_LINUX
+        return errorText(error) + ", RLIMIT_MEMLOCK is " + limitText(RLIMIT_MEMLOCK) + ", pages were touched instead";
+       #else
+        return "only supported on Linux, pages were touched instead";
+       #endif
+    }
+}
+
+bool RealtimeSupport::setRealtimePriority(juce::Thread::ThreadID thread, int priority, const juce::String& threadName)
+{
+   #if JUCE_LINUX
+    sched_param param{};
+    param.sched_priority = juce::jlimit(sched_get_priority_min(SCHED_FIFO), sched_get_priority_max(SCHED_FIFO), priority);
+    const int error = pthread_setschedparam((pthread_t)thread, SCHED_FIFO, &param);
+    if (error == 0)
+        return record("SCHED_FIFO " + threadName, true, "priority " + juce::String(param.sched_priority));
+
+    //rtkit would need d-bus, which this build doesn't link. The limit tells what to configure instead
+    return record("SCHED_FIFO " + threadName, false, errorText(error) + ", RLIMIT_RTPRIO is " + limitText(RLIMIT_RTPRIO)
+                  + " (add the user to a group with rtprio in /etc/security/limits.d)");
+   #else
+    juce::ignoreUnused(thread, priority);
+    return record("SCHED_FIFO " + threadName, false, "only supported on Linux");
+   #endif
+}
+
+bool RealtimeSupport::pinToCores(juce::Thread::ThreadID thread, const juce::Array<int>& cores, const juce::String& threadName)
+{
+    if (cores.isEmpty())
+        return true;
+
+   #if JUCE_LINUX
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    const int numCpus = juce::SystemStats::getNumCpus();
+    juce::StringArray used;
+    for (int core : cores) {
+        if (core >= 0 && core < numCpus && core < CPU_SETSIZE) {
+            CPU_SET(core, &set);
+            used.add(juce::String(core));
+        }
+    }
+
+    if (used.isEmpty())
+        return record("pin " + threadName + " to cores", false, "none of the cores exists, there are " + juce::String(numCpus));
+
+    const int error = pthread_setaffinity_np((pthread_t)thread, sizeof(set), &set);
+    return record("pin " + threadName + " to cores", error == 0, error == 0 ? used.joinIntoString(",") : errorText(error));
+   #else
+    juce::ignoreUnused(thread);
+    return record("pin " + threadName + " to cores", false, "only supported on Linux");
+   #endif
+}
+
+bool RealtimeSupport::lockMemory(void* data, size_t numBytes, const juce::String& what)
+{
+    const int error = lockPages(data, numBytes);
+    return record("lock " + what, error == 0, describeLock(numBytes, error));
+}
+
+void RealtimeSupport::unlockMemory(void* data, size_t numBytes)
+{
+   #if JUCE_LINUX
+    if (data != nullptr && numBytes > 0)
+        munlock(data, numBytes);
+   #else
+    juce::ignoreUnused(data, numBytes);
+   #endif
+}
+
+bool RealtimeSupport::lockBuffer(juce::AudioBuffer<float>& buffer, const juce::String& what)
+{
+    //one record for the whole buffer
+    const size_t channelBytes = (size_t)buffer.getNumSamples() * sizeof(float);
+    int error = 0;
+    for (int channel = 0; channel < buffer.getNumChannels(); ++channel) {
+        const int channelError = lockPages(buffer.getWritePointer(channel), channelBytes);
+        if (error == 0)
+            error = channelError;
+    }
+    return record("lock " + what, error == 0, describeLock(channelBytes * (size_t)buffer.getNumChannels(), error));
+}
+
+void RealtimeSupport::unlockBuffer(juce::AudioBuffer<float>& buffer)
+{
+    for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+        unlockMemory(buffer.getWritePointer(channel), (size_t)buffer.getNumSamples() * sizeof(float));
+}
+
+juce::Array<int> RealtimeSupport::parseCores(const juce::String& text)
+{
+    juce::Array<int> cores;
+    for (const juce::String& token : juce::StringArray::fromTokens(text, ",; ", ""))
+        if (token.containsOnly("0123456789") && token.isNotEmpty())
+            cores.add(token.getIntValue());
+    return cores;
+}
+
+juce::var RealtimeSupport::toVar()
+{
+    juce::Array<juce::var> result;
+
+    const juce::ScopedLock sl(lock);
+    for (const Attempt& attempt : attempts) {
+        juce::DynamicObject* obj = new juce::DynamicObject();
+        obj->setProperty("what", attempt.what);
+        obj->setProperty("success", attempt.success);
+        obj->setProperty("details", attempt.details);
+        result.add(juce::var(obj));
+    }
+
+    return result;
+}
+
+void RealtimeSupport::writeTo(const juce::File& file)
+{
+    file.getParentDirectory().createDirectory();
+    file.replaceWithText(juce::JSON::toString(toVar()));
+}
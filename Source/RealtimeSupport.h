@@ -0,0 +1,52 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+
+/// <summary>
+/// Opt-in real-time setup of the audio thread and the memory it plays from: SCHED_FIFO priority, pinning to cores and
+/// locking buffers into RAM. Only does something on Linux. Every attempt falls back to leaving things as they are
+/// if it isn't permitted and its outcome is recorded, the report of the latest outcomes is the diagnostics for the setup.
+/// Can be called from any thread except the audio thread.
+/// </summary>
+namespace RealtimeSupport
+{
+    //SCHED_FIFO priority, above the usual 50 of interrupt threads but below the ones of the audio server
+    constexpr int audioPriority = 70;
+    //the thread decoding ahead for the audio thread, which plays nothing it hasn't decoded yet
+    constexpr int readAheadPriority = 60;
+
+    /// <summary>
+    /// gives thread (Thread::getCurrentThreadId of that thread) the real-time priority. threadName tells the outcomes apart
+    /// </summary>
+    bool setRealtimePriority(juce::Thread::ThreadID thread, int priority, const juce::String& threadName);
+
+    /// <summary>
+    /// lets thread only run on these cpu cores, numbered from 0. Cores which don't exist are ignored
+    /// </summary>
+    bool pinToCores(juce::Thread::ThreadID thread, const juce::Array<int>& cores, const juce::String& threadName);
+
+    /// <summary>
+    /// keeps the memory from being paged out. Where that fails its pages are touched, so at least they are mapped before playback
+    /// </summary>
+    bool lockMemory(void* data, size_t numBytes, const juce::String& what);
+    void unlockMemory(void* data, size_t numBytes);
+
+    /// <summary>
+    /// locks every channel of buffer
+    /// </summary>
+    bool lockBuffer(juce::AudioBuffer<float>& buffer, const juce::String& what);
+    void unlockBuffer(juce::AudioBuffer<float>& buffer);
+
+    /// <summary>
+    /// parses a list of cores like "2,3"
+    /// </summary>
+    juce::Array<int> parseCores(const juce::String& text);
+
+    /// <summary>
+    /// the latest attempt of each kind as an array of {what, success, details}, in the order they were first made
+    /// </summary>
+    juce::var toVar();
+
+    void writeTo(const juce::File& file);
+}
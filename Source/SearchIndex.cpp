@@ -0,0 +1,333 @@
+#include "SearchIndex.h"
+#include <algorithm>
+
+void SearchIndex::add(const juce::File& libRoot, const juce::String& relPath)
+{
+    juce::File file = libRoot.getChildFile(relPath);
+
+    //most calls come from rescans of known files, those only need the read lock
+    {
+        const juce::ScopedReadLock srl(lock);
+        if (contents.idByAbsPath.count(file.getFullPathName()) > 0)
+            return;
+    }
+
+    const juce::ScopedLock sl(changeLock);
+    if (contents.idByAbsPath.count(file.getFullPathName()) > 0)
+        return;
+
+    const juce::ScopedWriteLock swl(lock);
+    contents.addEntry(file, relPath);
+}
+
+void SearchIndex::removeAllExcept(const juce::File& libRoot, const std::unordered_set<juce::String, StringHash>& stillExisting)
+{
+    const juce::ScopedLock sl(changeLock);
+
+    removeEntries(findEntries([&libRoot, &stillExisting](const Entry& entry) {
+        return entry.file.isAChildOf(libRoot) && stillExisting.count(entry.file.getRelativePathFrom(libRoot)) == 0;
+    }));
+
+    compactIfNeeded();
+}
+
+void SearchIndex::removeLibrariesExcept(const std::vector<juce::File>& libRoots)
+{
+    const juce::ScopedLock sl(changeLock);
+
+    removeEntries(findEntries([&libRoots](const Entry& entry) {
+        for (const juce::File& libRoot : libRoots) {
+            if (entry.file.isAChildOf(libRoot))
+                return false;
+        }
+        return true;
+    }));
+
+    compactIfNeeded();
+}
+
+void SearchIndex::fileRenamed(const juce::File& oldFile, const juce::File& newFile, const std::vector<juce::File>& libRoots)
+{
+    const juce::ScopedLock sl(changeLock);
+
+    const juce::String oldPath = oldFile.getFullPathName();
+    const juce::String oldPrefix = oldPath + juce::File::getSeparatorString();
+
+    //a directory takes all files below it along
+    const std::vector<Id> ids = findEntries([&oldPath, &oldPrefix](const Entry& entry) {
+        const juce::String path = entry.file.getFullPathName();
+        return path == oldPath || path.startsWith(oldPrefix);
+    });
+
+    if (ids.empty())
+        return;
+
+    std::vector<std::pair<juce::File, juce::String>> moved;
+    for (Id id : ids) {
+        juce::File file(newFile.getFullPathName() + contents.entries[id].file.getFullPathName().substring(oldPath.length()));
+        for (const juce::File& libRoot : libRoots) {
+            if (file.isAChildOf(libRoot)) {
+                moved.push_back({ file, file.getRelativePathFrom(libRoot) });
+                break;
+            }
+        }
+    }
+
+    {
+        const juce::ScopedWriteLock swl(lock);
+        for (Id id : ids)
+            contents.removeEntry(id);
+
+        for (const auto& [file, relPath] : moved) {
+            if (contents.idByAbsPath.count(file.getFullPathName()) == 0)
+                contents.addEntry(file, relPath);
+        }
+    }
+
+    compactIfNeeded();
+}
+
+void SearchIndex::fileRemoved(const juce::File& file)
+{
+    const juce::ScopedLock sl(changeLock);
+
+    const juce::String path = file.getFullPathName();
+    const juce::String prefix = path + juce::File::getSeparatorString();
+
+    removeEntries(findEntries([&path, &prefix](const Entry& entry) {
+        return entry.file.getFullPathName() == path || entry.file.getFullPathName().startsWith(prefix);
+    }));
+
+    compactIfNeeded();
+}
+
+std::vector<SearchIndex::Result> SearchIndex::search(const juce::String& query, int maxResults) const
+{
+    juce::StringArray words = juce::StringArray::fromTokens(query.toLowerCase(), true);
+    words.removeEmptyStrings();
+
+    std::vector<Result> results;
+    if (words.isEmpty())
+        return results;
+
+    const juce::ScopedReadLock srl(lock);
+    const std::vector<Entry>& entries = contents.entries;
+
+    auto matches = [&words](const Entry& entry) {
+        if (entry.removed)
+            return false;
+        for (const juce::String& word : words) {
+            if (!entry.key.contains(word))
+                return false;
+        }
+        return true;
+    };
+
+    //id lists of all trigrams of all words long enough to have some
+    std::vector<Trigram> trigrams;
+    for (const juce::String& word : words)
+        getTrigrams(word, trigrams);
+
+    std::vector<Id> candidates;
+    std::vector<Id> intersection;
+
+    if (!trigrams.empty()) {
+        std::vector<const std::vector<Id>*> lists;
+        for (Trigram trigram : trigrams) {
+            auto it = contents.postings.find(trigram);
+            if (it == contents.postings.end())
+                return results;
+            lists.push_back(&it->second);
+        }
+
+        //starting with the shortest list keeps the intersections small
+        std::sort(lists.begin(), lists.end(), [](auto* a, auto* b) { return a->size() < b->size(); });
+
+        candidates = *lists[0];
+        for (size_t i = 1; i < lists.size() && !candidates.empty(); ++i) {
+            intersection.clear();
+            std::set_intersection(candidates.begin(), candidates.end(), lists[i]->begin(), lists[i]->end(), std::back_inserter(intersection));
+            candidates.swap(intersection);
+        }
+    }
+    else {
+        //only short words, those of two characters still narrow the candidates down
+        bool narrowed = false;
+        for (const juce::String& word : words) {
+            if (word.length() != 2)
+                continue;
+
+            std::vector<Id> ids = findPair(word);
+            if (narrowed) {
+                intersection.clear();
+                std::set_intersection(candidates.begin(), candidates.end(), ids.begin(), ids.end(), std::back_inserter(intersection));
+                candidates.swap(intersection);
+            }
+            else {
+                candidates.swap(ids);
+                narrowed = true;
+            }
+
+            if (candidates.empty())
+                return results;
+        }
+
+        if (!narrowed) {
+            //single characters, those are in nearly every path, so the scan ends after maxResults
+            for (const Entry& entry : entries) {
+                if (matches(entry)) {
+                    results.push_back({ entry.file, entry.relPath });
+                    if ((int)results.size() >= maxResults)
+                        break;
+                }
+            }
+            return results;
+        }
+    }
+
+    //trigrams may match in a different order than the word, so candidates are checked
+    for (Id id : candidates) {
+        if (matches(entries[id])) {
+            results.push_back({ entries[id].file, entries[id].relPath });
+            if ((int)results.size() >= maxResults)
+                break;
+        }
+    }
+
+    return results;
+}
+
+int SearchIndex::size() const
+{
+    const juce::ScopedReadLock srl(lock);
+    return (int)(contents.entries.size() - contents.numRemoved);
+}
+
+size_t SearchIndex::getMemoryUsage() const
+{
+    const juce::ScopedReadLock srl(lock);
+
+    //removed entries still count until the next compaction, like they still take the memory
+    return contents.entryBytes
+        + contents.postings.size() * (sizeof(Trigram) + sizeof(std::vector<Id>) + sizeof(void*) + 2 * sizeof(Trigram))
+        + contents.trigramsByPair.size() * (sizeof(Trigram) + sizeof(std::vector<Trigram>) + sizeof(void*))
+        + (contents.postings.bucket_count() + contents.trigramsByPair.bucket_count() + contents.idByAbsPath.bucket_count()) * sizeof(void*);
+}
+
+void SearchIndex::getTrigrams(const juce::String& key, std::vector<Trigram>& trigrams)
+{
+    const size_t first = trigrams.size();
+
+    auto ptr = key.getCharPointer();
+    juce::juce_wchar c0 = 0, c1 = 0;
+    int n = 0;
+
+    while (!ptr.isEmpty()) {
+        juce::juce_wchar c2 = ptr.getAndAdvance();
+
+        //10 bits per character, other characters collide which only gives more candidates
+        if (++n >= 3)
+            trigrams.push_back((getPair(c0, c1) << 10) | (Trigram)(c2 & 0x3ff));
+
+        c0 = c1;
+        c1 = c2;
+    }
+
+    std::sort(trigrams.begin() + (std::ptrdiff_t)first, trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin() + (std::ptrdiff_t)first, trigrams.end()), trigrams.end());
+}
+
+std::vector<SearchIndex::Id> SearchIndex::findPair(const juce::String& word) const
+{
+    std::vector<Id> ids;
+    auto it = contents.trigramsByPair.find(getPair(word[0], word[1]));
+    if (it == contents.trigramsByPair.end())
+        return ids;
+
+    //every occurrence is the start of a trigram, or the end of one at the end of the key
+    for (Trigram trigram : it->second) {
+        const std::vector<Id>& list = contents.postings.at(trigram);
+        ids.insert(ids.end(), list.begin(), list.end());
+    }
+
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    return ids;
+}
+
+std::vector<SearchIndex::Id> SearchIndex::findEntries(const std::function<bool(const Entry&)>& predicate) const
+{
+    std::vector<Id> ids;
+    for (Id id = 0; id < (Id)contents.entries.size(); ++id) {
+        const Entry& entry = contents.entries[id];
+        if (!entry.removed && predicate(entry))
+            ids.push_back(id);
+    }
+    return ids;
+}
+
+void SearchIndex::removeEntries(const std::vector<Id>& ids)
+{
+    if (ids.empty())
+        return;
+
+    const juce::ScopedWriteLock swl(lock);
+    for (Id id : ids)
+        contents.removeEntry(id);
+}
+
+void SearchIndex::compactIfNeeded()
+{
+    if (contents.numRemoved < 1024 || contents.numRemoved < contents.entries.size() / 4)
+        return;
+
+    //built while searches go on, nothing else changes the contents meanwhile
+    Contents compacted;
+    for (const Entry& entry : contents.entries) {
+        if (!entry.removed)
+            compacted.addEntry(entry.file, entry.relPath);
+    }
+
+    {
+        const juce::ScopedWriteLock swl(lock);
+        std::swap(contents, compacted);
+    }
+
+    //the old contents are freed here, after the lock is released
+}
+
+void SearchIndex::Contents::addEntry(const juce::File& file, const juce::String& relPath)
+{
+    const Id id = (Id)entries.size();
+    juce::String key = relPath.toLowerCase();
+
+    std::vector<Trigram> trigrams;
+    getTrigrams(key, trigrams);
+    for (Trigram trigram : trigrams) {
+        std::vector<Id>& ids = postings[trigram];
+        if (ids.empty()) {
+            trigramsByPair[trigram >> 10].push_back(trigram);
+            if ((trigram >> 10) != (trigram & 0xfffff))
+                trigramsByPair[trigram & 0xfffff].push_back(trigram);
+        }
+        ids.push_back(id);
+    }
+
+    idByAbsPath[file.getFullPathName()] = id;
+    entries.push_back({ file, relPath, key });
+
+    //full path twice (file and key of idByAbsPath), relative path twice (as is and lower case)
+    const size_t pathBytes = file.getFullPathName().getNumBytesAsUTF8() + 1;
+    const size_t relPathBytes = relPath.getNumBytesAsUTF8() + 1;
+    entryBytes += sizeof(Entry) + sizeof(juce::String) + sizeof(Id) + sizeof(void*)
+        + 2 * pathBytes + 2 * relPathBytes + trigrams.size() * sizeof(Id);
+}
+
+void SearchIndex::Contents::removeEntry(Id id)
+{
+    //the id stays in the trigram lists until the next compaction, search() skips removed entries
+    Entry& entry = entries[id];
+    idByAbsPath.erase(entry.file.getFullPathName());
+    entry.removed = true;
+    ++numRemoved;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "AudioFile.h"
+#include "MemoryBudget.h"
+#include <unordered_map>
+#include <unordered_set>
+
+
+/// <summary>
+/// In memory index over the paths of all files inside the music libraries, fast enough to search while typing.
+/// Every lower case relative path is split into trigrams, a query intersects the sorted id lists of its trigrams
+/// and only checks the remaining candidates. Words of two characters use the lists of the trigrams starting or ending with them.
+/// Changes find what they change and rebuild the index without blocking searches, which only wait while the result is swapped in.
+/// All functions are thread safe.
+/// </summary>
+class SearchIndex : public MemoryBudget::Cache
+{
+public:
+    SearchIndex() {}
+
+    struct Result
+    {
+        juce::File file;
+        juce::String relPath;
+    };
+
+    /// <summary>
+    /// adds a file, does nothing if it's known already
+    /// </summary>
+    void add(const juce::File& libRoot, const juce::String& relPath);
+
+    /// <summary>
+    /// removes all files of a library whose relative path is not in stillExisting
+    /// </summary>
+    void removeAllExcept(const juce::File& libRoot, const std::unordered_set<juce::String, StringHash>& stillExisting);
+    void removeLibrariesExcept(const std::vector<juce::File>& libRoots);
+
+    void fileRenamed(const juce::File& oldFile, const juce::File& newFile, const std::vector<juce::File>& libRoots);
+    void fileRemoved(const juce::File& file);
+
+    /// <summary>
+    /// returns files whose relative path contains all words of the query, case insensitive
+    /// </summary>
+    std::vector<Result> search(const juce::String& query, int maxResults) const;
+
+    int size() const;
+
+    /// <summary>
+    /// estimated, entries and trigram lists are needed for searching, so nothing can be evicted
+    /// </summary>
+    size_t getMemoryUsage() const override;
+
+private:
+    using Trigram = juce::uint32;
+    using Id = juce::uint32;
+
+    struct Entry
+    {
+        juce::File file;
+        juce::String relPath;
+        juce::String key;   //relPath in lower case
+        bool removed = false;
+    };
+
+    //everything a search reads
+    struct Contents
+    {
+        std::vector<Entry> entries;
+        std::unordered_map<juce::String, Id, StringHash> idByAbsPath;
+        std::unordered_map<Trigram, std::vector<Id>> postings;  //ids are always sorted, new entries get the highest id
+        std::unordered_map<Trigram, std::vector<Trigram>> trigramsByPair;  //trigrams by their first and by their last two characters
+        size_t numRemoved = 0;
+        size_t entryBytes = 0;  //of entries, their absolute path keys and their ids in the trigram lists, counted as they are added
+
+        void addEntry(const juce::File& file, const juce::String& relPath);
+        void removeEntry(Id id);
+    };
+
+    static void getTrigrams(const juce::String& key, std::vector<Trigram>& trigrams);
+    static Trigram getPair(juce::juce_wchar c0, juce::juce_wchar c1) { return ((Trigram)(c0 & 0x3ff) << 10) | (Trigram)(c1 & 0x3ff); }
+
+    //ids of all entries containing the word of two characters, sorted
+    std::vector<Id> findPair(const juce::String& word) const;
+
+    //these expect changeLock to be held. The entries are searched without the read lock,
+    //only changing them needs the write lock
+    std::vector<Id> findEntries(const std::function<bool(const Entry&)>& predicate) const;
+    void removeEntries(const std::vector<Id>& ids);
+    void compactIfNeeded();
+
+    Contents contents;
+
+    //changes are made one at a time, so while making one the contents can be read without the read lock
+    juce::CriticalSection changeLock;
+    juce::ReadWriteLock lock;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SearchIndex)
+};
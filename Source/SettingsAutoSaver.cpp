@@ -0,0 +1,205 @@
+#include "SettingsAutoSaver.h"
+
+#if ! JUCE_WINDOWS
+ #include <fcntl.h>
+ #include <unistd.h>
+#endif
+
+std::vector<std::vector<const AudioFile*>> SettingsSnapshot::distributeRecords() const
+{
+    std::vector<std::vector<const AudioFile*>> distributed(libraryShards.size() + 1);
+
+    const PathTable& paths = PathTable::getShared();
+    std::vector<PathTable::Id> shardRoots;
+    for (const juce::File& libRoot : libraryShards)
+        shardRoots.push_back(paths.find(libRoot.getFullPathName()));
+
+    for (const AudioFileIndex::SettingsBlock& block : records) {
+        for (const AudioFile& file : *block) {
+            size_t target = 0;
+            if (file.hasRelPathToLib()) {
+                for (size_t i = 0; i < shardRoots.size(); ++i) {
+                    if (shardRoots[i] != PathTable::empty && paths.isWithin(file.absPathId, shardRoots[i])) {
+                        target = i + 1;
+                        break;
+                    }
+                }
+            }
+            distributed[target].push_back(&file);
+        }
+    }
+
+    return distributed;
+}
+
+juce::var SettingsSnapshot::toVar(const std::vector<const AudioFile*>& globalFiles) const
+{
+    juce::DynamicObject* obj = new juce::DynamicObject();
+    juce::var json(obj);
+
+    obj->setProperty("volume", volume);
+    obj->setProperty("currentFileBrowserPath", currentFileBrowserPath);
+
+    obj->setProperty("defaultCrossFadeActive", defaultCrossFadeActive);
+    obj->setProperty("defaultCrossFadeLength", defaultCrossFadeLength);
+    obj->setProperty("audioIdleTimeout", audioIdleTimeout);
+    obj->setProperty("realtimeAudio", realtimeAudio);
+    obj->setProperty("realtimeCores", realtimeCores);
+    obj->setProperty("memoryBudget", memoryBudget);
+
+    juce::var roots;
+    for (const juce::File& file : musicLibs) {
+        juce::DynamicObject* fileObj = new juce::DynamicObject();
+        fileObj->setProperty("path", file.getFullPathName());
+        roots.append(juce::var(fileObj));
+    }
+    obj->setProperty("musicLibs", roots);
+
+    juce::var files;
+    for (const AudioFile* file : globalFiles)
+        files.append(file->toVar());
+    obj->setProperty("audioFiles", files);
+
+    return json;
+}
+
+juce::var SettingsSnapshot::shardToVar(const std::vector<const AudioFile*>& shardFiles)
+{
+    juce::DynamicObject* obj = new juce::DynamicObject();
+    juce::var json(obj);
+
+    juce::var files;
+    for (const AudioFile* file : shardFiles)
+        files.append(file->toVar());
+    obj->setProperty("audioFiles", files);
+
+    return json;
+}
+
+
+SettingsAutoSaver::SettingsAutoSaver(const juce::File& fileToWrite)
+    : file(fileToWrite)
+{
+}
+
+SettingsAutoSaver::~SettingsAutoSaver()
+{
+    JobSystem::getShared().cancelAndWait(jobs);
+}
+
+void SettingsAutoSaver::save(SettingsSnapshot&& snapshot)
+{
+    {
+        const juce::ScopedLock sl(pendingLock);
+        const bool jobQueued = pending != nullptr;
+        pending = std::make_unique<SettingsSnapshot>(std::move(snapshot));
+        pendingGeneration = nextGeneration++;
+
+        //the queued job writes whatever is newest when it runs
+        if (jobQueued)
+            return;
+    }
+
+    //not a bulk class, so a long scan can't hold back saving
+    JobSystem::getShared().run(JobSystem::Priority::prefetch, [this] { writePending(); }, jobs);
+}
+
+bool SettingsAutoSaver::saveNow(SettingsSnapshot&& snapshot)
+{
+    juce::uint64 generation;
+    {
+        //a pending snapshot is older than this one
+        const juce::ScopedLock sl(pendingLock);
+        pending.reset();
+        generation = nextGeneration++;
+    }
+    return write(snapshot, generation);
+}
+
+void SettingsAutoSaver::writePending()
+{
+    std::unique_ptr<SettingsSnapshot> next;
+    juce::uint64 generation;
+    {
+        const juce::ScopedLock sl(pendingLock);
+        next = std::move(pending);
+        generation = pendingGeneration;
+    }
+
+    if (next != nullptr)
+        write(*next, generation);
+}
+
+bool SettingsAutoSaver::write(const SettingsSnapshot& snapshot, juce::uint64 generation)
+{
+    const juce::ScopedLock sl(writeLock);
+
+    //a newer snapshot is on disk already
+    if (generation < writtenGeneration)
+        return true;
+    writtenGeneration = generation;
+
+    const std::vector<std::vector<const AudioFile*>> distributed = snapshot.distributeRecords();
+    bool success = writeIfChanged(file, juce::JSON::toString(snapshot.toVar(distributed[0])));
+
+    for (size_t i = 0; i < snapshot.libraryShards.size(); ++i) {
+        const juce::File& libRoot = snapshot.libraryShards[i];
+        const std::vector<const AudioFile*>& shardFiles = distributed[i + 1];
+
+        //a library on a drive that is gone keeps its old shard, libraries without any settings don't get one
+        const bool hasContent = !shardFiles.empty() || SettingsSnapshot::getShardFile(libRoot).existsAsFile();
+        if (libRoot.isDirectory() && hasContent)
+            success = writeIfChanged(SettingsSnapshot::getShardFile(libRoot), juce::JSON::toString(SettingsSnapshot::shardToVar(shardFiles))) && success;
+    }
+
+    return success;
+}
+
+bool SettingsAutoSaver::writeIfChanged(const juce::File& target, const juce::String& content)
+{
+    const juce::int64 hash = content.hashCode64();
+    auto it = writtenHashes.find(target.getFullPathName());
+    if (it != writtenHashes.end() && it->second == hash)
+        return true;
+
+    if (!writeAtomically(target, content))
+        return false;
+
+    writtenHashes[target.getFullPathName()] = hash;
+    return true;
+}
+
+bool SettingsAutoSaver::writeAtomically(const juce::File& target, const juce::String& content)
+{
+    target.getParentDirectory().createDirectory();
+
+    juce::TemporaryFile temp(target);
+    {
+        juce::FileOutputStream out(temp.getFile());
+        if (out.failedToOpen())
+            return false;
+
+        out.setPosition(0);
+        out.truncate();
+        out.writeText(content, false, false, nullptr);
+
+        //flush() also does the fsync/FlushFileBuffers
+        out.flush();
+        if (out.getStatus().failed())
+            return false;
+    }
+
+    if (!temp.overwriteTargetFileWithTemporary())
+        return false;
+
+#if ! JUCE_WINDOWS
+    //make the rename itself durable
+    int dirFd = ::open(target.getParentDirectory().getFullPathName().toRawUTF8(), O_RDONLY);
+    if (dirFd >= 0) {
+        ::fsync(dirFd);
+        ::close(dirFd);
+    }
+#endif
+
+    return true;
+}
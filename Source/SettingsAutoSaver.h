@@ -0,0 +1,99 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "AudioFileIndex.h"
+#include "JobSystem.h"
+#include "MemoryBudget.h"
+#include <unordered_map>
+
+
+/// <summary>
+/// Everything that goes into settings.json, taken on the message thread and serialised in a saver job.
+/// The records are not copied one by one: the snapshot shares the immutable blocks of AudioFileIndex::getSettingsBlocks(),
+/// only blocks with a record changed since the last snapshot are copied again. They are split between the global file
+/// and the library shards by the saver job.
+/// </summary>
+struct SettingsSnapshot
+{
+    double volume = 1;
+    juce::String currentFileBrowserPath;
+    bool defaultCrossFadeActive = false;
+    double defaultCrossFadeLength = 0;
+    int audioIdleTimeout = 60;
+    bool realtimeAudio = false;
+    juce::String realtimeCores;
+    int memoryBudget = (int)(MemoryBudget::defaultBudget >> 20);   //MB
+
+    std::vector<juce::File> musicLibs;
+
+    //records with own settings
+    std::vector<AudioFileIndex::SettingsBlock> records;
+
+    //roots of the libraries whose shard was loaded, the shards of the others are left as they are on disk.
+    //a shard holds the records of files inside its library, saved in the library itself so they move and sync with it
+    std::vector<juce::File> libraryShards;
+
+    /// <summary>
+    /// the records of the global file first, then those of each of libraryShards.
+    /// Files of libraries whose shard isn't loaded yet stay in the global file until it is
+    /// </summary>
+    std::vector<std::vector<const AudioFile*>> distributeRecords() const;
+
+    juce::var toVar(const std::vector<const AudioFile*>& globalFiles) const;
+    static juce::var shardToVar(const std::vector<const AudioFile*>& shardFiles);
+
+    static juce::File getShardFile(const juce::File& libRoot) { return libRoot.getChildFile(".loopyaudioplayer.json"); }
+};
+
+
+/// <summary>
+/// Writes settings snapshots in background jobs. Only the newest pending snapshot is written,
+/// and the target file is replaced atomically (temporary file, fsync, rename).
+/// Every snapshot gets a generation when it's handed over, one older than what was written last is dropped,
+/// so a job that took its snapshot before saveNow() can't overwrite what saveNow() wrote.
+/// Library shards are only rewritten if their content changed since they were last written.
+/// </summary>
+class SettingsAutoSaver
+{
+public:
+    SettingsAutoSaver(const juce::File& fileToWrite);
+    ~SettingsAutoSaver();
+
+    /// <summary>
+    /// hands a snapshot to the saver. A snapshot that is still pending gets replaced.
+    /// </summary>
+    void save(SettingsSnapshot&& snapshot);
+
+    /// <summary>
+    /// writes the given snapshot on the calling thread, after any write that is already running.
+    /// Used on shutdown.
+    /// </summary>
+    bool saveNow(SettingsSnapshot&& snapshot);
+
+    const juce::File& getFile() const { return file; }
+
+    /// <summary>
+    /// replaces target with content without ever leaving a half written file behind.
+    /// </summary>
+    /// <returns>true if the new content is on disk</returns>
+    static bool writeAtomically(const juce::File& target, const juce::String& content);
+
+private:
+    void writePending();
+    bool write(const SettingsSnapshot& snapshot, juce::uint64 generation);
+    bool writeIfChanged(const juce::File& target, const juce::String& content);
+
+    const juce::File file;
+    JobSystem::CancellationToken jobs;
+
+    juce::CriticalSection pendingLock;
+    std::unique_ptr<SettingsSnapshot> pending;
+    juce::uint64 pendingGeneration = 0;
+    juce::uint64 nextGeneration = 1;
+
+    juce::CriticalSection writeLock;
+    juce::uint64 writtenGeneration = 0;
+    std::unordered_map<juce::String, juce::int64, StringHash> writtenHashes;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SettingsAutoSaver)
+};
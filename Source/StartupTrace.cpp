@@ -0,0 +1,51 @@
+#include "StartupTrace.h"
+
+namespace
+{
+    struct Mark
+    {
+        juce::String name;
+        double ms;
+        juce::String thread;
+    };
+
+    //set during static initialisation, so as close to process start as we get without os specific calls
+    const juce::int64 startTicks = juce::Time::getHighResolutionTicks();
+
+    juce::CriticalSection lock;
+    std::vector<Mark> marks;
+}
+
+void StartupTrace::mark(const juce::String& name)
+{
+    const double ms = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks) * 1000.0;
+
+    juce::String thread = juce::MessageManager::existsAndIsCurrentThread() ? "message" : juce::Thread::getCurrentThreadName();
+    if (thread.isEmpty())
+        thread = "worker";
+
+    const juce::ScopedLock sl(lock);
+    marks.push_back({ name, ms, thread });
+}
+
+juce::var StartupTrace::toVar()
+{
+    juce::Array<juce::var> result;
+
+    const juce::ScopedLock sl(lock);
+    for (const Mark& m : marks) {
+        juce::DynamicObject* obj = new juce::DynamicObject();
+        obj->setProperty("name", m.name);
+        obj->setProperty("ms", m.ms);
+        obj->setProperty("thread", m.thread);
+        result.add(juce::var(obj));
+    }
+
+    return result;
+}
+
+void StartupTrace::writeTo(const juce::File& file)
+{
+    file.getParentDirectory().createDirectory();
+    file.replaceWithText(juce::JSON::toString(toVar()));
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+
+/// <summary>
+/// Records when the phases of the application start are reached, measured from static initialisation of the executable.
+/// Marks can be set from any thread.
+/// </summary>
+namespace StartupTrace
+{
+    /// <summary>
+    /// remembers that the phase name was reached now, together with the thread it was reached on
+    /// </summary>
+    void mark(const juce::String& name);
+
+    /// <summary>
+    /// all marks so far as an array of {name, ms, thread}, in the order they were set
+    /// </summary>
+    juce::var toVar();
+
+    void writeTo(const juce::File& file);
+}
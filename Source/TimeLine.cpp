@@ -8,7 +8,7 @@ LoopMarker::LoopMarker(TimeLine* par) :par(par) {
     createIcons();
 }
 
-void LoopMarker::paint(juce::Graphics& g)
+void LoopMarker::drawOnto(juce::Graphics& g)
 {
     g.drawImageAt(active ? activeIcon : inactiveIcon, drawAtPoint.x, drawAtPoint.y);
 }
@@ -57,7 +57,7 @@ void LoopMarker::setPosition(float x, float y) {
                                 width+1,
                                 height+1);
     setBounds(bounds);
-    repaint();
+    par->repaintStaticLayer();
 
 }
 
@@ -226,15 +226,47 @@ TimeLine::TimeLine() {
     leftMarker.setTimeStamp(0);
     rightMarker.setTimeStamp(INFINITY);
 
+    setFrameCallbacksActive(true);
+
 
 };
 
 void TimeLine::paint(juce::Graphics& g)
 {
+    //everything but the playhead changes rarely, so it's drawn once into an image and only copied on every tick
+    const float scale = (float)juce::Component::getApproximateScaleFactorForComponent(this);
+    const int imageWidth = juce::roundToInt(getWidth() * scale);
+    const int imageHeight = juce::roundToInt(getHeight() * scale);
+    if (imageWidth <= 0 || imageHeight <= 0)
+        return;
+
+    if (!staticLayerValid || staticLayer.getWidth() != imageWidth || staticLayer.getHeight() != imageHeight) {
+        staticLayer = juce::Image(juce::Image::ARGB, imageWidth, imageHeight, true);
+        juce::Graphics layer(staticLayer);
+        layer.addTransform(juce::AffineTransform::scale(scale));
+        paintStaticLayer(layer);
+        staticLayerValid = true;
+    }
+
+    g.drawImageTransformed(staticLayer, juce::AffineTransform::scale(1.0f / scale));
+    paintPlayhead(g);
+}
+
+void TimeLine::paintStaticLayer(juce::Graphics& g)
+{
+    paintWaveform(g);
+
+    //background track like LookAndFeel_V4::drawLinearSlider, the value track and thumb are the playhead
+    auto track = getLookAndFeel().getSliderLayout(*this).sliderBounds.toFloat();
+    const float trackWidth = juce::jmin(6.0f, track.getHeight() * 0.25f);
+    juce::Path backgroundTrack;
+    backgroundTrack.startNewSubPath(track.getX(), track.getCentreY());
+    backgroundTrack.lineTo(track.getRight(), track.getCentreY());
+    g.setColour(findColour(juce::Slider::backgroundColourId));
+    g.strokePath(backgroundTrack, { trackWidth, juce::PathStrokeType::curved, juce::PathStrokeType::rounded });
 
-    juce::Slider::paint(g);
-    leftMarker.paint(g);
-    rightMarker.paint(g);
+    leftMarker.drawOnto(g);
+    rightMarker.drawOnto(g);
 
     juce::Colour fillCol = juce::Colours::blue;
     juce::Colour outlineCol = juce::Colours::black;
@@ -244,7 +276,6 @@ void TimeLine::paint(juce::Graphics& g)
         outlineCol = outlineCol.interpolatedWith(juce::Colours::darkgrey, 0.4);
     }
 
-    auto sliderbounds = getLookAndFeel().getSliderLayout(*this).sliderBounds;
     juce::Rectangle<float> wholeMarker(getTextBoxWidth()+1, getHeight()/2-10, 5, 20);
     g.setColour(fillCol);
     g.fillRoundedRectangle(wholeMarker, 1);
@@ -259,10 +290,209 @@ void TimeLine::paint(juce::Graphics& g)
     g.drawRoundedRectangle(wholeMarker, 1, 1);
 }
 
+void TimeLine::paintPlayhead(juce::Graphics& g)
+{
+    auto track = getLookAndFeel().getSliderLayout(*this).sliderBounds.toFloat();
+    const float trackWidth = juce::jmin(6.0f, track.getHeight() * 0.25f);
+    const juce::Point<float> start(track.getX(), track.getCentreY());
+    const juce::Point<float> thumb(getPositionOfValue(playheadValue), track.getCentreY());
+
+    juce::Path valueTrack;
+    valueTrack.startNewSubPath(start);
+    valueTrack.lineTo(thumb);
+    g.setColour(findColour(juce::Slider::trackColourId));
+    g.strokePath(valueTrack, { trackWidth, juce::PathStrokeType::curved, juce::PathStrokeType::rounded });
+
+    const float thumbWidth = (float)getLookAndFeel().getSliderThumbRadius(*this);
+    g.setColour(findColour(juce::Slider::thumbColourId));
+    g.fillEllipse(juce::Rectangle<float>(thumbWidth, thumbWidth).withCentre(thumb));
+}
+
+juce::Rectangle<int> TimeLine::getPlayheadArea(double value)
+{
+    const int x = juce::roundToInt(getPositionOfValue(value));
+    const int radius = getLookAndFeel().getSliderThumbRadius(*this) + 2;
+    return { x - radius, 0, 2 * radius, getHeight() };
+}
+
+void TimeLine::setPlayheadPosition(double seconds)
+{
+    if (seconds == playheadValue)
+        return;
+
+    //page along with the playhead while zoomed in
+    if (isZoomed() && (seconds < viewStart || seconds > viewStart + viewLength)) {
+        playheadValue = seconds;
+        setVisibleRange(seconds, viewLength);
+    }
+    else {
+        //the value track between the old and the new position changes as well
+        repaint(getPlayheadArea(playheadValue).getUnion(getPlayheadArea(seconds)));
+        playheadValue = seconds;
+    }
+
+    if (timeStampBox != nullptr && !timeStampBox->isBeingEdited())
+        timeStampBox->setText(getTextFromValue(seconds), juce::dontSendNotification);
+}
+
+void TimeLine::repaintStaticLayer()
+{
+    staticLayerValid = false;
+    repaint();
+}
+
+void TimeLine::lookAndFeelChanged()
+{
+    juce::Slider::lookAndFeelChanged();
+    repaintStaticLayer();
+}
+
+void TimeLine::paintWaveform(juce::Graphics& g)
+{
+    if (waveform == nullptr || getMaximum() <= getMinimum())
+        return;
+
+    auto track = getLookAndFeel().getSliderLayout(*this).sliderBounds;
+    const int numPixels = track.getWidth();
+    if (numPixels <= 0)
+        return;
+
+    //one peak per pixel column, so the cost only depends on the width
+    waveformPeaks.resize(numPixels);
+    if (!waveform->getPeaks(proportionOfLengthToValue(0), proportionOfLengthToValue(1), numPixels, waveformPeaks.data()))
+        return;
+
+    const float centreY = track.toFloat().getCentreY();
+    const float halfHeight = juce::jmin(track.getHeight() * 0.5f, 14.0f);
+    const juce::Colour peakCol = juce::Colours::lightblue.withAlpha(0.35f);
+    const juce::Colour rmsCol = juce::Colours::lightblue.withAlpha(0.6f);
+
+    //collected first and filled in one go each, a fill per column is too slow for smooth scrolling without a gpu
+    peakRects.clear();
+    rmsRects.clear();
+    peakRects.ensureStorageAllocated(numPixels);
+    rmsRects.ensureStorageAllocated(numPixels);
+
+    for (int px = 0; px < numPixels; ++px) {
+        const WaveformPyramid::Peak& peak = waveformPeaks[px];
+        if (!peak.known)
+            continue;
+
+        const float x = (float)(track.getX() + px);
+        const float top = centreY - peak.max * halfHeight;
+        const float bottom = centreY - peak.min * halfHeight;
+        peakRects.addWithoutMerging({ x, top, 1.0f, juce::jmax(1.0f, bottom - top) });
+
+        const float rms = juce::jmin(peak.rms, juce::jmax(peak.max, -peak.min));
+        rmsRects.addWithoutMerging({ x, centreY - rms * halfHeight, 1.0f, juce::jmax(1.0f, 2 * rms * halfHeight) });
+    }
+
+    g.setColour(peakCol);
+    g.fillRectList(peakRects);
+    g.setColour(rmsCol);
+    g.fillRectList(rmsRects);
+}
+
+void TimeLine::setFrameCallbacksActive(bool shouldBeActive)
+{
+    if (!shouldBeActive) {
+        vBlank.reset();
+    }
+    else if (vBlank == nullptr) {
+        vBlank = std::make_unique<juce::VBlankAttachment>(this, [this] {
+            if (onFrame)
+                onFrame();
+        });
+    }
+}
+
+void TimeLine::setWaveform(WaveformPyramid* newWaveform)
+{
+    waveform = newWaveform;
+    repaintStaticLayer();
+}
+
+void TimeLine::setVisibleRange(double startSeconds, double lengthSeconds)
+{
+    const double total = getMaximum() - getMinimum();
+    if (total <= 0) {
+        viewLength = 0;
+        repaintStaticLayer();
+        return;
+    }
+
+    const int width = juce::jmax(1, getLookAndFeel().getSliderLayout(*this).sliderBounds.getWidth());
+    if (sampleRate > 0)
+        lengthSeconds = juce::jmax(lengthSeconds, width / (maxPixelsPerSample * sampleRate));
+
+    if (lengthSeconds >= total) {
+        viewStart = 0;
+        viewLength = 0;
+    }
+    else {
+        viewStart = juce::jlimit(getMinimum(), getMaximum() - lengthSeconds, startSeconds);
+        viewLength = lengthSeconds;
+        if (waveform != nullptr)
+            waveform->requestDetail(viewStart, viewStart + viewLength);
+    }
+
+    updateLoopMarkers();
+    repaintStaticLayer();
+}
+
+void TimeLine::resetZoom()
+{
+    setVisibleRange(getMinimum(), getMaximum() - getMinimum());
+}
+
+double TimeLine::proportionOfLengthToValue(double proportion)
+{
+    if (!isZoomed())
+        return juce::Slider::proportionOfLengthToValue(proportion);
+
+    return viewStart + proportion * viewLength;
+}
+
+double TimeLine::valueToProportionOfLength(double value)
+{
+    if (!isZoomed())
+        return juce::Slider::valueToProportionOfLength(value);
+
+    //parts outside of the view stick to the edges
+    return juce::jlimit(0.0, 1.0, (value - viewStart) / viewLength);
+}
+
+void TimeLine::mouseWheelMove(const juce::MouseEvent& e, const juce::MouseWheelDetails& wheel)
+{
+    const double shownLength = isZoomed() ? viewLength : getMaximum() - getMinimum();
+
+    if (e.mods.isCommandDown()) {
+        //zooming around the time under the mouse, so it stays where it is
+        const double anchor = getValueFromPosition(e);
+        const double anchorProportion = isZoomed() ? (anchor - viewStart) / viewLength : valueToProportionOfLength(anchor);
+        const double newLength = shownLength * std::exp(-(wheel.isReversed ? -wheel.deltaY : wheel.deltaY) * 2.0);
+        setVisibleRange(anchor - anchorProportion * newLength, newLength);
+    }
+    else if (isZoomed()) {
+        const float delta = std::abs(wheel.deltaX) > std::abs(wheel.deltaY) ? -wheel.deltaX : wheel.deltaY;
+        setVisibleRange(viewStart - (wheel.isReversed ? -delta : delta) * viewLength, viewLength);
+    }
+    else {
+        juce::Slider::mouseWheelMove(e, wheel);
+    }
+}
+
+void TimeLine::valueChanged()
+{
+    //changed by the user, the slider repaints everything anyway
+    playheadValue = getValue();
+}
+
 void TimeLine::resized()
 {
     
     juce::Slider::resized();
+    staticLayerValid = false;
 
     positionInputBox();
 
@@ -273,7 +503,7 @@ void TimeLine::resized()
 
 void TimeLine::positionInputBox(double time) {
 
-    double value = time >= 0 ? time : getValue();
+    double value = time >= 0 ? time : playheadValue;
     inputBox.setText(getTextFromValue(value));
 
     float inputBoxWidth = inputBox.getFont().getStringWidthFloat(inputBox.getText()) + inputBox.getLeftIndent() * 2;
@@ -440,7 +670,8 @@ void TimeLine::mouseDown(const juce::MouseEvent& e)
         updateTimeInInputbox = false;
     }
     else {
-        //normal slider behavior
+        //normal slider behavior, starting from where the playhead is shown
+        juce::Slider::setValue(playheadValue, juce::dontSendNotification);
         juce::Slider::mouseDown(e);
         startShowingInputBox();
     }
@@ -481,6 +712,9 @@ void TimeLine::mouseDoubleClick(const juce::MouseEvent& e)
         loopMarkerClick(getValueFromPosition(e), true, true);
 
     }
+    else if (e.mods.isCommandDown()) {
+        resetZoom();
+    }
     else {
         //normal slider behavior
         juce::Slider::mouseDoubleClick(e);
@@ -499,7 +733,7 @@ void TimeLine::childrenChanged()
         timeStampBox = findTimeStampBox();
         if (timeStampBox != nullptr) {
             juce::TextEditor* te = timeStampBox->getCurrentTextEditor();
-            te->setText(getTextFromValue(getValue()), juce::NotificationType::sendNotificationAsync);
+            te->setText(getTextFromValue(playheadValue), juce::NotificationType::sendNotificationAsync);
             te->setJustification(juce::Justification::centred);
             te->moveCaretToEnd();
             te->selectAll();
@@ -513,13 +747,14 @@ void TimeLine::setLoopMarkersActive(bool active) {
 
     leftMarker.setActive(active);
     rightMarker.setActive(active);
-    repaint();
+    repaintStaticLayer();
 
 }
 
 void TimeLine::setWholeLoopMarkersActive(bool active)
 {
     wholeLoopActive = active;
+    repaintStaticLayer();
 }
 
 const juce::Image TimeLine::getActiveLoopMarkerIcon()
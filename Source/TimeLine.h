@@ -1,6 +1,7 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "WaveformPyramid.h"
 
 
 class TimeLine;
@@ -16,7 +17,9 @@ public:
         outlineColour
     };
 
-    void paint(juce::Graphics& g) override;
+    //drawn by the TimeLine into its cached layer, the component is only there for the mouse
+    void paint(juce::Graphics&) override {}
+    void drawOnto(juce::Graphics& g);
 
 
     void resized() override;
@@ -55,22 +58,42 @@ private:
     void createIcons();
 };
 
-class TimeLine : public juce::Slider,
-    public juce::Timer
+class TimeLine : public juce::Slider
 {
 public:
     TimeLine();
     ~TimeLine() {};
     
-    std::function<void()> onTimerCallback;
+    /// <summary>
+    /// called before every frame of the display the TimeLine is shown on, to move the playhead
+    /// </summary>
+    std::function<void()> onFrame;
+
+    /// <summary>
+    /// stops and restarts the onFrame callbacks, they cost a wake up per frame even if nothing moves
+    /// </summary>
+    void setFrameCallbacksActive(bool shouldBeActive);
     std::function<void(bool)> onValueChange;
     std::function<void(double, double)> onLoopMarkerChange;
 
-    double guiRefreshTime = 50; //ms;
     bool mouseIsDragged = false;
 
     void paint(juce::Graphics& g);
     void resized();
+    void lookAndFeelChanged() override;
+
+    /// <summary>
+    /// moves the playhead and repaints only the part of the TimeLine it moved over, the cheap way to follow playback.
+    /// The value of the Slider isn't touched by it, the time box is updated directly.
+    /// </summary>
+    void setPlayheadPosition(double seconds);
+    double getPlayheadPosition() const { return playheadValue; }
+
+    /// <summary>
+    /// redraws the cached background (track, waveform, loop markers) on the next paint.
+    /// Needed after anything drawn into it changed, the TimeLine does this itself for its own changes.
+    /// </summary>
+    void repaintStaticLayer();
 
 
     void positionInputBox(double time=-1);
@@ -103,8 +126,52 @@ public:
     void setWholeLoopMarkersActive(bool active);
     const juce::Image getActiveLoopMarkerIcon();
 
+    /// <summary>
+    /// overview of the file drawn behind the slider track, nullptr for none. Has to outlive the TimeLine or be reset.
+    /// </summary>
+    void setWaveform(WaveformPyramid* newWaveform);
+
+    /// <summary>
+    /// shows only the time from startSeconds to startSeconds + lengthSeconds on the whole width. Clamped to the range and to
+    /// a few pixels per sample, a length covering the whole range shows everything again.
+    /// </summary>
+    void setVisibleRange(double startSeconds, double lengthSeconds);
+    void resetZoom();
+    bool isZoomed() const { return viewLength > 0; }
+
+    /// <summary>
+    /// sample rate of the file, limits how far can be zoomed in
+    /// </summary>
+    void setSampleRate(double newSampleRate) { sampleRate = newSampleRate; }
+
+    //map the visible part instead of the whole range, so thumb, loop markers and dragging follow the zoom
+    double proportionOfLengthToValue(double proportion) override;
+    double valueToProportionOfLength(double value) override;
+
+    void mouseWheelMove(const juce::MouseEvent& e, const juce::MouseWheelDetails& wheel) override;
+    void valueChanged() override;
+
 private:
-    void timerCallback() final { onTimerCallback(); };
+    void paintStaticLayer(juce::Graphics& g);
+    void paintPlayhead(juce::Graphics& g);
+    juce::Rectangle<int> getPlayheadArea(double value);
+    juce::Image staticLayer;
+    bool staticLayerValid = false;
+    double playheadValue = 0;
+
+    void paintWaveform(juce::Graphics& g);
+    WaveformPyramid* waveform = nullptr;
+    std::vector<WaveformPyramid::Peak> waveformPeaks;
+    juce::RectangleList<float> peakRects;
+    juce::RectangleList<float> rmsRects;
+
+    //0 length if not zoomed
+    double viewStart = 0;
+    double viewLength = 0;
+    double sampleRate = 0;
+    static constexpr double maxPixelsPerSample = 8;
+
+    std::unique_ptr<juce::VBlankAttachment> vBlank;
     LoopMarker leftMarker = LoopMarker(this);
     LoopMarker rightMarker = LoopMarker(this);
 
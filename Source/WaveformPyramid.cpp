@@ -0,0 +1,575 @@
+#include "WaveformPyramid.h"
+
+namespace
+{
+    //level 0 blocks per block of the top level, segments and chunks are aligned to it so every level is complete per chunk
+    constexpr juce::int64 topLevelBlocks = 1024;
+    static_assert(topLevelBlocks == 4 * 4 * 4 * 4 * 4, "topLevelBlocks has to be levelFactor ^ (numLevels - 1)");
+
+    const juce::uint32 cacheMagic = 0x4c415057;   //"LAPW"
+    const int cacheVersion = 2;                   //2: key of the file stored, for finding entries of files which are gone
+
+    //four independent sums, so the compiler can keep them in one vector register
+    float sumOfSquares(const float* data, int numSamples)
+    {
+        float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        int i = 0;
+        for (; i + 4 <= numSamples; i += 4) {
+            s0 += data[i] * data[i];
+            s1 += data[i + 1] * data[i + 1];
+            s2 += data[i + 2] * data[i + 2];
+            s3 += data[i + 3] * data[i + 3];
+        }
+        for (; i < numSamples; ++i)
+            s0 += data[i] * data[i];
+
+        return s0 + s1 + s2 + s3;
+    }
+
+    juce::int16 toStored(float value)
+    {
+        return (juce::int16)juce::roundToInt(juce::jlimit(-1.0f, 1.0f, value) * 32767.0f);
+    }
+
+    float fromStored(juce::int16 value)
+    {
+        return value / 32767.0f;
+    }
+}
+
+WaveformPyramid::WaveformPyramid(FormatSniffer& sniffer_, const juce::File& cacheDirectory_)
+    : sniffer(sniffer_),
+      cacheDirectory(cacheDirectory_)
+{
+}
+
+WaveformPyramid::~WaveformPyramid()
+{
+    clear();
+    JobSystem::getShared().cancelAndWait(jobs);
+    cancelPendingUpdate();
+    progressTimer.stopTimer();
+}
+
+void WaveformPyramid::setFile(const juce::File& file)
+{
+    clear();
+
+    auto data = std::make_shared<Data>();
+    data->file = file;
+    {
+        const juce::ScopedLock sl(dataLock);
+        current = data;
+    }
+
+    JobSystem::getShared().run(JobSystem::Priority::analysis, [this, data] { setUp(data); }, jobs);
+}
+
+void WaveformPyramid::clear()
+{
+    const juce::ScopedLock sl(dataLock);
+    if (current != nullptr)
+        current->cancelled = true;
+    current.reset();
+    detail.reset();
+}
+
+size_t WaveformPyramid::getMemoryUsage() const
+{
+    const juce::ScopedLock sl(dataLock);
+    size_t bytes = 0;
+
+    //the levels are only allocated once the setup job is done
+    if (current != nullptr && current->ready.load(std::memory_order_acquire)) {
+        for (const auto& level : current->levels)
+            bytes += level.capacity() * sizeof(StoredPeak);
+        if (current->flac != nullptr)
+            bytes += current->flac->getMemoryUsage();
+    }
+
+    if (detail != nullptr)
+        bytes += (detail->min.capacity() + detail->max.capacity()) * sizeof(float);
+
+    return bytes;
+}
+
+std::vector<MemoryBudget::Entry> WaveformPyramid::getEvictableEntries() const
+{
+    //the levels of the file shown are always needed, the detail is decoded again when zooming in
+    const juce::ScopedLock sl(dataLock);
+    if (detail == nullptr)
+        return {};
+
+    return { { 0, (detail->min.capacity() + detail->max.capacity()) * sizeof(float), 1.0 } };
+}
+
+void WaveformPyramid::evict(juce::int64 /*id*/)
+{
+    const juce::ScopedLock sl(dataLock);
+    detail.reset();
+}
+
+juce::int64 WaveformPyramid::getBlockSize(int level)
+{
+    juce::int64 size = baseBlockSize;
+    for (int i = 0; i < level; ++i)
+        size *= levelFactor;
+    return size;
+}
+
+void WaveformPyramid::setUp(const std::shared_ptr<Data>& data)
+{
+    if (data->cancelled)
+        return;
+
+    std::unique_ptr<juce::AudioFormatReader> reader(sniffer.createReaderFor(data->file));
+    if (reader == nullptr || reader->lengthInSamples <= 0 || reader->sampleRate <= 0)
+        return;
+
+    data->sampleRate = reader->sampleRate;
+    data->numSamples = reader->lengthInSamples;
+
+    data->cacheKey = getCacheKey(data->file);
+    data->cacheFile = cacheDirectory.getChildFile(juce::String::toHexString(data->cacheKey.hashCode64()) + ".peaks");
+
+    data->levels.resize(numLevels);
+    for (int level = 0; level < numLevels; ++level) {
+        const juce::int64 blockSize = getBlockSize(level);
+        data->levels[level].resize((size_t)((data->numSamples + blockSize - 1) / blockSize));
+    }
+
+    const juce::int64 numBlocks = (juce::int64)data->levels[0].size();
+
+    if (readCache(*data)) {
+        //last use for pruneCache, access times aren't reliable with noatime
+        data->cacheFile.setLastModificationTime(juce::Time::getCurrentTime());
+
+        data->segmentBlocks = numBlocks;
+        data->segments.push_back(std::make_unique<Segment>());
+        data->segments[0]->endBlock = numBlocks;
+        data->segments[0]->blocksDone = numBlocks;
+        data->ready.store(true, std::memory_order_release);
+        memoryUsageGrew();
+        triggerAsyncUpdate();
+        return;
+    }
+
+    data->flac = ParallelFlacDecoder::open(data->file, sniffer, [&data] { return data->cancelled.load(); });
+
+    //a few segments per thread, so one slow part doesn't hold back the rest
+    const juce::int64 numTopBlocks = (numBlocks + topLevelBlocks - 1) / topLevelBlocks;
+    const juce::int64 numSegments = juce::jlimit((juce::int64)1, (juce::int64)JobSystem::getShared().getNumWorkers() * 2, numTopBlocks);
+    data->segmentBlocks = (numTopBlocks + numSegments - 1) / numSegments * topLevelBlocks;
+
+    for (juce::int64 start = 0; start < numBlocks; start += data->segmentBlocks) {
+        auto segment = std::make_unique<Segment>();
+        segment->startBlock = start;
+        segment->endBlock = juce::jmin(start + data->segmentBlocks, numBlocks);
+        data->segments.push_back(std::move(segment));
+    }
+
+    data->ready.store(true, std::memory_order_release);
+    memoryUsageGrew();
+
+    std::vector<JobSystem::Handle> analysed;
+    for (auto& segment : data->segments) {
+        Segment* s = segment.get();
+        analysed.push_back(JobSystem::getShared().run(JobSystem::Priority::analysis, [this, data, s] { analyseSegment(data, *s); }, jobs));
+    }
+
+    //cached once all segments are done
+    JobSystem::getShared().run(JobSystem::Priority::analysis, [this, data, numBlocks] {
+        if (!data->cancelled && isAnalysed(*data, 0, numBlocks)) {
+            writeCache(*data);
+            pruneCache();
+        }
+    }, jobs, analysed);
+}
+
+void WaveformPyramid::analyseSegment(const std::shared_ptr<Data>& data, Segment& segment)
+{
+    std::unique_ptr<juce::AudioFormatReader> reader;
+    juce::int64 readerStart = 0;
+    if (!data->cancelled) {
+        if (data->flac != nullptr) {
+            readerStart = segment.startBlock * baseBlockSize;
+            reader = data->flac->createReader(readerStart);
+        }
+        else {
+            reader.reset(sniffer.createReaderFor(data->file));
+        }
+    }
+
+    if (reader != nullptr) {
+        const int numChannels = juce::jmax(1, (int)reader->numChannels);
+        juce::AudioBuffer<float> buffer(numChannels, (int)(topLevelBlocks * baseBlockSize));
+        std::vector<StoredPeak>& peaks = data->levels[0];
+
+        for (juce::int64 block = segment.startBlock; block < segment.endBlock && !data->cancelled; block += topLevelBlocks) {
+            const juce::int64 endBlock = juce::jmin(block + topLevelBlocks, segment.endBlock);
+            const juce::int64 startSample = block * baseBlockSize;
+            const int numSamples = (int)(juce::jmin(endBlock * baseBlockSize, data->numSamples) - startSample);
+
+            reader->read(&buffer, 0, numSamples, startSample - readerStart, true, true);
+
+            for (juce::int64 b = block; b < endBlock; ++b) {
+                const int offset = (int)((b - block) * baseBlockSize);
+                const int length = juce::jmin(baseBlockSize, numSamples - offset);
+
+                juce::Range<float> range = juce::FloatVectorOperations::findMinAndMax(buffer.getReadPointer(0, offset), length);
+                float sum = sumOfSquares(buffer.getReadPointer(0, offset), length);
+                for (int channel = 1; channel < numChannels; ++channel) {
+                    range = range.getUnionWith(juce::FloatVectorOperations::findMinAndMax(buffer.getReadPointer(channel, offset), length));
+                    sum += sumOfSquares(buffer.getReadPointer(channel, offset), length);
+                }
+
+                const float rms = std::sqrt(sum / (float)(length * numChannels));
+                peaks[(size_t)b] = { toStored(range.getStart()), toStored(range.getEnd()), toStored(rms) };
+            }
+
+            aggregate(*data, block, endBlock);
+            segment.blocksDone.store(endBlock - segment.startBlock, std::memory_order_release);
+            triggerAsyncUpdate();
+        }
+    }
+}
+
+void WaveformPyramid::aggregate(Data& data, juce::int64 startBlock, juce::int64 endBlock)
+{
+    for (int level = 1; level < numLevels; ++level) {
+        startBlock /= levelFactor;
+        endBlock = (endBlock + levelFactor - 1) / levelFactor;
+
+        const std::vector<StoredPeak>& below = data.levels[(size_t)level - 1];
+        std::vector<StoredPeak>& peaks = data.levels[(size_t)level];
+
+        for (juce::int64 i = startBlock; i < juce::jmin(endBlock, (juce::int64)peaks.size()); ++i) {
+            const size_t first = (size_t)(i * levelFactor);
+            const size_t last = juce::jmin(first + levelFactor, below.size());
+
+            StoredPeak combined = below[first];
+            float sumOfRmsSquares = 0;
+            for (size_t j = first; j < last; ++j) {
+                combined.min = juce::jmin(combined.min, below[j].min);
+                combined.max = juce::jmax(combined.max, below[j].max);
+                sumOfRmsSquares += fromStored(below[j].rms) * fromStored(below[j].rms);
+            }
+            combined.rms = toStored(std::sqrt(sumOfRmsSquares / (float)(last - first)));
+            peaks[(size_t)i] = combined;
+        }
+    }
+}
+
+bool WaveformPyramid::isAnalysed(const Data& data, juce::int64 startBlock, juce::int64 endBlock)
+{
+    for (juce::int64 s = startBlock / data.segmentBlocks; s < (juce::int64)data.segments.size(); ++s) {
+        const Segment& segment = *data.segments[(size_t)s];
+        if (segment.startBlock >= endBlock)
+            break;
+
+        const juce::int64 doneUntil = segment.startBlock + segment.blocksDone.load(std::memory_order_acquire);
+        if (doneUntil < juce::jmin(endBlock, segment.endBlock))
+            return false;
+    }
+    return true;
+}
+
+void WaveformPyramid::requestDetail(double startSeconds, double endSeconds)
+{
+    std::shared_ptr<Data> data;
+    std::shared_ptr<const Detail> known;
+    {
+        const juce::ScopedLock sl(dataLock);
+        data = current;
+        known = detail;
+    }
+
+    if (data == nullptr || !data->ready.load(std::memory_order_acquire))
+        return;
+
+    const juce::int64 startSample = juce::jmax((juce::int64)0, (juce::int64)std::floor(startSeconds * data->sampleRate));
+    const juce::int64 endSample = juce::jmin(data->numSamples, (juce::int64)std::ceil(endSeconds * data->sampleRate));
+    const juce::int64 length = endSample - startSample;
+    if (length <= 0 || length > maxDetailSamples / 3)
+        return;
+
+    if (known != nullptr && known->data == data && known->startSample <= startSample && known->getEndSample() >= endSample)
+        return;
+
+    //the same length again on both sides, so panning a bit doesn't have to wait for the decoder
+    const int generation = ++detailGeneration;
+    const juce::int64 from = juce::jmax((juce::int64)0, startSample - length);
+    const juce::int64 to = juce::jmin(data->numSamples, endSample + length);
+    JobSystem::getShared().run(JobSystem::Priority::interactive, [this, data, from, to, generation] { decodeDetail(data, from, to, generation); }, jobs);
+}
+
+void WaveformPyramid::decodeDetail(const std::shared_ptr<Data>& data, juce::int64 startSample, juce::int64 endSample, int generation)
+{
+    //a newer request makes this one useless
+    if (generation != detailGeneration || data->cancelled)
+        return;
+
+    const int numSamples = (int)(endSample - startSample);
+    juce::AudioBuffer<float> buffer;
+
+    //FLAC is decoded in parts on all workers, this one included. It is only indexed when the peaks weren't cached,
+    //indexing the whole file would read more than the detail needs
+    if (const ParallelFlacDecoder* flac = data->flac.get()) {
+        buffer.setSize(juce::jmax(1, flac->getNumChannels()), numSamples);
+        auto outdated = [this, data, generation] { return generation != detailGeneration || data->cancelled; };
+        if (!flac->decode(buffer, 0, startSample, numSamples, JobSystem::getShared(), JobSystem::Priority::interactive, outdated))
+            return;
+    }
+    else {
+        std::unique_ptr<juce::AudioFormatReader> reader(sniffer.createReaderFor(data->file));
+        if (reader == nullptr)
+            return;
+
+        buffer.setSize(juce::jmax(1, (int)reader->numChannels), numSamples);
+        reader->read(&buffer, 0, numSamples, startSample, true, true);
+    }
+
+    const int numChannels = buffer.getNumChannels();
+
+    auto decoded = std::make_shared<Detail>();
+    decoded->data = data;
+    decoded->startSample = startSample;
+    decoded->min.assign(buffer.getReadPointer(0), buffer.getReadPointer(0) + numSamples);
+    decoded->max = decoded->min;
+    for (int channel = 1; channel < numChannels; ++channel) {
+        juce::FloatVectorOperations::min(decoded->min.data(), decoded->min.data(), buffer.getReadPointer(channel), numSamples);
+        juce::FloatVectorOperations::max(decoded->max.data(), decoded->max.data(), buffer.getReadPointer(channel), numSamples);
+    }
+
+    {
+        const juce::ScopedLock sl(dataLock);
+        if (current != data)
+            return;
+        detail = decoded;
+    }
+    memoryUsageGrew();
+    triggerAsyncUpdate();
+}
+
+bool WaveformPyramid::getPeaks(double startSeconds, double endSeconds, int numPixels, Peak* peaks) const
+{
+    std::shared_ptr<Data> data;
+    std::shared_ptr<const Detail> samples;
+    {
+        const juce::ScopedLock sl(dataLock);
+        data = current;
+        samples = detail;
+    }
+
+    if (numPixels <= 0)
+        return false;
+
+    for (int px = 0; px < numPixels; ++px)
+        peaks[px] = Peak();
+
+    if (data == nullptr || !data->ready.load(std::memory_order_acquire) || endSeconds <= startSeconds)
+        return false;
+
+    //the coarsest level that still has at least one peak per pixel, so every pixel combines only a few peaks
+    const double samplesPerPixel = (endSeconds - startSeconds) * data->sampleRate / numPixels;
+    int level = 0;
+    while (level + 1 < numLevels && getBlockSize(level + 1) <= samplesPerPixel)
+        ++level;
+
+    const std::vector<StoredPeak>& stored = data->levels[(size_t)level];
+    const juce::int64 blockSize = getBlockSize(level);
+    const juce::int64 baseBlocksPerBlock = blockSize / baseBlockSize;
+    const juce::int64 numBaseBlocks = (juce::int64)data->levels[0].size();
+    const juce::int64 numBlocks = (juce::int64)stored.size();
+
+    //finer than level 0, single samples are drawn where they are decoded
+    const bool useSamples = samplesPerPixel < baseBlockSize && samples != nullptr && samples->data == data;
+
+    bool anyKnown = false;
+    for (int px = 0; px < numPixels; ++px) {
+        const double firstSample = startSeconds * data->sampleRate + px * samplesPerPixel;
+        const double endSample = firstSample + samplesPerPixel;
+        if (endSample <= 0 || firstSample >= (double)data->numSamples)
+            continue;
+
+        if (useSamples) {
+            const juce::int64 from = juce::jmax((juce::int64)0, (juce::int64)std::floor(firstSample));
+            const juce::int64 to = juce::jmax(from + 1, (juce::int64)std::ceil(endSample));
+            if (from >= samples->startSample && to <= samples->getEndSample()) {
+                Peak& peak = peaks[px];
+                const size_t offset = (size_t)(from - samples->startSample);
+                peak.min = samples->min[offset];
+                peak.max = samples->max[offset];
+                float sumOfSquares = 0;
+                for (size_t i = offset; i < offset + (size_t)(to - from); ++i) {
+                    peak.min = juce::jmin(peak.min, samples->min[i]);
+                    peak.max = juce::jmax(peak.max, samples->max[i]);
+                    sumOfSquares += 0.5f * (samples->min[i] * samples->min[i] + samples->max[i] * samples->max[i]);
+                }
+                peak.rms = std::sqrt(sumOfSquares / (float)(to - from));
+                peak.known = true;
+                anyKnown = true;
+                continue;
+            }
+        }
+
+        const juce::int64 first = juce::jmax((juce::int64)0, (juce::int64)std::floor(firstSample / blockSize));
+        const juce::int64 last = juce::jmin(numBlocks, juce::jmax(first + 1, (juce::int64)std::ceil(endSample / blockSize)));
+
+        if (!isAnalysed(*data, first * baseBlocksPerBlock, juce::jmin(last * baseBlocksPerBlock, numBaseBlocks)))
+            continue;
+
+        Peak& peak = peaks[px];
+        peak.min = fromStored(stored[(size_t)first].min);
+        peak.max = fromStored(stored[(size_t)first].max);
+        float sumOfRmsSquares = 0;
+        for (juce::int64 b = first; b < last; ++b) {
+            peak.min = juce::jmin(peak.min, fromStored(stored[(size_t)b].min));
+            peak.max = juce::jmax(peak.max, fromStored(stored[(size_t)b].max));
+            sumOfRmsSquares += fromStored(stored[(size_t)b].rms) * fromStored(stored[(size_t)b].rms);
+        }
+        peak.rms = std::sqrt(sumOfRmsSquares / (float)(last - first));
+        peak.known = true;
+        anyKnown = true;
+    }
+
+    return anyKnown;
+}
+
+double WaveformPyramid::getProgress() const
+{
+    std::shared_ptr<Data> data;
+    {
+        const juce::ScopedLock sl(dataLock);
+        data = current;
+    }
+
+    if (data == nullptr || !data->ready.load(std::memory_order_acquire) || data->levels[0].empty())
+        return 0;
+
+    juce::int64 done = 0;
+    for (const auto& segment : data->segments)
+        done += segment->blocksDone.load(std::memory_order_acquire);
+
+    return (double)done / (double)data->levels[0].size();
+}
+
+juce::String WaveformPyramid::getCacheKey(const juce::File& file)
+{
+    return file.getFullPathName() + "|" + juce::String(file.getSize()) + "|" + juce::String(file.getLastModificationTime().toMilliseconds());
+}
+
+bool WaveformPyramid::readCache(Data& data)
+{
+    juce::FileInputStream in(data.cacheFile);
+    if (in.failedToOpen())
+        return false;
+
+    if ((juce::uint32)in.readInt() != cacheMagic || in.readInt() != cacheVersion || in.readString() != data.cacheKey
+        || in.readInt() != numLevels || in.readInt() != baseBlockSize || in.readInt() != levelFactor
+        || in.readDouble() != data.sampleRate || in.readInt64() != data.numSamples)
+        return false;
+
+    for (std::vector<StoredPeak>& peaks : data.levels) {
+        if (in.readInt64() != (juce::int64)peaks.size())
+            return false;
+
+        const size_t numBytes = peaks.size() * sizeof(StoredPeak);
+        if ((size_t)in.read(peaks.data(), (int)numBytes) != numBytes)
+            return false;
+    }
+
+    return true;
+}
+
+void WaveformPyramid::writeCache(const Data& data)
+{
+    data.cacheFile.getParentDirectory().createDirectory();
+
+    juce::TemporaryFile temp(data.cacheFile);
+    {
+        juce::FileOutputStream out(temp.getFile());
+        if (out.failedToOpen())
+            return;
+
+        out.writeInt((int)cacheMagic);
+        out.writeInt(cacheVersion);
+        out.writeString(data.cacheKey);
+        out.writeInt(numLevels);
+        out.writeInt(baseBlockSize);
+        out.writeInt(levelFactor);
+        out.writeDouble(data.sampleRate);
+        out.writeInt64(data.numSamples);
+
+        for (const std::vector<StoredPeak>& peaks : data.levels) {
+            out.writeInt64((juce::int64)peaks.size());
+            out.write(peaks.data(), peaks.size() * sizeof(StoredPeak));
+        }
+
+        out.flush();
+        if (out.getStatus().failed())
+            return;
+    }
+
+    temp.overwriteTargetFileWithTemporary();
+}
+
+void WaveformPyramid::pruneCache()
+{
+    struct Entry
+    {
+        juce::File file;
+        juce::int64 size;
+        juce::Time lastUsed;
+    };
+
+    std::vector<Entry> entries;
+    juce::int64 total = 0;
+
+    for (const juce::DirectoryEntry& entry : juce::RangedDirectoryIterator(cacheDirectory, false, "*.peaks", juce::File::findFiles)) {
+        if (!orphansRemoved) {
+            //the key is path|size|modification time of the file the entry was made for
+            juce::FileInputStream in(entry.getFile());
+            juce::String key;
+            if ((juce::uint32)in.readInt() == cacheMagic && in.readInt() == cacheVersion)
+                key = in.readString();
+
+            const juce::File source(key.upToLastOccurrenceOf("|", false, false).upToLastOccurrenceOf("|", false, false));
+            if (key.isEmpty() || !source.existsAsFile() || getCacheKey(source) != key) {
+                entry.getFile().deleteFile();
+                continue;
+            }
+        }
+
+        entries.push_back({ entry.getFile(), entry.getFileSize(), entry.getModificationTime() });
+        total += entry.getFileSize();
+    }
+    orphansRemoved = true;
+
+    if (total <= maxCacheBytes)
+        return;
+
+    //least recently used first, a cache hit touches the entry
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.lastUsed < b.lastUsed; });
+    for (const Entry& entry : entries) {
+        if (total <= maxCacheBytes)
+            break;
+        if (entry.file.deleteFile())
+            total -= entry.size;
+    }
+}
+
+void WaveformPyramid::handleAsyncUpdate()
+{
+    //chunks finish far more often than the waveform needs repainting, the last one always gets through
+    const juce::uint32 sinceLast = juce::Time::getMillisecondCounter() - lastProgress;
+    if (sinceLast < (juce::uint32)minProgressInterval) {
+        if (!progressTimer.isTimerRunning())
+            progressTimer.startTimer(minProgressInterval - (int)sinceLast);
+        return;
+    }
+
+    lastProgress = juce::Time::getMillisecondCounter();
+    if (onProgress)
+        onProgress();
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "FormatSniffer.h"
+#include "ParallelFlacDecoder.h"
+#include "JobSystem.h"
+#include "MemoryBudget.h"
+
+
+/// <summary>
+/// Min/max/rms overview of an audio file in several levels of detail, for drawing the waveform behind the TimeLine.
+/// Level 0 has one peak per baseBlockSize samples, every further level combines levelFactor peaks of the level below.
+/// The file is analysed in parallel segments on the JobSystem and the finished parts can be drawn right away.
+/// FLAC files are indexed first, so every segment starts at a frame instead of seeking and the samples for zooming in are decoded in parallel.
+/// Finished pyramids are cached on disk per file (path, size and modification time), so reopening a file is instant.
+/// The disk cache is kept below maxCacheBytes, the entries used least recently go first, and entries of files which
+/// are gone or changed are removed.
+/// Peaks are only read from the level fitting the requested resolution, so getPeaks costs O(pixels) for any file length.
+/// The samples decoded for zooming in are given up when the MemoryBudget needs room.
+/// </summary>
+class WaveformPyramid : public MemoryBudget::Cache,
+                        private juce::AsyncUpdater
+{
+public:
+    WaveformPyramid(FormatSniffer& sniffer, const juce::File& cacheDirectory);
+    ~WaveformPyramid() override;
+
+    static constexpr int baseBlockSize = 256;
+    static constexpr int levelFactor = 4;
+    static constexpr int numLevels = 6;
+
+    struct Peak
+    {
+        float min = 0;
+        float max = 0;
+        float rms = 0;
+        bool known = false;     //false where that part of the file isn't analysed yet
+    };
+
+    /// <summary>
+    /// drops the current pyramid and starts loading or building the one for file
+    /// </summary>
+    void setFile(const juce::File& file);
+    void clear();
+
+    /// <summary>
+    /// one peak per pixel for the time from startSeconds to endSeconds, spread evenly over numPixels.
+    /// </summary>
+    /// <returns>false if nothing of the file is known yet</returns>
+    bool getPeaks(double startSeconds, double endSeconds, int numPixels, Peak* peaks) const;
+
+    /// <summary>
+    /// decodes the samples around this time range in the background, so getPeaks can draw them one by one when zoomed in
+    /// further than level 0. Ranges too long for that are ignored, the levels are used for them anyway.
+    /// </summary>
+    void requestDetail(double startSeconds, double endSeconds);
+
+    /// <summary>
+    /// share of the file that is analysed, 0 to 1
+    /// </summary>
+    double getProgress() const;
+
+    /// <summary>
+    /// called on the message thread when more of the file is analysed, a few times per second at most
+    /// </summary>
+    std::function<void()> onProgress;
+    static constexpr int minProgressInterval = 100;  //ms
+
+    static constexpr juce::int64 maxCacheBytes = (juce::int64)256 << 20;
+
+    const juce::File& getCacheDirectory() const { return cacheDirectory; }
+
+    size_t getMemoryUsage() const override;
+    std::vector<MemoryBudget::Entry> getEvictableEntries() const override;
+    void evict(juce::int64 id) override;
+
+private:
+    //stored with 16 bit, -1..1 mapped to -32767..32767
+    struct StoredPeak
+    {
+        juce::int16 min;
+        juce::int16 max;
+        juce::int16 rms;
+    };
+
+    struct Segment
+    {
+        juce::int64 startBlock = 0;
+        juce::int64 endBlock = 0;
+        std::atomic<juce::int64> blocksDone{ 0 };   //level 0 blocks, all levels above are complete for them too
+    };
+
+    struct Data
+    {
+        juce::File file;
+        juce::File cacheFile;
+        juce::String cacheKey;
+
+        //set by the setup job before ready is set
+        double sampleRate = 0;
+        juce::int64 numSamples = 0;
+        std::vector<std::vector<StoredPeak>> levels;
+        std::vector<std::unique_ptr<Segment>> segments;
+        juce::int64 segmentBlocks = 1;
+        std::unique_ptr<ParallelFlacDecoder> flac;    //frame index of FLAC files, only if the peaks weren't cached
+
+        std::atomic<bool> ready{ false };
+        std::atomic<bool> cancelled{ false };
+    };
+
+    //min and max over all channels for every sample of a short part of the file
+    struct Detail
+    {
+        std::shared_ptr<Data> data;
+        juce::int64 startSample = 0;
+        std::vector<float> min;
+        std::vector<float> max;
+
+        juce::int64 getEndSample() const { return startSample + (juce::int64)min.size(); }
+    };
+
+    static constexpr juce::int64 maxDetailSamples = 1 << 20;
+
+    void setUp(const std::shared_ptr<Data>& data);
+    void decodeDetail(const std::shared_ptr<Data>& data, juce::int64 startSample, juce::int64 endSample, int generation);
+    void analyseSegment(const std::shared_ptr<Data>& data, Segment& segment);
+    static void aggregate(Data& data, juce::int64 startBlock, juce::int64 endBlock);
+
+    static juce::String getCacheKey(const juce::File& file);
+    static bool readCache(Data& data);
+    static void writeCache(const Data& data);
+
+    //removes entries of files which are gone or changed once per run, and the least recently used ones above maxCacheBytes
+    void pruneCache();
+    std::atomic<bool> orphansRemoved{ false };
+
+    static juce::int64 getBlockSize(int level);
+    static bool isAnalysed(const Data& data, juce::int64 startBlock, juce::int64 endBlock);
+
+    void handleAsyncUpdate() override;
+    juce::uint32 lastProgress = 0;
+    juce::TimedCallback progressTimer{ [this] { progressTimer.stopTimer(); handleAsyncUpdate(); } };
+
+    FormatSniffer& sniffer;
+    const juce::File cacheDirectory;
+    JobSystem::CancellationToken jobs;
+
+    mutable juce::CriticalSection dataLock;
+    std::shared_ptr<Data> current;
+    std::shared_ptr<const Detail> detail;
+    std::atomic<int> detailGeneration{ 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(WaveformPyramid)
+};
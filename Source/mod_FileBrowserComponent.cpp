@@ -38,6 +38,84 @@
 namespace juce::mod
 {
 
+//==============================================================================
+/** Lists a directory on the browser's thread like the DirectoryContentsList does and
+    refreshes the browser if the result differs from what it shows. Listing a large
+    directory on a network drive takes seconds, this way the shown list stays meanwhile.
+*/
+class FileBrowserComponent::ContentsCheck : public TimeSliceClient,
+                                            private AsyncUpdater
+{
+public:
+    ContentsCheck (FileBrowserComponent& o) : owner (o) {}
+
+    ~ContentsCheck() override
+    {
+        owner.thread.removeTimeSliceClient (this);
+        cancelPendingUpdate();
+    }
+
+    bool isRunning() const { return running; }
+
+    void start (const File& dir, StringArray&& shown, bool ignoreHidden)
+    {
+        owner.thread.removeTimeSliceClient (this);
+        cancelPendingUpdate();
+
+        directory = dir;
+        shownEntries = std::move (shown);
+        ignoresHidden = ignoreHidden;
+        changed = false;
+        running = true;
+        owner.thread.addTimeSliceClient (this);
+    }
+
+    static String describe (const File& file, bool isDirectory, int64 size, Time modificationTime)
+    {
+        return file.getFileName() + (isDirectory ? "/" : "") + "|" + String (size) + "|" + String (modificationTime.toMilliseconds());
+    }
+
+private:
+    int useTimeSlice() override
+    {
+        StringArray listed;
+        const int whatToLookFor = File::findFilesAndDirectories | (ignoresHidden ? File::ignoreHiddenFiles : 0);
+
+        for (const auto& entry : RangedDirectoryIterator (directory, false, "*", whatToLookFor))
+        {
+            if (owner.thread.threadShouldExit())
+                return -1;
+
+            const File file = entry.getFile();
+            const bool suitable = entry.isDirectory() ? owner.isDirectorySuitable (file)
+                                                      : owner.isFileSuitable (file);
+            if (suitable)
+                listed.add (describe (file, entry.isDirectory(), entry.getFileSize(), entry.getModificationTime()));
+        }
+
+        listed.sort (false);
+        changed = (listed != shownEntries);
+        triggerAsyncUpdate();
+        return -1;
+    }
+
+    void handleAsyncUpdate() override
+    {
+        running = false;
+
+        //the browser may have moved on meanwhile, its new directory is listed anyway
+        if (changed && owner.currentRoot == directory)
+            owner.refresh();
+    }
+
+    FileBrowserComponent& owner;
+    File directory;
+    StringArray shownEntries;
+    bool ignoresHidden = true;
+    std::atomic<bool> changed { false };
+    bool running = false;
+};
+
     FileBrowserComponent::FileBrowserComponent(int flags_,
                                             const File& initialFileOrDirectory,
                                             const FileFilter* fileFilter_,
@@ -112,6 +190,16 @@ namespace juce::mod
     resetRecentPaths();
     currentPathBox.onChange = [this] { updateSelectedPath(); };
 
+    addAndMakeVisible (searchBox);
+    searchBox.setTextToShowWhenEmpty (TRANS ("Search all music libraries"), Colours::grey);
+    searchBox.onTextChange = [this] { updateSearchResults(); };
+    searchBox.onEscapeKey = [this] { searchBox.clear(); updateSearchResults(); };
+    searchBox.onReturnKey = [this] { returnKeyPressed (jmax (0, searchResultsList.getSelectedRow())); };
+
+    searchResultsList.setModel (this);
+    searchResultsList.setOutlineThickness (1);
+    addChildComponent (searchResultsList);
+
     {
         if (! isSaveMode())
             selectionChanged();
@@ -131,6 +219,7 @@ namespace juce::mod
 
 FileBrowserComponent::~FileBrowserComponent()
 {
+    contentsCheck.reset();
     fileListComponent.reset();
     fileList.reset();
     thread.stopThread (10000);
@@ -312,6 +401,44 @@ void FileBrowserComponent::refresh()
     fileList->refresh();
 }
 
+void FileBrowserComponent::directoryContentsChanged (const File& directory)
+{
+    //copying many files gives a burst of events, refresh only once after it
+    if (directory == currentRoot)
+        delayedRefresh.startTimer (300);
+}
+
+void FileBrowserComponent::setRootIsWatched (bool isWatched)
+{
+    rootIsWatched = isWatched;
+}
+
+void FileBrowserComponent::checkContents()
+{
+    const auto now = Time::getMillisecondCounter();
+
+    if (fileList == nullptr || fileList->isStillLoading()
+         || (lastContentsCheck != 0 && now - lastContentsCheck < (uint32) minContentsCheckInterval))
+        return;
+
+    if (contentsCheck == nullptr)
+        contentsCheck = std::make_unique<ContentsCheck> (*this);
+    else if (contentsCheck->isRunning())
+        return;
+
+    lastContentsCheck = now;
+
+    StringArray shown;
+    DirectoryContentsList::FileInfo info;
+
+    for (int i = 0; fileList->getFileInfo (i, info); ++i)
+        shown.add (ContentsCheck::describe (currentRoot.getChildFile (info.filename), info.isDirectory,
+                                            info.fileSize, info.modificationTime));
+
+    shown.sort (false);
+    contentsCheck->start (currentRoot, std::move (shown), fileList->ignoresHiddenFiles());
+}
+
 void FileBrowserComponent::setFileFilter (const FileFilter* const newFileFilter)
 {
     if (fileFilter != newFileFilter)
@@ -363,11 +490,16 @@ void FileBrowserComponent::layoutFileBrowserComponent()
     topSlice.removeFromLeft(spaceBetweenButtons);
     goUpButton.get()->setBounds(topSlice);
 
+    b.removeFromTop(spaceBetweenButtons);
+    searchBox.setBounds(b.removeFromTop(sectionHeight));
+
     if (previewComp != nullptr)
         previewComp->setBounds(b.removeFromRight(b.getWidth() / 3));
 
     if (auto* listAsComp = dynamic_cast<Component*> (fileListComponent.get()))
         listAsComp->setBounds(b.reduced(0, 10));
+
+    searchResultsList.setBounds(b.reduced(0, 10));
 }
 
 //==============================================================================
@@ -468,6 +600,84 @@ void FileBrowserComponent::fileDoubleClicked (const File& f)
 
 void FileBrowserComponent::browserRootChanged (const File&) {}
 
+//==============================================================================
+void FileBrowserComponent::updateSearchResults()
+{
+    const auto query = searchBox.getText().trim();
+    searchResults.clear();
+
+    if (query.isNotEmpty() && onSearch)
+        searchResults = onSearch (query);
+
+    searchResultsList.updateContent();
+    searchResultsList.deselectAllRows();
+    searchResultsList.scrollToEnsureRowIsOnscreen (0);
+    searchResultsList.repaint();
+
+    //the results cover the directory list as long as something is searched
+    const bool isSearching = query.isNotEmpty();
+    searchResultsList.setVisible (isSearching);
+
+    if (auto* listAsComp = dynamic_cast<Component*> (fileListComponent.get()))
+        listAsComp->setVisible (! isSearching);
+}
+
+int FileBrowserComponent::getNumRows()
+{
+    return (int) searchResults.size();
+}
+
+void FileBrowserComponent::paintListBoxItem (int rowNumber, Graphics& g, int width, int height, bool rowIsSelected)
+{
+    if (! isPositiveAndBelow (rowNumber, (int) searchResults.size()))
+        return;
+
+    const auto& result = searchResults[(size_t) rowNumber];
+
+    if (rowIsSelected)
+        g.fillAll (findColour (DirectoryContentsDisplayComponent::highlightColourId));
+
+    auto area = Rectangle<int> (width, height).reduced (4, 0);
+    auto markerArea = area.removeFromLeft (height);
+
+    if (result.hasSavedSettings)
+    {
+        g.setColour (Colours::gold);
+        g.fillEllipse (markerArea.toFloat().reduced ((float) height * 0.3f));
+    }
+
+    const auto textColour = findColour (rowIsSelected ? DirectoryContentsDisplayComponent::highlightedTextColourId
+                                                      : DirectoryContentsDisplayComponent::textColourId);
+    g.setFont ((float) height * 0.6f);
+
+    g.setColour (textColour);
+    g.drawFittedText (result.file.getFileName(), area.removeFromLeft (area.getWidth() / 2), Justification::centredLeft, 1);
+
+    g.setColour (textColour.withMultipliedAlpha (0.6f));
+    g.drawFittedText (result.description, area, Justification::centredRight, 1);
+}
+
+void FileBrowserComponent::listBoxItemClicked (int row, const MouseEvent& e)
+{
+    if (isPositiveAndBelow (row, (int) searchResults.size()))
+        fileClicked (searchResults[(size_t) row].file, e);
+}
+
+void FileBrowserComponent::listBoxItemDoubleClicked (int row, const MouseEvent&)
+{
+    returnKeyPressed (row);
+}
+
+void FileBrowserComponent::returnKeyPressed (int lastRowSelected)
+{
+    if (! isPositiveAndBelow (lastRowSelected, (int) searchResults.size()))
+        return;
+
+    Component::BailOutChecker checker (this);
+    const auto file = searchResults[(size_t) lastRowSelected].file;
+    listeners.callChecked (checker, [&] (FileBrowserListener& l) { l.fileDoubleClicked (file); });
+}
+
 bool FileBrowserComponent::keyPressed ([[maybe_unused]] const KeyPress& key)
 {
    #if JUCE_LINUX || JUCE_BSD || JUCE_WINDOWS
@@ -621,8 +831,9 @@ void FileBrowserComponent::timerCallback()
     {
         wasProcessActive = isProcessActive;
 
-        if (isProcessActive && fileList != nullptr)
-            refresh();
+        //a watched directory is refreshed as soon as it changes, others are only checked
+        if (isProcessActive && ! rootIsWatched)
+            checkContents();
     }
 }
 
@@ -632,6 +843,19 @@ std::unique_ptr<AccessibilityHandler> FileBrowserComponent::createAccessibilityH
     return std::make_unique<AccessibilityHandler> (*this, AccessibilityRole::group);
 }
 
+void FileBrowserComponent::setPeriodicChecksActive (bool shouldBeActive)
+{
+    if (! shouldBeActive)
+    {
+        stopTimer();
+        return;
+    }
+
+    //catches up on what happened while stopped right away
+    timerCallback();
+    startTimer (2000);
+}
+
 void FileBrowserComponent::setMusicLibState(bool isCurrentlyMusicLib)
 {
     musicLibButton->setToggleState(isCurrentlyMusicLib, juce::NotificationType::dontSendNotification);
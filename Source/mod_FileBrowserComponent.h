@@ -55,6 +55,7 @@ namespace juce::mod
 class JUCE_API  FileBrowserComponent  : public Component,
                                         private FileBrowserListener,
                                         private FileFilter,
+                                        private ListBoxModel,
                                         private Timer
 {
 public:
@@ -156,6 +157,21 @@ public:
     /** Refreshes the directory that's currently being listed. */
     void refresh();
 
+    /** Tells the browser that files inside a directory were added, removed or renamed.
+        If it's the directory being listed, it gets refreshed once the changes have settled.
+    */
+    void directoryContentsChanged (const File& directory);
+
+    /** If the listed directory is watched for changes, it isn't checked anymore when
+        the app comes to the foreground.
+    */
+    void setRootIsWatched (bool isWatched);
+
+    /** An unwatched directory (e.g. on a network drive) is listed again in the background
+        at most this often, and only refreshed if that listing differs from the shown one.
+    */
+    static constexpr int minContentsCheckInterval = 30000;
+
     /** Changes the filter that's being used to sift the files. */
     void setFileFilter (const FileFilter* newFileFilter);
 
@@ -269,8 +285,26 @@ public:
 
     void setMusicLibState(bool isCurrentlyMusicLib);
 
+    /** Starts or stops checking whether the app came to the foreground, which refreshes
+        an unwatched directory. Stopped while nothing is shown anyway.
+    */
+    void setPeriodicChecksActive (bool shouldBeActive);
+
     std::function<void()> OnMusicLibButtonClick;
 
+    /** A file found by the search box. Results with saved settings get marked. */
+    struct SearchResult
+    {
+        File file;
+        String description;
+        bool hasSavedSettings = false;
+    };
+
+    /** Called on every change of the search box text. While the box isn't empty,
+        the results are shown instead of the current directory.
+    */
+    std::function<std::vector<SearchResult> (const String& query)> onSearch;
+
 protected:
     /** Returns a list of names and paths for the default places the user might want to look.
 
@@ -297,8 +331,18 @@ private:
     ComboBox currentPathBox;
     std::unique_ptr<Button> goUpButton;
     std::unique_ptr<Button> musicLibButton;
+    TextEditor searchBox;
+    ListBox searchResultsList;
+    std::vector<SearchResult> searchResults;
     TimeSliceThread thread;
     bool wasProcessActive;
+    bool rootIsWatched = false;
+    TimedCallback delayedRefresh { [this] { delayedRefresh.stopTimer(); refresh(); } };
+
+    class ContentsCheck;
+    std::unique_ptr<ContentsCheck> contentsCheck;
+    uint32 lastContentsCheck = 0;
+    void checkContents();
 
     OwnLookAndFeel* myLookAndFeel;
 
@@ -307,6 +351,13 @@ private:
     bool isFileOrDirSuitable (const File&) const;
     void updateSelectedPath();
     bool isMusicLibButtonVisible();
+    void updateSearchResults();
+
+    int getNumRows() override;
+    void paintListBoxItem (int rowNumber, Graphics&, int width, int height, bool rowIsSelected) override;
+    void listBoxItemClicked (int row, const MouseEvent&) override;
+    void listBoxItemDoubleClicked (int row, const MouseEvent&) override;
+    void returnKeyPressed (int lastRowSelected) override;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FileBrowserComponent)
 };